@@ -0,0 +1,257 @@
+/*
+* This file is part of the BSGS distribution (https://github.com/JeanLucPons/Kangaroo).
+* Copyright (c) 2020 Jean Luc PONS.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Kangaroo.h"
+#include "Timer.h"
+#include <string.h>
+#define _USE_MATH_DEFINES
+#include <math.h>
+#ifndef WIN64
+#include <pthread.h>
+#endif
+
+using namespace std;
+
+// Number of table entries recomputed per batch
+#define FILTER_GRP_SIZE 4096
+
+// ----------------------------------------------------------------------------
+
+double Kangaroo::ProjectedRAM(int dp) {
+
+  // Expected table size of this server (MB) with the current number of kangaroos
+  double op;
+  double ram;
+  ComputeExpected((double)dp,&op,&ram);
+  return ram / (double)nbShard;
+
+}
+
+// ----------------------------------------------------------------------------
+
+int Kangaroo::FitDP(int dp) {
+
+  if(maxRam <= 0)
+    return dp;
+
+  int fit = dp;
+  while(fit < 64 && ProjectedRAM(fit) > (double)maxRam)
+    fit++;
+
+  if(fit != dp)
+    ::printf("DP size raised from %d to %d (RAM budget %dMB)\n",dp,fit,maxRam);
+
+  return fit;
+
+}
+
+// ----------------------------------------------------------------------------
+
+void Kangaroo::AdaptDP(bool lock) {
+
+  if(maxRam <= 0 || dpSize >= 64 || endOfSearch)
+    return;
+
+  double ram = ProjectedRAM(dpSize);
+  double used = hashTable.GetSizeMB();
+  if(ram <= (double)maxRam && used <= (double)maxRam)
+    return;
+
+  // Each extra bit halves the DP rate and, after filtering, the stored entries
+  // (bucket allocation is not released below 16 slots)
+  uint64_t nbItem = hashTable.GetNbItem();
+  double entries = (double)nbItem * (double)(sizeof(ENTRY) + sizeof(ENTRY *)) / (1024.0 * 1024.0);
+  double fixed = used - entries;
+  if(fixed >= (double)maxRam)
+    entries = 0.0;
+  int newDP = dpSize;
+  while(newDP < 64 && (ProjectedRAM(newDP) > (double)maxRam || fixed + entries > (double)maxRam)) {
+    newDP++;
+    entries /= 2.0;
+  }
+  if(newDP == (int)dpSize)
+    return;
+
+  ::printf("\nRAM budget exceeded [Projected %.1fMB][Table %.1fMB][Max %dMB]\n",ram,used,maxRam);
+
+  if(lock) {
+    LOCK(ghMutex);
+  }
+
+  double t0 = Timer::get_tick();
+  nbItem = hashTable.GetNbItem();
+  SetDP(newDP);
+  uint64_t removed = FilterTable();
+  ComputeExpected((double)dpSize,&expectedNbOp,&expectedMem);
+  double t1 = Timer::get_tick();
+
+  if(lock) {
+    UNLOCK(ghMutex);
+  }
+
+  ::printf("DP table filtered: %.0f/%.0f entries removed [%s][%.1fs]\n",(double)removed,(double)nbItem,
+           hashTable.GetSizeInfo().c_str(),t1 - t0);
+
+}
+
+// ----------------------------------------------------------------------------
+
+#ifdef WIN64
+DWORD WINAPI _FilterTable(LPVOID lpParam) {
+#else
+void *_FilterTable(void *lpParam) {
+#endif
+  TH_PARAM *p = (TH_PARAM *)lpParam;
+  p->obj->FilterTablePart(p);
+  return 0;
+}
+
+uint64_t Kangaroo::FilterTable() {
+
+  // Split the hash table in contiguous bucket ranges
+  int nbTh = nbHerdThread;
+  if(nbTh < 1) nbTh = 1;
+
+  TH_PARAM *params = (TH_PARAM *)malloc(nbTh * sizeof(TH_PARAM));
+  THREAD_HANDLE *thHandles = (THREAD_HANDLE *)malloc(nbTh * sizeof(THREAD_HANDLE));
+  memset(params,0,nbTh * sizeof(TH_PARAM));
+
+  for(int i = 0; i < nbTh; i++) {
+    params[i].threadId = i;
+    params[i].isRunning = true;
+    params[i].hStart = (uint32_t)(((uint64_t)i * HASH_SIZE) / nbTh);
+    params[i].hStop = (uint32_t)(((uint64_t)(i + 1) * HASH_SIZE) / nbTh);
+    thHandles[i] = LaunchThread(_FilterTable,params + i);
+  }
+
+  JoinThreads(thHandles,nbTh);
+  FreeHandles(thHandles,nbTh);
+
+  uint64_t removed = 0;
+  for(int i = 0; i < nbTh; i++)
+    removed += params[i].nbKangaroo;
+
+  free(params);
+  free(thHandles);
+
+  return removed;
+
+}
+
+// ----------------------------------------------------------------------------
+
+static bool MatchX(Point &P,ENTRY *e) {
+  return P.x.bits64[0] == e->x.i64[0] && P.x.bits64[1] == e->x.i64[1];
+}
+
+void Kangaroo::FilterTablePart(TH_PARAM *p) {
+
+  // The table stores only the 128 LSB of x, the position of each entry is
+  // recomputed from its travelled distance to test the new DP mask
+  vector<ENTRY *> entry;
+  vector<Int> dist;
+  vector<uint32_t> type;
+  vector<Point> wild;
+  vector<Point> key;
+  vector<uint32_t> wIdx;
+  vector<bool> drop;
+  uint64_t removed = 0;
+  uint32_t h = p->hStart;
+
+  while(h < p->hStop) {
+
+    // Gather a group of buckets
+    uint32_t h0 = h;
+    entry.clear();
+    dist.clear();
+    type.clear();
+    while(h < p->hStop && entry.size() < FILTER_GRP_SIZE) {
+      for(uint32_t i = 0; i < hashTable.E[h].nbItem; i++) {
+        Int d;
+        uint32_t kType;
+        ENTRY *e = hashTable.E[h].items[i];
+        HashTable::CalcDistAndType(e->d,&d,&kType);
+        entry.push_back(e);
+        dist.push_back(d);
+        type.push_back(kType);
+      }
+      h++;
+    }
+
+    if(entry.size() == 0)
+      continue;
+
+    // Tame: dG
+    vector<Point> P = secp->ComputePublicKeys(dist);
+
+    // Wild: k+dG, or -k+dG when the kangaroo has been folded by the symmetry
+    drop.assign(entry.size(),false);
+    for(int pass = 0; pass < 2; pass++) {
+
+      Point &k = (pass == 0) ? keyToSearch : keyToSearchNeg;
+      wild.clear();
+      key.clear();
+      wIdx.clear();
+      for(uint32_t i = 0; i < (uint32_t)entry.size(); i++) {
+        if(type[i] == WILD && !dist[i].IsZero() && (pass == 0 || !drop[i])) {
+          wild.push_back(P[i]);
+          key.push_back(k);
+          wIdx.push_back(i);
+        }
+      }
+      if(wild.size() == 0)
+        break;
+
+      vector<Point> W = secp->AddDirect(wild,key);
+      for(uint32_t i = 0; i < (uint32_t)wIdx.size(); i++) {
+        if(MatchX(W[i],entry[wIdx[i]])) {
+          P[wIdx[i]] = W[i];
+          drop[wIdx[i]] = true;
+        }
+      }
+
+    }
+
+    // An entry is dropped only if its position has been recovered and does not
+    // satisfy the new mask, unresolved entries are kept
+    for(uint32_t i = 0; i < (uint32_t)entry.size(); i++) {
+      bool found = (type[i] == WILD) ? drop[i] : MatchX(P[i],entry[i]);
+      drop[i] = found && !IsDP(P[i].x.bits64[3]);
+    }
+
+    // Compact buckets (order is preserved)
+    uint32_t k = 0;
+    for(uint32_t hh = h0; hh < h; hh++) {
+      HASH_ENTRY &b = hashTable.E[hh];
+      uint32_t nb = 0;
+      for(uint32_t i = 0; i < b.nbItem; i++,k++) {
+        if(drop[k]) {
+          HashTable::FreeEntry(b.items[i]);
+          removed++;
+        } else {
+          b.items[nb++] = b.items[i];
+        }
+      }
+      b.nbItem = nb;
+      hashTable.Shrink(hh);
+    }
+
+  }
+
+  p->nbKangaroo = removed;
+
+}
@@ -0,0 +1,398 @@
+/*
+* This file is part of the BSGS distribution (https://github.com/JeanLucPons/Kangaroo).
+* Copyright (c) 2020 Jean Luc PONS.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Kangaroo.h"
+#include "Timer.h"
+#include <string.h>
+#include <algorithm>
+#ifndef WIN64
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+#define TUNE_FILE   "kangaroo.tune" // Per host cache (current directory)
+#define TUNE_WARMUP 200             // ms
+#define TUNE_TIME   600             // ms per candidate
+
+#define PLACE_FREE    0 // Not pinned
+#define PLACE_SPREAD  1 // One thread per physical core first
+#define PLACE_COMPACT 2 // Fill the SMT siblings of a core first
+
+static const char *placeName[3] = { "free","spread","compact" };
+static const int grpCandidate[] = { 256,512,1024,2048,4096 };
+
+// ----------------------------------------------------------------------------
+
+// Allowed logical CPUs in the order of the placement, returns the number of physical cores
+// (0 if the topology is unknown)
+static int GetPlacement(int placement,vector<int> &cpus) {
+
+  cpus.clear();
+
+#ifndef WIN64
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if(sched_getaffinity(0,sizeof(set),&set) != 0)
+    return 0;
+
+  // (package,core) -> logical CPUs
+  map<pair<int,int>,vector<int>> cores;
+  for(int c = 0; c < CPU_SETSIZE; c++) {
+    if(!CPU_ISSET(c,&set))
+      continue;
+    char name[128];
+    int core = -1;
+    int pkg = 0;
+    ::sprintf(name,"/sys/devices/system/cpu/cpu%d/topology/core_id",c);
+    FILE *f = fopen(name,"r");
+    if(f == NULL) return 0;
+    if(fscanf(f,"%d",&core) != 1) core = c;
+    fclose(f);
+    ::sprintf(name,"/sys/devices/system/cpu/cpu%d/topology/physical_package_id",c);
+    f = fopen(name,"r");
+    if(f) {
+      if(fscanf(f,"%d",&pkg) != 1) pkg = 0;
+      fclose(f);
+    }
+    cores[make_pair(pkg,core)].push_back(c);
+  }
+
+  if(placement == PLACE_COMPACT) {
+
+    for(auto it = cores.begin(); it != cores.end(); it++)
+      cpus.insert(cpus.end(),it->second.begin(),it->second.end());
+
+  } else {
+
+    // Cores ordered by core id then package (sockets alternate)
+    vector<pair<int,int>> order;
+    size_t maxSibling = 0;
+    for(auto it = cores.begin(); it != cores.end(); it++) {
+      order.push_back(make_pair(it->first.second,it->first.first));
+      maxSibling = max(maxSibling,it->second.size());
+    }
+    sort(order.begin(),order.end());
+    for(size_t r = 0; r < maxSibling; r++) {
+      for(size_t i = 0; i < order.size(); i++) {
+        vector<int> &s = cores[make_pair(order[i].second,order[i].first)];
+        if(r < s.size())
+          cpus.push_back(s[r]);
+      }
+    }
+
+  }
+
+  return (int)cores.size();
+
+#else
+
+  return 0;
+
+#endif
+
+}
+
+static string GetHostKey(int maxThread) {
+
+  char host[256];
+  strcpy(host,"localhost");
+#ifdef WIN64
+  DWORD size = sizeof(host);
+  GetComputerNameA(host,&size);
+#else
+  gethostname(host,sizeof(host));
+  host[sizeof(host) - 1] = 0;
+#endif
+
+  char key[512];
+#ifdef USE_SYMMETRY
+  ::sprintf(key,"%s %d %d sym",host,Timer::getCoreNumber(),maxThread);
+#else
+  ::sprintf(key,"%s %d %d std",host,Timer::getCoreNumber(),maxThread);
+#endif
+  return string(key);
+
+}
+
+// ----------------------------------------------------------------------------
+
+void Kangaroo::PinThread(int thId) {
+
+#ifndef WIN64
+  if(cpuPin.size() == 0) {
+    PinNode(thId);
+    return;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpuPin[thId % cpuPin.size()],&set);
+  pthread_setaffinity_np(pthread_self(),sizeof(set),&set);
+#endif
+
+}
+
+#ifdef WIN64
+DWORD WINAPI _TuneThread(LPVOID lpParam) {
+#else
+void *_TuneThread(void *lpParam) {
+#endif
+  TH_PARAM *p = (TH_PARAM *)lpParam;
+  p->obj->TuneThread(p);
+  return 0;
+}
+
+void Kangaroo::TuneThread(TH_PARAM *p) {
+
+  int n = (int)p->nbKangaroo;
+  int thId = p->threadId;
+  PinThread(thId);
+
+  IntGroup *grp = new IntGroup(n);
+  Int *dx = new Int[n];
+  Int *px = new Int[n];
+  Int *py = new Int[n];
+  Int *pd = new Int[n];
+  uint64_t *symClass = new uint64_t[n]();
+
+  vector<Int> k(n);
+  for(int i = 0; i < n; i++)
+    k[i].Rand(128);
+  vector<Point> P = secp->ComputePublicKeys(k);
+  for(int i = 0; i < n; i++) {
+    px[i].Set(&P[i].x);
+    py[i].Set(&P[i].y);
+    pd[i].Set(&k[i]);
+  }
+
+  p->hasStarted = true;
+
+  // Same work as SolveKeyCPU without DP
+  uint64_t nbDP = 0;
+  while(!endOfSearch) {
+    JumpHerd(n,px,py,pd,symClass,grp,dx);
+    for(int g = 0; g < n; g++)
+      if(IsDP(px[g].bits64[3])) nbDP++;
+    stats[thId].step += n;
+  }
+  stats[thId].nbDP = nbDP;
+
+  delete grp;
+  delete[] dx;
+  delete[] px;
+  delete[] py;
+  delete[] pd;
+  delete[] symClass;
+
+  p->isRunning = false;
+
+}
+
+// ----------------------------------------------------------------------------
+
+double Kangaroo::TuneRun(int grpSize,int nbThread) {
+
+  TH_PARAM *params = (TH_PARAM *)malloc(nbThread * sizeof(TH_PARAM));
+  THREAD_HANDLE *thHandles = (THREAD_HANDLE *)malloc(nbThread * sizeof(THREAD_HANDLE));
+  memset(params,0,nbThread * sizeof(TH_PARAM));
+  memset(stats,0,sizeof(stats));
+
+  // hasStarted() and getCPUCount() work on nbCPUThread + nbGPUThread
+  int nbCPU = nbCPUThread;
+  int nbGPU = nbGPUThread;
+  nbCPUThread = nbThread;
+  nbGPUThread = 0;
+
+  endOfSearch = false;
+  for(int i = 0; i < nbThread; i++) {
+    params[i].threadId = i;
+    params[i].isRunning = true;
+    params[i].nbKangaroo = grpSize;
+    thHandles[i] = LaunchThread(_TuneThread,params + i);
+  }
+
+  while(!hasStarted(params))
+    Timer::SleepMillis(5);
+  Timer::SleepMillis(TUNE_WARMUP);
+
+  uint64_t c0 = getCPUCount();
+  double t0 = Timer::get_tick();
+  Timer::SleepMillis(TUNE_TIME);
+  uint64_t c1 = getCPUCount();
+  double t1 = Timer::get_tick();
+
+  endOfSearch = true;
+  JoinThreads(thHandles,nbThread);
+  FreeHandles(thHandles,nbThread);
+  free(params);
+  free(thHandles);
+  endOfSearch = false;
+  nbCPUThread = nbCPU;
+  nbGPUThread = nbGPU;
+
+  return (double)(c1 - c0) / (t1 - t0);
+
+}
+
+// ----------------------------------------------------------------------------
+
+bool Kangaroo::LoadTune(string &key,int *grpSize,int *nbThread,int *placement) {
+
+  FILE *f = fopen(TUNE_FILE,"r");
+  if(f == NULL)
+    return false;
+
+  char line[1024];
+  bool found = false;
+  while(!found && fgets(line,sizeof(line),f)) {
+    string l(line);
+    if(l.compare(0,key.length(),key) != 0 || l.length() <= key.length() || l[key.length()] != ' ')
+      continue;
+    char place[64];
+    if(sscanf(line + key.length(),"%d %d %63s",grpSize,nbThread,place) != 3)
+      continue;
+    for(int i = 0; i < 3; i++) {
+      if(strcmp(place,placeName[i]) == 0) {
+        *placement = i;
+        found = true;
+      }
+    }
+  }
+  fclose(f);
+
+  return found && *grpSize >= 8 && *nbThread > 0 && *nbThread <= 256;
+
+}
+
+void Kangaroo::SaveTune(string &key,int grpSize,int nbThread,int placement,double rate) {
+
+  // Replace the line of this host
+  vector<string> lines;
+  FILE *f = fopen(TUNE_FILE,"r");
+  if(f) {
+    char line[1024];
+    while(fgets(line,sizeof(line),f)) {
+      string l(line);
+      if(l.compare(0,key.length() + 1,key + " ") != 0)
+        lines.push_back(l);
+    }
+    fclose(f);
+  }
+
+  f = fopen(TUNE_FILE,"w");
+  if(f == NULL) {
+    ::printf("Autotune: Cannot write %s %s\n",TUNE_FILE,::strerror(errno));
+    return;
+  }
+  for(size_t i = 0; i < lines.size(); i++)
+    fputs(lines[i].c_str(),f);
+  fprintf(f,"%s %d %d %s %.0f\n",key.c_str(),grpSize,nbThread,placeName[placement],rate);
+  fclose(f);
+
+}
+
+// ----------------------------------------------------------------------------
+
+void Kangaroo::AutoTune() {
+
+  int maxThread = nbCPUThread;
+  string key = GetHostKey(maxThread);
+  int bestGrp = CPU_GRP_SIZE;
+  int bestThread = nbCPUThread;
+  int bestPlace = PLACE_FREE;
+  vector<int> cpus;
+
+  if(LoadTune(key,&bestGrp,&bestThread,&bestPlace)) {
+
+    ::printf("Autotune: %s [grp %d][threads %d][%s] (cached in %s)\n",key.c_str(),bestGrp,bestThread,
+             placeName[bestPlace],TUNE_FILE);
+
+  } else {
+
+    // Temporary jump points, CreateJumpTable() sets the real ones
+    vector<Int> k(nbJump);
+    for(int i = 0; i < nbJump; i++)
+      k[i].Rand(128);
+    vector<Point> J = secp->ComputePublicKeys(k);
+    for(int i = 0; i < nbJump; i++) {
+      jumpDistance[i].Set(&k[i]);
+      jumpPointx[i].Set(&J[i].x);
+      jumpPointy[i].Set(&J[i].y);
+    }
+    uint64_t dMaskSave = dMask;
+    dMask = 0xFFFF000000000000ULL;
+
+    double bestRate = 0.0;
+    cpuPin.clear();
+
+    // Group size
+    for(int i = 0; i < (int)(sizeof(grpCandidate) / sizeof(int)); i++) {
+      double rate = TuneRun(grpCandidate[i],maxThread);
+      ::printf("Autotune: [grp %4d][threads %d][free] %.2f MK/s\n",grpCandidate[i],maxThread,rate / 1e6);
+      if(rate > bestRate) {
+        bestRate = rate;
+        bestGrp = grpCandidate[i];
+      }
+    }
+
+    // Thread count (SMT on/off) and placement
+    int nbCore = GetPlacement(PLACE_SPREAD,cpus);
+    int nbCpu = (int)cpus.size();
+    vector<int> threads;
+    threads.push_back(maxThread);
+    if(nbCore > 0 && nbCore < maxThread && nbCore < nbCpu)
+      threads.push_back(nbCore);
+
+    for(size_t t = 0; t < threads.size(); t++) {
+      for(int place = PLACE_FREE; place <= PLACE_COMPACT; place++) {
+        if(place == PLACE_FREE && t == 0)
+          continue;
+        if(place != PLACE_FREE && (nbCore == 0 || threads[t] > nbCpu))
+          continue;
+        if(place == PLACE_COMPACT && nbCore == nbCpu)
+          continue;
+        if(place == PLACE_FREE)
+          cpuPin.clear();
+        else
+          GetPlacement(place,cpuPin);
+        double rate = TuneRun(bestGrp,threads[t]);
+        ::printf("Autotune: [grp %4d][threads %d][%s] %.2f MK/s\n",bestGrp,threads[t],placeName[place],rate / 1e6);
+        if(rate > bestRate) {
+          bestRate = rate;
+          bestThread = threads[t];
+          bestPlace = place;
+        }
+      }
+    }
+
+    dMask = dMaskSave;
+    SaveTune(key,bestGrp,bestThread,bestPlace,bestRate);
+    ::printf("Autotune: [grp %d][threads %d][%s] %.2f MK/s, saved in %s\n",bestGrp,bestThread,
+             placeName[bestPlace],bestRate / 1e6,TUNE_FILE);
+
+  }
+
+  CPU_GRP_SIZE = bestGrp;
+  nbCPUThread = bestThread;
+  if(bestPlace == PLACE_FREE)
+    cpuPin.clear();
+  else if(GetPlacement(bestPlace,cpuPin) == 0 || (int)cpuPin.size() < nbCPUThread)
+    cpuPin.clear();
+
+}
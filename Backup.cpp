@@ -124,6 +124,13 @@ FILE *Kangaroo::ReadHeader(std::string fileName, uint32_t *version, int type) {
   }
 
   ::fread(&versionF,sizeof(uint32_t),1,f);
+
+  // Herd configuration (b2), the returned version is the jump configuration
+  fileHerdConfig = HERD_DEFAULT;
+  if(versionF & 4) {
+    ::fread(&fileHerdConfig,sizeof(uint32_t),1,f);
+    versionF &= ~4U;
+  }
   if(version) *version = versionF;
 
   if(head!=type) {
@@ -154,9 +161,16 @@ bool Kangaroo::LoadWork(string &fileName) {
 
   if(!clientMode) {
 
-    fRead = ReadHeader(fileName,NULL,HEADW);
+    uint32_t version;
+    fRead = ReadHeader(fileName,&version,HEADW);
     if(fRead == NULL)
       return false;
+    if(!SetJumpConfig(version,fileName))
+      return false;
+    if(GetHerdConfig() != fileHerdConfig && GetHerdConfig() != HERD_DEFAULT)
+      ::printf("Warning, herd layout forced to the one of %s\n",fileName.c_str());
+    if(!SetHerdConfig(fileHerdConfig,fileName))
+      return false;
 
     keysToSearch.clear();
     Point key;
@@ -225,7 +239,7 @@ void Kangaroo::FetchWalks(uint64_t nbWalk,Int *x,Int *y,Int *d) {
   if(n<(int64_t)nbWalk) {
     int64_t empty = nbWalk - n;
     // Fill empty kanagaroo
-    CreateHerd((int)empty,&(x[n]),&(y[n]),&(d[n]),TAME);
+    CreateHerd((int)empty,&(x[n]),&(y[n]),&(d[n]),(uint64_t)n);
   }
 
 }
@@ -258,7 +272,7 @@ void Kangaroo::FetchWalks(uint64_t nbWalk,std::vector<int128_t>& kangs,Int* x,In
 
     for(n = 0; n < avail; n++) {
 
-      if(n % 2 == TAME) {
+      if(KangarooType(n) == TAME) {
         Sp.push_back(Z);
       }
       else {
@@ -283,7 +297,7 @@ void Kangaroo::FetchWalks(uint64_t nbWalk,std::vector<int128_t>& kangs,Int* x,In
   if(avail < nbWalk) {
     int64_t empty = nbWalk - avail;
     // Fill empty kanagaroo
-    CreateHerd((int)empty,&(x[n]),&(y[n]),&(d[n]),TAME);
+    CreateHerd((int)empty,&(x[n]),&(y[n]),&(d[n]),(uint64_t)n);
   }
 
 }
@@ -369,13 +383,18 @@ bool Kangaroo::SaveHeader(string fileName,FILE* f,int type,uint64_t totalCount,d
 
   // Header
   uint32_t head = type;
-  uint32_t version = 0;
+  uint32_t version = GetJumpConfig();
+  uint32_t herdConfig = GetHerdConfig();
+  if(herdConfig != HERD_DEFAULT)
+    version |= 4;
   if(::fwrite(&head,sizeof(uint32_t),1,f) != 1) {
     ::printf("SaveHeader: Cannot write to %s\n",fileName.c_str());
     ::printf("%s\n",::strerror(errno));
     return false;
   }
   ::fwrite(&version,sizeof(uint32_t),1,f);
+  if(version & 4)
+    ::fwrite(&herdConfig,sizeof(uint32_t),1,f);
 
   if(type==HEADW) {
 
@@ -441,6 +460,7 @@ void Kangaroo::SaveServerWork() {
   time_t now = time(NULL);
   ctimeBuff = ctime(&now);
   ::printf("done [%.1f MB] [%s] %s",(double)size / (1024.0*1024.0),GetTimeStr(t1 - t0).c_str(),ctimeBuff);
+  SaveDone(t1 - t0);
 
   saveRequest = false;
 
@@ -502,12 +522,15 @@ void Kangaroo::SaveWork(uint64_t totalCount,double totalTime,TH_PARAM *threads,i
         int128_t D;
         uint64_t h;
         for(uint64_t n = 0; n < threads[i].nbKangaroo; n++) {
-          HashTable::Convert(&threads[i].px[n],&threads[i].distance[n],n%2,&h,&X,&D);
+          HashTable::Convert(&threads[i].px[n],&threads[i].distance[n],KangarooType(n),&h,&X,&D);
           kangs.push_back(D);
         }
       }
+      // Unblock threads during the transfer (dedicated connection, see SendKangaroosToServer)
+      saveRequest = false;
+      UNLOCK(saveMutex);
       SendKangaroosToServer(fileName,kangs);
-      size = kangs.size()*16 + 16;
+      size = kangs.size()*16 + 48;
       goto end;
 
     } else {
@@ -558,16 +581,17 @@ void Kangaroo::SaveWork(uint64_t totalCount,double totalTime,TH_PARAM *threads,i
     hashTable.Reset();
 
   // Unblock threads
-end:
   saveRequest = false;
   UNLOCK(saveMutex);
 
+end:
   double t1 = Timer::get_tick();
 
   char *ctimeBuff;
   time_t now = time(NULL);
   ctimeBuff = ctime(&now);
   ::printf("done [%.1f MB] [%s] %s",(double)size/(1024.0*1024.0),GetTimeStr(t1 - t0).c_str(),ctimeBuff);
+  SaveDone(t1 - t0);
 
 }
 
@@ -628,6 +652,18 @@ void Kangaroo::WorkInfo(std::string &fName) {
   }
 
   ::printf("Version   : %d\n",version);
+  if(version & 2) {
+    ::printf("Jumps     : %d [Jump file]\n",version >> 16);
+  } else if(SetJumpConfig(version,fileName)) {
+    if(jumpMean > 0)
+      ::printf("Jumps     : %d [Avg 2^%d]\n",nbJump,jumpMean);
+    else
+      ::printf("Jumps     : %d\n",nbJump);
+  }
+  if(SetHerdConfig(fileHerdConfig,fileName))
+    ::printf("Herd      : %s\n",GetHerdInfo().c_str());
+  if(version & 8)
+    ::printf("Walk      : four-kangaroo\n");
   ::printf("DP bits   : %d\n",dp1);
   ::printf("Start     : %s\n",RS1.GetBase16().c_str());
   ::printf("Stop      : %s\n",RE1.GetBase16().c_str());
@@ -0,0 +1,190 @@
+/*
+* This file is part of the BSGS distribution (https://github.com/JeanLucPons/Kangaroo).
+* Copyright (c) 2020 Jean Luc PONS.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Kangaroo.h"
+#include "Timer.h"
+#include <string.h>
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <algorithm>
+
+using namespace std;
+
+// ----------------------------------------------------------------------------
+
+static double Percentile(vector<double> &v,double p) {
+
+  // Nearest rank on a sorted vector
+  if(v.size() == 0)
+    return 0.0;
+  size_t r = (size_t)ceil(p * (double)v.size());
+  if(r < 1) r = 1;
+  if(r > v.size()) r = v.size();
+  return v[r - 1];
+
+}
+
+// ----------------------------------------------------------------------------
+
+void Kangaroo::AddBenchResult(double solveTime) {
+
+  BENCH_KEY b;
+  b.count = (double)(getCPUCount() + getGPUCount());
+  b.dead = (double)collisionInSameHerd;
+  b.time = solveTime;
+  b.solved = keyFound;
+  benchResult.push_back(b);
+
+  double SN = pow(2.0,(double)rangePower / 2.0);
+  ::printf("\n[Bench %3d/%d] 2^%.3f (%.3f sqrt(N)) Dead:%d %s\n",(int)benchResult.size(),(int)keysToSearch.size(),
+           log2(b.count),b.count / SN,(int)b.dead,GetTimeStr(solveTime).c_str());
+
+}
+
+// ----------------------------------------------------------------------------
+
+void Kangaroo::BenchSolve(int nbThread,std::vector<int> gpuId,std::vector<int> gridSize,int nbKey,int rangeBits,
+                          std::string &reportFile) {
+
+  if(nbKey <= 0 || rangeBits < 8 || rangeBits > 125) {
+    ::printf("BenchSolve: invalid arguments\n");
+    ::exit(-1);
+  }
+
+  // Puzzle like range [2^rangeBits,2^(rangeBits+1)-1] and random keys
+  rangeStart.SetInt32(1);
+  rangeStart.ShiftL(rangeBits);
+  rangeEnd.Set(&rangeStart);
+  rangeEnd.Add(&rangeStart);
+  rangeEnd.SubOne();
+
+  keysToSearch.clear();
+  for(int i = 0; i < nbKey; i++) {
+    Int k;
+    k.Rand(rangeBits);
+    k.Add(&rangeStart);
+    keysToSearch.push_back(secp->ComputePublicKey(&k));
+  }
+
+  ::printf("Bench: %d random keys\n",nbKey);
+  ::printf("Start:%s\n",rangeStart.GetBase16().c_str());
+  ::printf("Stop :%s\n",rangeEnd.GetBase16().c_str());
+
+  benchMode = true;
+  benchResult.clear();
+  double t0 = Timer::get_tick();
+  Run(nbThread,gpuId,gridSize);
+  double t1 = Timer::get_tick();
+  benchMode = false;
+
+  // Statistics (operations in sqrt(N))
+  double SN = pow(2.0,(double)rangePower / 2.0);
+  vector<double> ops;
+  double totalCount = 0.0;
+  double totalDead = 0.0;
+  double totalTime = 0.0;
+  int nbFailed = 0;
+  for(size_t i = 0; i < benchResult.size(); i++) {
+    totalCount += benchResult[i].count;
+    totalDead += benchResult[i].dead;
+    totalTime += benchResult[i].time;
+    if(benchResult[i].solved)
+      ops.push_back(benchResult[i].count / SN);
+    else
+      nbFailed++;
+  }
+
+  int n = (int)ops.size();
+  double avg = 0.0;
+  double var = 0.0;
+  for(int i = 0; i < n; i++)
+    avg += ops[i];
+  if(n > 0) avg /= (double)n;
+  for(int i = 0; i < n; i++)
+    var += (ops[i] - avg) * (ops[i] - avg);
+  if(n > 1) var /= (double)(n - 1);
+  double err = (n > 0) ? sqrt(var / (double)n) : 0.0;
+  sort(ops.begin(),ops.end());
+  double median = Percentile(ops,0.5);
+  double p95 = Percentile(ops,0.95);
+  double nbKeyDone = (double)benchResult.size();
+  double keyTime = (nbKeyDone > 0.0) ? totalTime / nbKeyDone : 0.0;
+  double keyPerHour = (totalTime > 0.0) ? 3600.0 * nbKeyDone / totalTime : 0.0;
+  double keyRate = (totalTime > 0.0) ? totalCount / totalTime : 0.0;
+  double nbDP = totalCount / pow(2.0,(double)dpSize);
+  double deadRate = (nbDP > 0.0) ? totalDead / nbDP : 0.0;
+
+  ::printf("\nBench: %d/%d solved, range width 2^%d, %.0f kangaroos, DP %d, %d jumps, %s walk\n",n,
+           (int)benchResult.size(),rangePower,(double)totalRW,dpSize,nbJump,fourKangaroo ? "four-kangaroo" : "tame/wild");
+  ::printf("Operations: Avg %.3f [Err %.3f] Median %.3f P95 %.3f Std %.3f sqrt(N) (expected %.3f)\n",avg,err,median,
+           p95,sqrt(var),expectedNbOp / SN);
+  ::printf("Dead: %.1f per key (%.4f%% of DP)\n",totalDead / (nbKeyDone > 0.0 ? nbKeyDone : 1.0),
+           deadRate * 100.0);
+  ::printf("Time: %s per key, %.1f keys/hour, %.2f MK/s\n",GetTimeStr(keyTime).c_str(),keyPerHour,keyRate / 1000000.0);
+
+  if(reportFile.length() == 0)
+    return;
+
+  FILE *f = fopen(reportFile.c_str(),"w");
+  if(f == NULL) {
+    ::printf("BenchSolve: Cannot open %s for writing\n",reportFile.c_str());
+    ::printf("%s\n",::strerror(errno));
+    return;
+  }
+
+  ::fprintf(f,"{\n");
+  ::fprintf(f,"  \"version\": \"%s\",\n",RELEASE);
+#ifdef USE_SYMMETRY
+  ::fprintf(f,"  \"symmetry\": true,\n");
+#else
+  ::fprintf(f,"  \"symmetry\": false,\n");
+#endif
+  ::fprintf(f,"  \"range_bits\": %d,\n",rangePower);
+  ::fprintf(f,"  \"cpu_threads\": %d,\n",nbCPUThread);
+  ::fprintf(f,"  \"gpu_threads\": %d,\n",nbGPUThread);
+  ::fprintf(f,"  \"kangaroos\": %.0f,\n",(double)totalRW);
+  ::fprintf(f,"  \"dp_bits\": %d,\n",dpSize);
+  ::fprintf(f,"  \"jump_config\": %u,\n",GetJumpConfig());
+  ::fprintf(f,"  \"walk\": \"%s\",\n",fourKangaroo ? "four-kangaroo" : "tame/wild");
+  ::fprintf(f,"  \"keys\": %d,\n",(int)benchResult.size());
+  ::fprintf(f,"  \"solved\": %d,\n",n);
+  ::fprintf(f,"  \"failed\": %d,\n",nbFailed);
+  ::fprintf(f,"  \"expected_sqrtn\": %.4f,\n",expectedNbOp / SN);
+  ::fprintf(f,"  \"mean_sqrtn\": %.4f,\n",avg);
+  ::fprintf(f,"  \"stderr_sqrtn\": %.4f,\n",err);
+  ::fprintf(f,"  \"std_sqrtn\": %.4f,\n",sqrt(var));
+  ::fprintf(f,"  \"median_sqrtn\": %.4f,\n",median);
+  ::fprintf(f,"  \"p95_sqrtn\": %.4f,\n",p95);
+  ::fprintf(f,"  \"dead_per_key\": %.2f,\n",totalDead / (nbKeyDone > 0.0 ? nbKeyDone : 1.0));
+  ::fprintf(f,"  \"dead_rate\": %.6f,\n",deadRate);
+  ::fprintf(f,"  \"time_per_key\": %.3f,\n",keyTime);
+  ::fprintf(f,"  \"keys_per_hour\": %.2f,\n",keyPerHour);
+  ::fprintf(f,"  \"key_rate\": %.0f,\n",keyRate);
+  ::fprintf(f,"  \"total_time\": %.3f,\n",t1 - t0);
+  ::fprintf(f,"  \"runs\": [\n");
+  for(size_t i = 0; i < benchResult.size(); i++) {
+    ::fprintf(f,"    {\"ops\": %.0f, \"dead\": %.0f, \"time\": %.3f, \"solved\": %s}%s\n",benchResult[i].count,
+              benchResult[i].dead,benchResult[i].time,benchResult[i].solved ? "true" : "false",
+              (i + 1 < benchResult.size()) ? "," : "");
+  }
+  ::fprintf(f,"  ]\n");
+  ::fprintf(f,"}\n");
+  ::fclose(f);
+
+  ::printf("Report saved: %s\n",reportFile.c_str());
+
+}
@@ -456,19 +456,109 @@ void Kangaroo::Check(std::vector<int> gpuId,std::vector<int> gridSize) {
     ::printf("%s\n",pts2[i].toString().c_str());
   }
 
-  /*
-  // Check jump table
-  for(int i=0;i<128;i++) {
-    rangePower = i;
-    CreateJumpTable();  
+  // Fixed base window trade-off (-gw)
+  int userWindow = secp->GetWindow();
+  for(int w = 4; w <= 16; w += 4) {
+    t0 = Timer::get_tick();
+    secp->SetWindow(w);
+    t1 = Timer::get_tick();
+    double tInit = t1 - t0;
+    vector<Point> pts3;
+    t0 = Timer::get_tick();
+    for(int j = 0; j < nbKey; j++)
+      pts3.push_back(secp->ComputePublicKey(&priv[j]));
+    t1 = Timer::get_tick();
+    double r1 = (double)nbKey / ((t1 - t0)*1000.0);
+    t0 = Timer::get_tick();
+    vector<Point> pts4 = secp->ComputePublicKeys(priv);
+    t1 = Timer::get_tick();
+    double r2 = (double)nbKey / ((t1 - t0)*1000.0);
+    bool wOk = true;
+    for(int j = 0; wOk && j < nbKey; j++)
+      wOk = pts1[j].equals(pts3[j]) && pts1[j].equals(pts4[j]);
+    ::printf("Window %2d [%.1fMB, %.2fs]: ComputePublicKey %.3f KKey/s, ComputePublicKeys %.3f KKey/s %s\n",
+             w,secp->GetTableSize(),tInit,r1,r2,wOk ? "ok" : "failed");
   }
-  */
+  secp->SetWindow(userWindow);
+
+  // Check jump tables (built with ComputePublicKey) against a double and add chain
+  bool jumpOk = true;
+  int userNbJump = nbJump;
+  int userRangePower = rangePower;
+  uint64_t userJumpMask = jumpMask;
+  int32_t userJumpMean = jumpMean;
+  rangePower = 64;
+  for(nbJump = 8; jumpOk && nbJump <= MAX_JUMP; nbJump *= 2) {
+    CreateJumpTable();
+    for(int j = 0; jumpOk && j < nbJump; j++) {
+      Point J(secp->G);
+      for(int b = jumpDistance[j].GetBitLength() - 2; b >= 0; b--) {
+        J = secp->Double(J);
+        if(jumpDistance[j].GetBit(b))
+          J = secp->Add2(J,secp->G);
+      }
+      J.Reduce();
+      jumpOk = J.x.IsEqual(&jumpPointx[j]) && J.y.IsEqual(&jumpPointy[j]);
+      if(!jumpOk) ::printf("Jump table %d wrong at %d\n",nbJump,j);
+    }
+  }
+  nbJump = userNbJump;
+  rangePower = userRangePower;
+  jumpMask = userJumpMask;
+  jumpMean = userJumpMean;
+  if(jumpOk) ::printf("Jump tables [8..%d] ok\n",MAX_JUMP);
+
+  // Check herd creation (full scalar multiplication, incremental and multi-threaded)
+  rangeStart.SetBase16("5B3F38AF935A3640D158E871CE6E9666DB862636383386EE0000000000000000");
+  rangeEnd.SetBase16("5B3F38AF935A3640D158E871CE6E9666DB862636383386EEFFFFFFFFFFFFFFFF");
+  Int hk;
+  hk.SetBase16("5B3F38AF935A3640D158E871CE6E9666DB862636383386EE0000000000123000");
+  keysToSearch.clear();
+  keysToSearch.push_back(secp->ComputePublicKey(&hk));
+  keyIdx = 0;
+  InitRange();
+  InitSearchKey();
+  Point keyNeg = keyToSearch;
+  keyNeg.y.ModNeg();
+
+  bool userHerdStep = herdStep;
+  int nbHerd = 65536;
+  Int *hPx = new Int[nbHerd];
+  Int *hPy = new Int[nbHerd];
+  Int *hD = new Int[nbHerd];
+  for(int mode = 0; mode < 3; mode++) {
+    herdStep = (mode > 0);
+    t0 = Timer::get_tick();
+    if(mode < 2)
+      CreateHerd(nbHerd,hPx,hPy,hD,TAME);
+    else
+      CreateHerdMT(nbHerd,hPx,hPy,hD);
+    t1 = Timer::get_tick();
+    bool herdOk = true;
+    for(int j = 0; herdOk && j < nbHerd; j += 61) {
+      // Under symmetry, a wild kangaroo may be in the class of -key
+      Point P = secp->ComputePublicKey(&hD[j]);
+      Point W1 = (KangarooType(j) == TAME) ? P : secp->AddDirect(keyToSearch,P);
+      Point W2 = (KangarooType(j) == TAME) ? P : secp->AddDirect(keyNeg,P);
+      herdOk = W1.x.IsEqual(&hPx[j]) || W2.x.IsEqual(&hPx[j]);
+      if(!herdOk) ::printf("CreateHerd wrong at %d\n",j);
+    }
+    const char *mName[] = { "CreateHerd","CreateHerd (-hs)","CreateHerdMT (-hs)" };
+    ::printf("%s %d : %.3f KKang/s %s\n",mName[mode],nbHerd,(double)nbHerd / ((t1 - t0)*1000.0),herdOk ? "ok" : "failed");
+  }
+  herdStep = userHerdStep;
+  delete[] hPx;
+  delete[] hPy;
+  delete[] hD;
 
 #ifdef WITHGPU
 
   // Check gpu
   if(useGpu) {
 
+    int userRangePower = rangePower;
+    uint64_t userJumpMask = jumpMask;
+    int32_t userJumpMean = jumpMean;
     rangePower = 64;
     rangeStart.SetBase16("5B3F38AF935A3640D158E871CE6E9666DB862636383386EE0000000000000000");
     rangeEnd.SetBase16("5B3F38AF935A3640D158E871CE6E9666DB862636383386EEFFFFFFFFFFFFFFFF");
@@ -509,112 +599,122 @@ void Kangaroo::Check(std::vector<int> gpuId,std::vector<int> gridSize) {
     pk.Rand(256);
     keyToSearch = secp->ComputePublicKey(&pk);
 
-    CreateHerd(nb,cpuPx,cpuPy,cpuD,TAME);
-    for(int i=0;i<nb;i++) lastJump[i]=NB_JUMP;
+    // Check each jump table size
+    for(nbJump = 8; nbJump <= MAX_JUMP; nbJump *= 2) {
 
-    CreateJumpTable();
+      gpuFound.clear();
+      CreateHerd(nb,cpuPx,cpuPy,cpuD,TAME);
+      for(int i=0;i<nb;i++) lastJump[i]=MAX_JUMP;
 
-    h.SetParams(dMask,jumpDistance,jumpPointx,jumpPointy);
-    h.SetWildOffset(&rangeWidthDiv2);
-    h.SetKangaroos(cpuPx,cpuPy,cpuD);
+      CreateJumpTable();
 
-    // Test single
-    uint64_t r = rndl() % nb;
-    CreateHerd(1,&cpuPx[r],&cpuPy[r],&cpuD[r],r % 2);
-    h.SetKangaroo(r,&cpuPx[r],&cpuPy[r],&cpuD[r]);
+      h.SetParams(dMask,jumpDistance,jumpPointx,jumpPointy,nbJump);
+      h.SetWildOffset(&rangeWidthDiv2);
+      h.SetKangaroos(cpuPx,cpuPy,cpuD);
 
-    h.Launch(gpuFound);
-    h.GetKangaroos(gpuPx,gpuPy,gpuD);
-    h.Launch(gpuFound);
-    ::printf("DP found: %d\n",(int)gpuFound.size());
+      // Test single
+      uint64_t r = rndl() % nb;
+      CreateHerd(1,&cpuPx[r],&cpuPy[r],&cpuD[r],r);
+      h.SetKangaroo(r,&cpuPx[r],&cpuPy[r],&cpuD[r]);
 
-    // Do the same on CPU
-    Int _1;
-    _1.SetInt32(1);
-    for(int r = 0; r<NB_RUN; r++) {
-      for(int i = 0; i<nb; i++) {
-        uint64_t jmp = (cpuPx[i].bits64[0] % NB_JUMP);
+      h.Launch(gpuFound);
+      h.GetKangaroos(gpuPx,gpuPy,gpuD);
+      h.Launch(gpuFound);
+      ::printf("DP found: %d\n",(int)gpuFound.size());
+
+      // Do the same on CPU
+      Int _1;
+      _1.SetInt32(1);
+      for(int r = 0; r<NB_RUN; r++) {
+        for(int i = 0; i<nb; i++) {
+          uint64_t jmp = (cpuPx[i].bits64[0] & jumpMask);
 
 #ifdef USE_SYMMETRY
-        // Limit cycle
-        if(jmp == lastJump[i]) jmp = (lastJump[i] + 1) % NB_JUMP;
+          // Limit cycle
+          if(jmp == lastJump[i]) jmp = (lastJump[i] + 1) & jumpMask;
 #endif
 
-        Point J(&jumpPointx[jmp],&jumpPointy[jmp],&_1);
-        Point P(&cpuPx[i],&cpuPy[i],&_1);
-        P = secp->AddDirect(P,J);
-        cpuPx[i].Set(&P.x);
-        cpuPy[i].Set(&P.y);
+          Point J(&jumpPointx[jmp],&jumpPointy[jmp],&_1);
+          Point P(&cpuPx[i],&cpuPy[i],&_1);
+          P = secp->AddDirect(P,J);
+          cpuPx[i].Set(&P.x);
+          cpuPy[i].Set(&P.y);
 
-        cpuD[i].ModAddK1order(&jumpDistance[jmp]);
+          cpuD[i].ModAddK1order(&jumpDistance[jmp]);
 
 #ifdef USE_SYMMETRY
-        // Equivalence symmetry class switch
-        if(cpuPy[i].ModPositiveK1())
-          cpuD[i].ModNegK1order();
-        lastJump[i] = jmp;
+          // Equivalence symmetry class switch
+          if(cpuPy[i].ModPositiveK1())
+            cpuD[i].ModNegK1order();
+          lastJump[i] = jmp;
 #endif
 
-        if(IsDP(cpuPx[i].bits64[3])) {
-
-          // Search for DP found
-          bool found = false;
-          int j = 0;
-          while(!found && j<(int)gpuFound.size()) {
-            found = gpuFound[j].x.IsEqual(&cpuPx[i]) &&
-              gpuFound[j].d.IsEqual(&cpuD[i]) &&
-              gpuFound[j].kIdx == (uint64_t)i;
-            if(!found) j++;
-          }
-
-          if(found) {
-            gpuFound.erase(gpuFound.begin() + j);
-          } else {
-            ::printf("DP Mismatch:\n");
+          if(IsDP(cpuPx[i].bits64[3])) {
+
+            // Search for DP found
+            bool found = false;
+            int j = 0;
+            while(!found && j<(int)gpuFound.size()) {
+              found = gpuFound[j].x.IsEqual(&cpuPx[i]) &&
+                gpuFound[j].d.IsEqual(&cpuD[i]) &&
+                gpuFound[j].kIdx == (uint64_t)i;
+              if(!found) j++;
+            }
+
+            if(found) {
+              gpuFound.erase(gpuFound.begin() + j);
+            } else {
+              ::printf("DP Mismatch:\n");
 #ifdef WIN64
-            ::printf("[%d] %s [0x%016I64X]\n",j,gpuFound[j].x.GetBase16().c_str(),gpuFound[j].kIdx);
+              ::printf("[%d] %s [0x%016I64X]\n",j,gpuFound[j].x.GetBase16().c_str(),gpuFound[j].kIdx);
 #else
-            ::printf("[%d] %s [0x%" PRIx64 "]\n",j,gpuFound[j].x.GetBase16().c_str(),gpuFound[j].kIdx);
+              ::printf("[%d] %s [0x%" PRIx64 "]\n",j,gpuFound[j].x.GetBase16().c_str(),gpuFound[j].kIdx);
 #endif
-            ::printf("[%d] %s \n",i,cpuPx[gpuFound[i].kIdx].GetBase16().c_str());
-            return;
+              ::printf("[%d] %s \n",i,cpuPx[gpuFound[i].kIdx].GetBase16().c_str());
+              return;
+            }
+
           }
 
         }
-
       }
-    }
 
-    // Compare kangaroos
-    int nbFault = 0;
-    bool firstFaut = true;
-    for(int i = 0; i<nb; i++) {
-      bool ok = gpuPx[i].IsEqual(&cpuPx[i]) && gpuPy[i].IsEqual(&cpuPy[i]) &&
-                gpuD[i].IsEqual(&cpuD[i]);
-      if(!ok) {
-        nbFault++;
-        if(firstFaut) {
-          ::printf("CPU Kx=%s\n",cpuPx[i].GetBase16().c_str());
-          ::printf("CPU Ky=%s\n",cpuPy[i].GetBase16().c_str());
-          ::printf("CPU Kd=%s\n",cpuD[i].GetBase16().c_str());
-          ::printf("GPU Kx=%s\n",gpuPx[i].GetBase16().c_str());
-          ::printf("GPU Ky=%s\n",gpuPy[i].GetBase16().c_str());
-          ::printf("GPU Kd=%s\n",gpuD[i].GetBase16().c_str());
-          firstFaut = false;
+      // Compare kangaroos
+      int nbFault = 0;
+      bool firstFaut = true;
+      for(int i = 0; i<nb; i++) {
+        bool ok = gpuPx[i].IsEqual(&cpuPx[i]) && gpuPy[i].IsEqual(&cpuPy[i]) &&
+                  gpuD[i].IsEqual(&cpuD[i]);
+        if(!ok) {
+          nbFault++;
+          if(firstFaut) {
+            ::printf("CPU Kx=%s\n",cpuPx[i].GetBase16().c_str());
+            ::printf("CPU Ky=%s\n",cpuPy[i].GetBase16().c_str());
+            ::printf("CPU Kd=%s\n",cpuD[i].GetBase16().c_str());
+            ::printf("GPU Kx=%s\n",gpuPx[i].GetBase16().c_str());
+            ::printf("GPU Ky=%s\n",gpuPy[i].GetBase16().c_str());
+            ::printf("GPU Kd=%s\n",gpuD[i].GetBase16().c_str());
+            firstFaut = false;
+          }
         }
+
       }
 
-    }
+      if(nbFault) {
+        ::printf("CPU/GPU not ok: %d/%d faults\n",nbFault,nb);
+        return;
+      }
 
-    if(nbFault) {
-      ::printf("CPU/GPU not ok: %d/%d faults\n",nbFault,nb);
-      return;
-    }
+      // Comapre DP
 
-    // Comapre DP
 
+      ::printf("CPU/GPU ok [%d jumps]\n",nbJump);
 
-    ::printf("CPU/GPU ok\n");
+    }
+    nbJump = userNbJump;
+    rangePower = userRangePower;
+    jumpMask = userJumpMask;
+    jumpMean = userJumpMean;
 
   }
 
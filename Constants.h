@@ -24,13 +24,24 @@
 // Use symmetry
 //#define USE_SYMMETRY
 
-// Number of random jumps
-// Max 512 for the GPU
+// Default number of random jumps (power of 2, see -jn)
 #define NB_JUMP 32
+// Max 512 for the GPU (constant memory)
+#define MAX_JUMP 512
 
 // GPU group size
 #define GPU_GRP_SIZE 128
 
+// Incremental herd creation (-hs), step table size (2^HERD_STEP_BIT) and group size
+// (must be lower than the table size)
+#define HERD_STEP_BIT 12
+#define HERD_STEP_SIZE (1 << HERD_STEP_BIT)
+#define HERD_STEP_GRP 1024
+// Minimum herd size for incremental creation
+#define HERD_STEP_MIN 64
+// Minimum number of kangaroos per thread for parallel herd creation
+#define HERD_MT_MIN 1024
+
 // GPU number of run per kernel call
 #define NB_RUN 64
 
@@ -38,7 +49,19 @@
 #define TAME 0  // Tame kangaroo
 #define WILD 1  // Wild kangaroo
 
-// SendDP Period in sec
+// Kangaroo type from its index in the herd, tameRatio/256 of tames evenly spread
+// (128: even index tame, odd index wild)
+#define HERD_TYPE(idx,tameRatio) (((((uint64_t)(idx)) * (uint64_t)(tameRatio)) & 0xFF) < (uint64_t)(tameRatio) ? TAME : WILD)
+
+// Default herd configuration (-herd): 50% tame in [0,W], wild in [-W/2,W/2]
+// b7..b0 tame ratio (1/256), b15..b8 tame start, b23..b16 wild start (signed, 1/64 of W)
+// b27..b24 tame width-1, b31..b28 wild width-1 (1/16 of W)
+#define HERD_DEFAULT 0xFFE00080
+
+// Four-kangaroo walk (-4k), expected cost relative to the tame/wild walk
+#define FOUR_KANGAROO_GAIN 0.79
+
+// SendDP Period in sec (default of -sendperiod)
 #define SEND_PERIOD 2.0
 
 // Timeout before closing connection idle client in sec
@@ -0,0 +1,316 @@
+/*
+* This file is part of the BSGS distribution (https://github.com/JeanLucPons/Kangaroo).
+* Copyright (c) 2020 Jean Luc PONS.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Kangaroo.h"
+#include "Timer.h"
+#include <string.h>
+#include <math.h>
+#ifndef WIN64
+#include <pthread.h>
+#endif
+
+using namespace std;
+
+#define FLOOD_MAX_THREAD 16     // Sender threads, connections are shared round robin
+#define FLOOD_MAX_BATCH  65536  // Max DP per request
+
+// ----------------------------------------------------------------------------
+
+// Per thread generator (Int::Rand is not thread safe)
+static inline uint64_t NextRand(uint64_t *s) {
+
+  uint64_t z = (*s += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+
+}
+
+// Random DP record, same encoding as SendToServer(): random x, distance in the range, tame or wild
+static void RandDP(DP *dp,uint64_t *seed,int distBits,uint32_t kIdx) {
+
+  Int x;
+  Int d;
+  x.SetInt32(0);
+  d.SetInt32(0);
+  for(int i = 0; i < 4; i++)
+    x.bits64[i] = NextRand(seed);
+  for(int i = 0; i < 2; i++)
+    d.bits64[i] = NextRand(seed);
+  if(distBits < 64) {
+    d.bits64[0] &= (1ULL << distBits) - 1;
+    d.bits64[1] = 0;
+  } else if(distBits < 128) {
+    d.bits64[1] &= (1ULL << (distBits - 64)) - 1;
+  }
+
+  int128_t X;
+  int128_t D;
+  uint64_t h;
+  HashTable::Convert(&x,&d,kIdx % 2,&h,&X,&D);
+  dp->kIdx = kIdx;
+  dp->h = (uint32_t)h;
+  dp->x = X;
+  dp->d = D;
+
+}
+
+// DP of the planted collision, the tame (at Td) and the wild (at Wd) kangaroos share the point Td.G
+void Kangaroo::PlantDP(DP *dp,Int *d,uint32_t type) {
+
+  Point P = secp->ComputePublicKey(&plantTd);
+
+  int128_t X;
+  int128_t D;
+  uint64_t h;
+  HashTable::Convert(&P.x,d,type,&h,&X,&D);
+  dp->kIdx = type;
+  dp->h = (uint32_t)h;
+  dp->x = X;
+  dp->d = D;
+
+}
+
+// ----------------------------------------------------------------------------
+
+#ifdef WIN64
+DWORD WINAPI _floodThread(LPVOID lpParam) {
+#else
+void *_floodThread(void *lpParam) {
+#endif
+  TH_PARAM *p = (TH_PARAM *)lpParam;
+  p->obj->FloodThread(p);
+  return 0;
+}
+
+void Kangaroo::FloodThread(TH_PARAM *p) {
+
+  int thId = p->threadId;
+  uint64_t seed = ((uint64_t)Timer::getSeed32() << 32) ^ (uint64_t)thId;
+  int nbConn = (int)floodSock.size();
+  int distBits = (rangePower < 125) ? rangePower : 125;
+
+  // DP per request, the fraction is carried to the next period
+  double perConn = floodRate * sendPeriod / (double)nbConn;
+  vector<double> carry(nbConn,0.0);
+  vector<DP> dps;
+  uint32_t batchId = 0;
+  bool planted = !floodPlant || thId != 0;
+
+  p->hasStarted = true;
+
+  while(!endOfSearch) {
+
+    double t0 = Timer::get_tick();
+
+    for(int c = thId; c < nbConn && !endOfSearch; c += nbCPUThread) {
+
+      if(!floodUp[c]) {
+        // Lost connection, try again
+        if(!ConnectToServer(&floodSock[c]))
+          continue;
+        floodUp[c] = 1;
+      }
+
+      carry[c] += perConn;
+      uint32_t n = (carry[c] > (double)FLOOD_MAX_BATCH) ? FLOOD_MAX_BATCH : (uint32_t)carry[c];
+      carry[c] -= (double)n;
+      if(carry[c] > (double)FLOOD_MAX_BATCH)
+        carry[c] = (double)FLOOD_MAX_BATCH; // Rate too high for this connection, do not accumulate
+
+      dps.resize(n);
+      for(uint32_t i = 0; i < n; i++)
+        RandDP(&dps[i],&seed,distBits,(uint32_t)(NextRand(&seed) % CPU_GRP_SIZE));
+
+      if(!planted && t0 - startTime >= plantDelay) {
+        DP tame;
+        DP wild;
+        PlantDP(&tame,&plantTd,TAME);
+        PlantDP(&wild,&plantWd,WILD);
+        dps.push_back(tame);
+        dps.push_back(wild);
+        planted = true;
+        plantTime = Timer::get_tick();
+        ::printf("\nFlood: collision planted on connection %d\n",c);
+      }
+
+      if(dps.size() == 0)
+        continue;
+
+      uint64_t n0 = Timer::get_ns();
+      bool ok = SendFlood(floodSock[c],dps.data(),(uint32_t)dps.size(),(uint32_t)c,batchId++);
+      stats[thId].netStall += Timer::get_ns() - n0;
+      stats[thId].step++;
+      if(ok) {
+        stats[thId].nbDP += dps.size();
+      } else {
+        floodUp[c] = 0;
+        floodError++;
+      }
+
+    }
+
+    double toSleep = sendPeriod - (Timer::get_tick() - t0);
+    if(toSleep > 0.0 && !endOfSearch)
+      Timer::SleepMillis((uint32_t)(toSleep * 1000.0));
+
+  }
+
+  p->isRunning = false;
+
+}
+
+// ----------------------------------------------------------------------------
+
+void Kangaroo::FloodTest(int nbConn,double dpRate,std::string plantKey,double delay) {
+
+  if(shards.size() > 1) {
+    ::printf("Flood: a single server is expected\n");
+    ::exit(-1);
+  }
+
+  // Kangaroos announced to the server
+  totalRW = (uint64_t)nbConn * CPU_GRP_SIZE;
+  if(!GetConfigFromServer())
+    ::exit(0);
+  InitRange();
+
+  // Planted collision, tame at Td and wild at Wd with Td-Wd = k (relative to the range start)
+  floodPlant = plantKey.length() > 0;
+  plantDelay = delay;
+  plantTime = 0.0;
+  if(floodPlant) {
+    Int priv;
+    priv.SetBase16((char *)plantKey.c_str());
+    Point P = secp->ComputePublicKey(&priv);
+    if(!P.equals(keysToSearch[keyIdx])) {
+      ::printf("Flood: -floodkey does not match the key of the server\n");
+      ::exit(-1);
+    }
+    Int k(&priv);
+    k.ModSubK1order(&rangeStart);
+#ifdef USE_SYMMETRY
+    k.ModSubK1order(&rangeWidthDiv2);
+#endif
+    // Wd >= |k| so that Td is positive
+    plantWd.Rand(rangePower);
+    plantWd.Add(&rangeWidth);
+    plantTd.Set(&plantWd);
+    plantTd.ModAddK1order(&k);
+  }
+
+  // Connections
+  floodRate = dpRate;
+  floodBackup = 0;
+  floodError = 0;
+  floodSock.resize(nbConn);
+  floodUp.assign(nbConn,0);
+  for(int i = 0; i < nbConn; i++) {
+    if(!ConnectToServer(&floodSock[i])) {
+      ::printf("Flood: connection %d failed: %s\n",i,lastError.c_str());
+      if(i == 0)
+        ::exit(-1);
+#ifndef WIN64
+      ::printf("Flood: raise the file descriptor limit (ulimit -n) of the client and of the server\n");
+#endif
+      nbConn = i;
+      floodSock.resize(nbConn);
+      floodUp.resize(nbConn);
+      break;
+    }
+    floodUp[i] = 1;
+  }
+
+  int nbThread = (nbConn < FLOOD_MAX_THREAD) ? nbConn : FLOOD_MAX_THREAD;
+  ::printf("Flood: %d connection(s), %d thread(s), target %.0f DP/s, %.1f DP per request, period %.2fs\n",
+           nbConn,nbThread,dpRate,dpRate * sendPeriod / (double)nbConn,sendPeriod);
+  if(dpRate * sendPeriod / (double)nbConn > (double)FLOOD_MAX_BATCH)
+    ::printf("Flood: Warning, target rate too high, limited to %d DP per request (%.0f DP/s), use more connections\n",
+             FLOOD_MAX_BATCH,(double)FLOOD_MAX_BATCH * (double)nbConn / sendPeriod);
+  if(floodPlant)
+    ::printf("Flood: collision planted after %.1fs\n",plantDelay);
+
+  // Sender threads
+  nbCPUThread = nbThread;
+  nbGPUThread = 0;
+  endOfSearch = false;
+  memset(stats,0,sizeof(stats));
+  TH_PARAM *params = (TH_PARAM *)malloc(nbThread * sizeof(TH_PARAM));
+  THREAD_HANDLE *thHandles = (THREAD_HANDLE *)malloc(nbThread * sizeof(THREAD_HANDLE));
+  memset(params,0,nbThread * sizeof(TH_PARAM));
+
+#ifndef WIN64
+  pthread_mutex_init(&ghMutex,NULL);
+  setvbuf(stdout,NULL,_IONBF,0);
+#else
+  ghMutex = CreateMutex(NULL,FALSE,NULL);
+#endif
+
+  startTime = Timer::get_tick();
+  for(int i = 0; i < nbThread; i++) {
+    params[i].threadId = i;
+    params[i].isRunning = true;
+    thHandles[i] = LaunchThread(_floodThread,params + i);
+  }
+
+  // Status
+  THREAD_STATS last;
+  memset(&last,0,sizeof(last));
+  double t0 = startTime;
+  while(isAlive(params)) {
+
+    int i = 0;
+    while(isAlive(params) && i++ < 20)
+      Timer::SleepMillis(100);
+
+    double t1 = Timer::get_tick();
+    THREAD_STATS st;
+    GetThreadStats(&st);
+    double dt = t1 - t0;
+    double nbReq = (double)(st.step - last.step);
+    int up = 0;
+    for(int c = 0; c < nbConn; c++)
+      up += floodUp[c];
+
+    ::printf("\r[Flood][Conn %d/%d][%.0f DP/s][%.0f req/s][Latency %.2f ms][Sent 2^%.2f][Backup %.0f][Error %.0f][%s]  ",
+             up,nbConn,(double)(st.nbDP - last.nbDP) / dt,nbReq / dt,
+             (nbReq > 0.0) ? (double)(st.netStall - last.netStall) / nbReq / 1e6 : 0.0,
+             log2((double)st.nbDP),(double)floodBackup,(double)floodError,GetTimeStr(t1 - startTime).c_str());
+
+    last = st;
+    t0 = t1;
+
+  }
+
+  JoinThreads(thHandles,nbThread);
+  FreeHandles(thHandles,nbThread);
+
+  // Summary
+  THREAD_STATS st;
+  GetThreadStats(&st);
+  double t = Timer::get_tick() - startTime;
+  ::printf("\nFlood: %.0f DP in %.0f requests, %.0f DP/s, average latency %.2f ms\n",(double)st.nbDP,(double)st.step,
+           (double)st.nbDP / t,(st.step > 0) ? (double)st.netStall / (double)st.step / 1e6 : 0.0);
+  if(floodPlant && plantTime > 0.0)
+    ::printf("Flood: key solved by the server %.3fs after the planted collision was sent\n",Timer::get_tick() - plantTime);
+  else if(endOfSearch)
+    ::printf("Flood: search ended by the server\n");
+
+  free(params);
+  free(thHandles);
+
+}
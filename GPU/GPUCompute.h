@@ -50,10 +50,10 @@ __device__ void ComputeKangaroos(uint64_t *kangaroos,uint32_t maxFound,uint32_t
     __syncthreads();
 
     for(int g = 0; g < GPU_GRP_SIZE; g++) {
-      jmp = (uint32_t)px[g][0] & (NB_JUMP-1);
+      jmp = (uint32_t)px[g][0] & jMask;
 
 #ifdef USE_SYMMETRY
-      if(jmp==lastJump[g]) jmp = (lastJump[g] + 1) % NB_JUMP;
+      if(jmp==lastJump[g]) jmp = (lastJump[g] + 1) & jMask;
       lastJump[g] = jmp;
 #endif
 
@@ -69,7 +69,7 @@ __device__ void ComputeKangaroos(uint64_t *kangaroos,uint32_t maxFound,uint32_t
 #ifdef USE_SYMMETRY
       jmp = lastJump[g];
 #else
-      jmp = (uint32_t)px[g][0] & (NB_JUMP-1);
+      jmp = (uint32_t)px[g][0] & jMask;
 #endif
 
       ModSub256(dy,py[g],jPy[jmp]);
@@ -141,6 +141,18 @@ void GPUEngine::SetWildOffset(Int* offset) {
   wildOffset.Set(offset);
 }
 
+void GPUEngine::SetTameRatio(uint32_t tameRatio) {
+  this->tameRatio = tameRatio;
+}
+
+void GPUEngine::SetDPMask(uint64_t dpMask) {
+  this->dpMask = dpMask;
+}
+
+uint64_t GPUEngine::GetDPMask() {
+  return dpMask;
+}
+
 GPUEngine::GPUEngine(int nbThreadGroup,int nbThreadPerGroup,int gpuId,uint32_t maxFound) {
 
   // Initialise CUDA
@@ -224,7 +236,7 @@ GPUEngine::GPUEngine(int nbThreadGroup,int nbThreadPerGroup,int gpuId,uint32_t m
   }
 
   // Jump array
-  jumpSize = NB_JUMP * 8 * 4;
+  jumpSize = MAX_JUMP * 8 * 4;
   err = cudaHostAlloc(&jumpPinned,jumpSize,cudaHostAllocMapped);
   if(err != cudaSuccess) {
     printf("GPUEngine: Allocate jump pinned memory: %s\n",cudaGetErrorString(err));
@@ -234,6 +246,7 @@ GPUEngine::GPUEngine(int nbThreadGroup,int nbThreadPerGroup,int gpuId,uint32_t m
   lostWarning = false;
   initialised = true;
   wildOffset.SetInt32(0);
+  tameRatio = 128;
 
 #ifdef GPU_CHECK
 
@@ -406,13 +419,13 @@ void GPUEngine::SetKangaroos(Int *px,Int *py,Int *d) {
         // Distance
         Int dOff;
         dOff.Set(&d[idx]);
-        if(idx % 2 == WILD) dOff.ModAddK1order(&wildOffset);
+        if(HERD_TYPE(idx,tameRatio) == WILD) dOff.ModAddK1order(&wildOffset);
         inputKangarooPinned[g * strideSize + t + 8 * nbThreadPerGroup] = dOff.bits64[0];
         inputKangarooPinned[g * strideSize + t + 9 * nbThreadPerGroup] = dOff.bits64[1];
 
 #ifdef USE_SYMMETRY
         // Last jump
-        inputKangarooPinned[t + 10 * nbThreadPerGroup] = (uint64_t)NB_JUMP;
+        inputKangarooPinned[t + 10 * nbThreadPerGroup] = (uint64_t)MAX_JUMP;
 #endif
 
         idx++;
@@ -474,7 +487,7 @@ void GPUEngine::GetKangaroos(Int *px,Int *py,Int *d) {
         dOff.SetInt32(0);
         dOff.bits64[0] = inputKangarooPinned[g * strideSize + t + 8 * nbThreadPerGroup];
         dOff.bits64[1] = inputKangarooPinned[g * strideSize + t + 9 * nbThreadPerGroup];
-        if(idx % 2 == WILD) dOff.ModSubK1order(&wildOffset);
+        if(HERD_TYPE(idx,tameRatio) == WILD) dOff.ModSubK1order(&wildOffset);
         d[idx].Set(&dOff);
 
         idx++;
@@ -523,7 +536,7 @@ void GPUEngine::SetKangaroo(uint64_t kIdx,Int *px,Int *py,Int *d) {
   // D
   Int dOff;
   dOff.Set(d);
-  if(kIdx % 2 == WILD) dOff.ModAddK1order(&wildOffset);
+  if(HERD_TYPE(kIdx,tameRatio) == WILD) dOff.ModAddK1order(&wildOffset);
   inputKangarooPinned[0] = dOff.bits64[0];
   cudaMemcpy(inputKangaroo + (b * blockSize + g * strideSize + t + 8 * nbThreadPerGroup),inputKangarooPinned,8,cudaMemcpyHostToDevice);
   inputKangarooPinned[0] = dOff.bits64[1];
@@ -531,7 +544,7 @@ void GPUEngine::SetKangaroo(uint64_t kIdx,Int *px,Int *py,Int *d) {
 
 #ifdef USE_SYMMETRY
   // Last jump
-  inputKangarooPinned[0] = (uint64_t)NB_JUMP;
+  inputKangarooPinned[0] = (uint64_t)MAX_JUMP;
   cudaMemcpy(inputKangaroo + (b * blockSize + g * strideSize + t + 10 * nbThreadPerGroup),inputKangarooPinned,8,cudaMemcpyHostToDevice);
 #endif
 
@@ -556,31 +569,39 @@ bool GPUEngine::callKernel() {
 
 }
 
-void GPUEngine::SetParams(uint64_t dpMask,Int *distance,Int *px,Int *py) {
+void GPUEngine::SetParams(uint64_t dpMask,Int *distance,Int *px,Int *py,int nbJump) {
   
   this->dpMask = dpMask;
 
-  for(int i=0;i< NB_JUMP;i++)
-    memcpy(jumpPinned + 2*i,distance[i].bits64,16);
-  cudaMemcpyToSymbol(jD,jumpPinned,jumpSize/2);
+  uint32_t mask = nbJump - 1;
+  cudaMemcpyToSymbol(jMask,&mask,sizeof(uint32_t));
   cudaError_t err = cudaGetLastError();
   if(err != cudaSuccess) {
     printf("GPUEngine: SetParams: Failed to copy to constant memory: %s\n",cudaGetErrorString(err));
     return;
   }
 
-  for(int i = 0; i < NB_JUMP; i++)
+  for(int i=0;i< nbJump;i++)
+    memcpy(jumpPinned + 2*i,distance[i].bits64,16);
+  cudaMemcpyToSymbol(jD,jumpPinned,nbJump * 16);
+  err = cudaGetLastError();
+  if(err != cudaSuccess) {
+    printf("GPUEngine: SetParams: Failed to copy to constant memory: %s\n",cudaGetErrorString(err));
+    return;
+  }
+
+  for(int i = 0; i < nbJump; i++)
     memcpy(jumpPinned + 4 * i,px[i].bits64,32);
-  cudaMemcpyToSymbol(jPx,jumpPinned,jumpSize);
+  cudaMemcpyToSymbol(jPx,jumpPinned,nbJump * 32);
   err = cudaGetLastError();
   if(err != cudaSuccess) {
     printf("GPUEngine: SetParams: Failed to copy to constant memory: %s\n",cudaGetErrorString(err));
     return;
   }
 
-  for(int i = 0; i < NB_JUMP; i++)
+  for(int i = 0; i < nbJump; i++)
     memcpy(jumpPinned + 4 * i,py[i].bits64,32);
-  cudaMemcpyToSymbol(jPy,jumpPinned,jumpSize);
+  cudaMemcpyToSymbol(jPy,jumpPinned,nbJump * 32);
   err = cudaGetLastError();
   if(err != cudaSuccess) {
     printf("GPUEngine: SetParams: Failed to copy to constant memory: %s\n",cudaGetErrorString(err));
@@ -669,7 +690,7 @@ bool GPUEngine::Launch(std::vector<ITEM> &hashFound,bool spinWait) {
     it.d.bits64[2] = 0;
     it.d.bits64[3] = 0;
     it.d.bits64[4] = 0;
-    if(it.kIdx % 2 == WILD) it.d.ModSubK1order(&wildOffset);
+    if(HERD_TYPE(it.kIdx,tameRatio) == WILD) it.d.ModSubK1order(&wildOffset);
 
     hashFound.push_back(it);
   }
@@ -43,12 +43,15 @@ public:
 
   GPUEngine(int nbThreadGroup,int nbThreadPerGroup,int gpuId,uint32_t maxFound);
   ~GPUEngine();
-  void SetParams(uint64_t dpMask,Int *distance,Int *px,Int *py);
+  void SetParams(uint64_t dpMask,Int *distance,Int *px,Int *py,int nbJump);
   void SetKangaroos(Int *px,Int *py,Int *d);
   void GetKangaroos(Int *px,Int *py,Int *d);
   void SetKangaroo(uint64_t kIdx,Int *px,Int *py,Int *d);
   bool Launch(std::vector<ITEM> &hashFound,bool spinWait = false);
   void SetWildOffset(Int *offset);
+  void SetTameRatio(uint32_t tameRatio);
+  void SetDPMask(uint64_t dpMask);
+  uint64_t GetDPMask();
   int GetNbThread();
   int GetGroupSize();
   int GetMemory();
@@ -65,6 +68,7 @@ public:
 private:
 
   Int wildOffset;
+  uint32_t tameRatio;
   int nbThread;
   int nbThreadPerGroup;
   uint64_t *inputKangaroo;
@@ -48,10 +48,12 @@
 #define MADDS(r,a,b,c) asm volatile ("madc.hi.s64 %0, %1, %2, %3;" : "=l"(r) : "l"(a), "l"(b), "l"(c));
 
 // Jump distance
-__device__ __constant__ uint64_t jD[NB_JUMP][2];
+__device__ __constant__ uint64_t jD[MAX_JUMP][2];
 // jump points
-__device__ __constant__ uint64_t jPx[NB_JUMP][4];
-__device__ __constant__ uint64_t jPy[NB_JUMP][4];
+__device__ __constant__ uint64_t jPx[MAX_JUMP][4];
+__device__ __constant__ uint64_t jPy[MAX_JUMP][4];
+// Number of jumps - 1
+__device__ __constant__ uint32_t jMask;
 
 #ifdef USE_SYMMETRY
 __device__ __constant__ uint64_t _O[] = { 0xBFD25E8CD0364141ULL,0xBAAEDCE6AF48A03BULL,0xFFFFFFFFFFFFFFFEULL,0xFFFFFFFFFFFFFFFFULL };
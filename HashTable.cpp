@@ -20,10 +20,135 @@
 #include <math.h>
 #ifndef WIN64
 #include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #endif
 
 #define GET(hash,id) E[hash].items[id]
 
+// ------------------------------------------------------------------------------------------------------
+// Entry pool, entries are carved in 2MB chunks backed by huge pages and freed entries are
+// kept in a free list for reuse (chunks are never released)
+
+#define POOL_CHUNK (2*1024*1024)
+
+static int hugePages = HUGE_PAGE_OFF;
+static ENTRY *poolFree = NULL;
+static char *poolPtr = NULL;
+static size_t poolLeft = 0;
+#ifdef WIN64
+static HANDLE poolMutex = NULL;
+#define POOL_LOCK() WaitForSingleObject(poolMutex,INFINITE);
+#define POOL_UNLOCK() ReleaseMutex(poolMutex);
+#else
+static pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
+#define POOL_LOCK() pthread_mutex_lock(&poolMutex);
+#define POOL_UNLOCK() pthread_mutex_unlock(&poolMutex);
+#endif
+
+void HashTable::SetHugePages(int mode) {
+
+#ifdef WIN64
+  if(poolMutex == NULL)
+    poolMutex = CreateMutex(NULL,FALSE,NULL);
+#endif
+  hugePages = mode;
+
+}
+
+int HashTable::GetHugePages() {
+
+  return hugePages;
+
+}
+
+void HashTable::AdviseHugePages(void *p,size_t size) {
+
+#if !defined(WIN64) && defined(MADV_HUGEPAGE)
+  // Whole 2MB pages covering the range (the advice is ignored for pages already mapped)
+  uintptr_t start = (uintptr_t)p & ~(uintptr_t)(POOL_CHUNK - 1);
+  uintptr_t end = ((uintptr_t)p + size + POOL_CHUNK - 1) & ~(uintptr_t)(POOL_CHUNK - 1);
+  madvise((void *)start,end - start,MADV_HUGEPAGE);
+#endif
+
+}
+
+void HashTable::AdviseHugePages() {
+
+  if(hugePages != HUGE_PAGE_OFF)
+    AdviseHugePages(E,sizeof(E));
+
+}
+
+static char *AllocChunk() {
+
+#ifndef WIN64
+#ifdef MAP_HUGETLB
+  if(hugePages == HUGE_PAGE_TLB) {
+    void *p = mmap(NULL,POOL_CHUNK,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,-1,0);
+    if(p != MAP_FAILED)
+      return (char *)p;
+    ::printf("\nWarning: no explicit huge page available (vm.nr_hugepages), using transparent huge pages\n");
+    hugePages = HUGE_PAGE_THP;
+  }
+#endif
+  void *p = NULL;
+  if(posix_memalign(&p,POOL_CHUNK,POOL_CHUNK) != 0)
+    return NULL;
+  HashTable::AdviseHugePages(p,POOL_CHUNK);
+  return (char *)p;
+#else
+  return (char *)malloc(POOL_CHUNK);
+#endif
+
+}
+
+ENTRY *HashTable::AllocEntry() {
+
+  if(hugePages == HUGE_PAGE_OFF)
+    return (ENTRY *)malloc(sizeof(ENTRY));
+
+  ENTRY *e;
+  POOL_LOCK();
+  if(poolFree) {
+    e = poolFree;
+    poolFree = *(ENTRY **)e;
+  } else {
+    if(poolLeft < sizeof(ENTRY)) {
+      char *chunk = AllocChunk();
+      if(chunk == NULL) {
+        ::printf("\nHashTable: out of memory, cannot allocate a %d MB entry chunk\n",(int)(POOL_CHUNK / (1024 * 1024)));
+        ::exit(-1);
+      }
+      poolPtr = chunk;
+      poolLeft = POOL_CHUNK;
+    }
+    e = (ENTRY *)poolPtr;
+    poolPtr += sizeof(ENTRY);
+    poolLeft -= sizeof(ENTRY);
+  }
+  POOL_UNLOCK();
+  return e;
+
+}
+
+void HashTable::FreeEntry(ENTRY *e) {
+
+  if(hugePages == HUGE_PAGE_OFF) {
+    free(e);
+    return;
+  }
+
+  POOL_LOCK();
+  *(ENTRY **)e = poolFree;
+  poolFree = e;
+  POOL_UNLOCK();
+
+}
+
+// ------------------------------------------------------------------------------------------------------
+
 HashTable::HashTable() {
 
   memset(E,0,sizeof(E));
@@ -35,7 +160,7 @@ void HashTable::Reset() {
   for(uint32_t h = 0; h < HASH_SIZE; h++) {
     if(E[h].items) {
       for(uint32_t i = 0; i<E[h].nbItem; i++)
-        free(E[h].items[i]);
+        FreeEntry(E[h].items[i]);
     }
     safe_free(E[h].items);
     E[h].maxItem = 0;
@@ -56,7 +181,7 @@ uint64_t HashTable::GetNbItem() {
 
 ENTRY *HashTable::CreateEntry(int128_t *x,int128_t *d) {
 
-  ENTRY *e = (ENTRY *)malloc(sizeof(ENTRY));
+  ENTRY *e = AllocEntry();
   e->x.i64[0] = x->i64[0];
   e->x.i64[1] = x->i64[1];
   e->d.i64[0] = d->i64[0];
@@ -225,7 +350,9 @@ int HashTable::Add(Int *x,Int *d,uint32_t type) {
   uint64_t h;
   Convert(x,d,type,&h,&X,&D);
   ENTRY* e = CreateEntry(&X,&D);
-  return Add(h,e);
+  int addStatus = Add(h,e);
+  if(addStatus != ADD_OK) FreeEntry(e);
+  return addStatus;
 
 }
 
@@ -239,10 +366,28 @@ void HashTable::ReAllocate(uint64_t h,uint32_t add) {
 
 }
 
+void HashTable::Shrink(uint64_t h) {
+
+  // Release unused slots after entries have been removed
+  uint32_t maxItem = E[h].nbItem + 4;
+  if(maxItem < 16) maxItem = 16;
+  if(E[h].maxItem <= maxItem)
+    return;
+
+  E[h].maxItem = maxItem;
+  ENTRY** nitems = (ENTRY**)malloc(sizeof(ENTRY*) * E[h].maxItem);
+  memcpy(nitems,E[h].items,sizeof(ENTRY*) * E[h].nbItem);
+  free(E[h].items);
+  E[h].items = nitems;
+
+}
+
 int HashTable::Add(uint64_t h,int128_t *x,int128_t *d) {
 
   ENTRY *e = CreateEntry(x,d);
-  return Add(h,e);
+  int addStatus = Add(h,e);
+  if(addStatus != ADD_OK) FreeEntry(e);
+  return addStatus;
 
 }
 
@@ -323,6 +468,19 @@ int HashTable::compare(int128_t *i1,int128_t *i2) {
 
 }
 
+double HashTable::GetSizeMB() {
+
+  uint64_t totalByte = sizeof(E);
+
+  for(int h = 0; h < HASH_SIZE; h++) {
+    totalByte += sizeof(ENTRY *) * E[h].maxItem;
+    totalByte += sizeof(ENTRY) * E[h].nbItem;
+  }
+
+  return (double)totalByte / (1024.0*1024.0);
+
+}
+
 std::string HashTable::GetSizeInfo() {
 
   char *unit;
@@ -450,7 +608,7 @@ void HashTable::LoadTable(FILE* f,uint32_t from,uint32_t to) {
       E[h].items = (ENTRY**)malloc(sizeof(ENTRY*) * E[h].maxItem);
 
     for(uint32_t i = 0; i < E[h].nbItem; i++) {
-      ENTRY* e = (ENTRY*)malloc(sizeof(ENTRY));
+      ENTRY* e = AllocEntry();
       fread(&(e->x),16,1,f);
       fread(&(e->d),16,1,f);
       E[h].items[i] = e;
@@ -33,6 +33,11 @@
 #define ADD_DUPLICATE 1
 #define ADD_COLLISION 2
 
+// Entry storage (-hugepages)
+#define HUGE_PAGE_OFF 0 // malloc
+#define HUGE_PAGE_THP 1 // 2MB chunks, transparent huge pages (madvise)
+#define HUGE_PAGE_TLB 2 // 2MB chunks, explicit huge pages (hugetlbfs), THP if none reserved
+
 union int128_s {
 
   uint8_t  i8[16];
@@ -74,14 +79,24 @@ public:
   uint64_t GetNbItem();
   void Reset();
   std::string GetSizeInfo();
+  double GetSizeMB();
   void PrintInfo();
   void SaveTable(FILE *f);
   void SaveTable(FILE* f,uint32_t from,uint32_t to,bool printPoint=true);
   void LoadTable(FILE *f);
   void LoadTable(FILE* f,uint32_t from,uint32_t to);
   void ReAllocate(uint64_t h,uint32_t add);
+  void Shrink(uint64_t h);
   void SeekNbItem(FILE* f,bool restorePos = false);
   void SeekNbItem(FILE* f,uint32_t from,uint32_t to);
+  void AdviseHugePages();
+
+  // Entry allocation, shared by all tables
+  static ENTRY *AllocEntry();
+  static void FreeEntry(ENTRY *e);
+  static void SetHugePages(int mode);
+  static int GetHugePages();
+  static void AdviseHugePages(void *p,size_t size);
 
   HASH_ENTRY    E[HASH_SIZE];
   // Collision info
@@ -34,10 +34,14 @@ using namespace std;
 // ----------------------------------------------------------------------------
 
 Kangaroo::Kangaroo(Secp256K1 *secp,int32_t initDPSize,bool useGpu,string &workFile,string &iWorkFile,uint32_t savePeriod,bool saveKangaroo,bool saveKangarooByServer,
-                   double maxStep,int wtimeout,int port,int ntimeout,string serverIp,string outputFile,bool splitWorkfile) {
+                   double maxStep,int wtimeout,int port,int ntimeout,string serverIp,string outputFile,bool splitWorkfile,int localTableSize,int shardIdx,int nbShard,bool multiKey,
+                   string tableFile,int nbJump,int jumpMean,string jumpFile,bool herdStep,int maxRam,
+                   vector<double> herdLayout,bool fourKangaroo,string metricsFile,int metricsPort,
+                   bool perfMode,bool autoTune,bool numaMode,double sendPeriod,string traceName) {
 
   this->secp = secp;
   this->initDPSize = initDPSize;
+  this->maxRam = maxRam;
   this->useGpu = useGpu;
   this->offsetCount = 0;
   this->offsetTime = 0.0;
@@ -59,11 +63,115 @@ Kangaroo::Kangaroo(Secp256K1 *secp,int32_t initDPSize,bool useGpu,string &workFi
   this->endOfSearch = false;
   this->saveRequest = false;
   this->connectedClient = 0;
+  this->lastClientId = 0;
+  this->serverVersion = 0;
+  this->nbResetKangaroo = 0;
+  this->localTable = NULL;
+  this->nbLocalDP = 0;
+  this->maxLocalDP = 0;
+  this->localSolved = false;
+  if(this->clientMode && localTableSize > 0) {
+    this->maxLocalDP = ((uint64_t)localTableSize * 1024ULL * 1024ULL) / (sizeof(ENTRY) + sizeof(ENTRY *));
+    this->localTable = new HashTable();
+  }
   this->totalRW = 0;
   this->collisionInSameHerd = 0;
   this->keyIdx = 0;
   this->splitWorkfile = splitWorkfile;
   this->pid = Timer::getPID();
+  this->shardIdx = shardIdx;
+  this->nbShard = nbShard;
+  this->nbWrongShard = 0;
+  this->curShard = 0;
+  this->relayMode = false;
+  this->multiKey = multiKey;
+  this->nbSolvedKey = 0;
+  this->solvedVersion = 0;
+  this->nextWildKey = 0;
+  this->keyTagShift = 126;
+  this->listenPort = port;
+  this->relayBatch = 0;
+  this->relayIn = 0;
+  this->relayOut = 0;
+  this->herdType = -1;
+  this->tableFile = tableFile;
+  this->precompMode = false;
+  this->benchMode = false;
+  this->keyFound = false;
+  this->precompTarget = 0;
+  this->precompCoverage = 0.0;
+  this->precompSpan = 0.0;
+  this->nbJump = nbJump;
+  this->jumpMask = nbJump - 1;
+  this->jumpMean = jumpMean;
+  this->jumpSeed = 0x600DCAFE;
+  this->jumpFile = jumpFile;
+  this->jumpFileRange = 0;
+  this->herdStep = herdStep;
+  this->herdStepRange = 0;
+  this->nbHerdThread = Timer::getCoreNumber();
+  this->fileHerdConfig = HERD_DEFAULT;
+  this->fourKangaroo = fourKangaroo;
+  this->metricsFile = metricsFile;
+  this->metricsPort = metricsPort;
+  this->metricsStream = NULL;
+  this->metricsRunning = false;
+  this->lastMetricsTime = 0.0;
+  this->lastMetricsDP = 0;
+  this->nbSave = 0;
+  this->lastSaveTime = 0.0;
+  this->totalSaveTime = 0.0;
+  this->perfMode = perfMode;
+  this->autoTune = autoTune;
+  this->numaMode = numaMode;
+  this->sendPeriod = sendPeriod;
+  this->netRx = 0;
+  this->netTx = 0;
+  this->floodBackup = 0;
+  this->floodError = 0;
+  this->traceName = traceName;
+  this->traceStream = NULL;
+  this->traceStart = 0.0;
+  this->traceCount = 0;
+  this->succMu = 0.0;
+  this->succOverHead = 0.0;
+  this->succProb = 0.0;
+  for(int i = 0; i < NB_SUCC_POINT; i++)
+    this->succTime[i] = -1.0;
+  this->succHint = false;
+  SetHerdConfig(HERD_DEFAULT,"default");
+  if(herdLayout.size() > 0 && !SetHerdLayout(herdLayout))
+    ::exit(-1);
+  if(jumpFile.length() > 0 && !LoadJumpFile(jumpFile))
+    ::exit(-1);
+
+  // Server shard list: host[:port][,host[:port],...]
+  if(this->clientMode) {
+    size_t start = 0,end;
+    do {
+      end = serverIp.find(',',start);
+      string item = serverIp.substr(start,(end == string::npos) ? string::npos : end - start);
+      SHARD_CONN c;
+      size_t sep = item.find(':');
+      c.ip = item.substr(0,sep);
+      c.port = (sep == string::npos) ? port : ::atoi(item.substr(sep + 1).c_str());
+      if(c.ip.length() == 0 || c.port <= 0) {
+        ::printf("Error: Invalid server address %s\n",item.c_str());
+        ::exit(-1);
+      }
+      c.sock = 0;
+      c.isConnected = false;
+      c.hostInfo = NULL;
+      c.hostInfoLength = 0;
+      c.hostAddrType = 0;
+      c.status = "Not OK";
+      c.version = 0;
+      shards.push_back(c);
+      start = end + 1;
+    } while(end != string::npos);
+    this->serverIp = shards[0].ip;
+    this->port = shards[0].port;
+  }
 
   CPU_GRP_SIZE = 1024;
 
@@ -71,9 +179,11 @@ Kangaroo::Kangaroo(Secp256K1 *secp,int32_t initDPSize,bool useGpu,string &workFi
 #ifdef WIN64
   ghMutex = CreateMutex(NULL,FALSE,NULL);
   saveMutex = CreateMutex(NULL,FALSE,NULL);
+  metricsMutex = CreateMutex(NULL,FALSE,NULL);
 #else
   pthread_mutex_init(&ghMutex, NULL);
   pthread_mutex_init(&saveMutex, NULL);
+  pthread_mutex_init(&metricsMutex, NULL);
   signal(SIGPIPE, SIG_IGN);
 #endif
 
@@ -198,6 +308,7 @@ bool Kangaroo::Output(Int *pk,char sInfo,int sType) {
   ::fprintf(f,"Key#%2d [%d%c]Pub:  0x%s \n",keyIdx,sType,sInfo,secp->GetPublicKeyHex(true,keysToSearch[keyIdx]).c_str());
   if(PR.equals(keysToSearch[keyIdx])) {
     ::fprintf(f,"       Priv: 0x%s \n",pk->GetBase16().c_str());
+    keyFound = true;
   } else {
     ::fprintf(f,"       Failed !\n");
     if(needToClose)
@@ -235,6 +346,7 @@ bool  Kangaroo::CheckKey(Int d1,Int d2,uint8_t type) {
     pk.ModAddK1order(&rangeWidthDiv2);
 #endif
     pk.ModAddK1order(&rangeStart);    
+    foundKey.Set(&pk);
     return Output(&pk,'N',type);
   }
 
@@ -245,6 +357,7 @@ bool  Kangaroo::CheckKey(Int d1,Int d2,uint8_t type) {
     pk.ModAddK1order(&rangeWidthDiv2);
 #endif
     pk.ModAddK1order(&rangeStart);
+    foundKey.Set(&pk);
     return Output(&pk,'S',type);
   }
 
@@ -257,6 +370,12 @@ bool Kangaroo::CollisionCheck(Int* d1,uint32_t type1,Int* d2,uint32_t type2) {
 
   if(type1 == type2) {
 
+    // Four-kangaroo, the 2 wild herds (k and -k) can meet
+    if(fourKangaroo && type1 == WILD) {
+      endOfSearch = CheckWildPair(d1,d2);
+      return endOfSearch;
+    }
+
     // Collision inside the same herd
     return false;
 
@@ -301,11 +420,34 @@ bool Kangaroo::CollisionCheck(Int* d1,uint32_t type1,Int* d2,uint32_t type2) {
 
 }
 
+bool Kangaroo::CheckWildPair(Int *d1,Int *d2) {
+
+  // k+d1 = -k+d2 (or the reverse), +/-k = (d2-d1)/2, CheckKey tests both signs
+  Int h(d2);
+  h.ModSubK1order(d1);
+  if(h.IsZero())
+    return false;
+  if(h.IsOdd())
+    h.Add(&secp->order);
+  h.ShiftR(1);
+
+  Int zero((uint64_t)0);
+  return CheckKey(h,zero,0);
+
+}
+
 // ----------------------------------------------------------------------------
 
-bool Kangaroo::AddToTable(Int *pos,Int *dist,uint32_t kType) {
+bool Kangaroo::AddToTable(Int *pos,Int *dist,uint32_t kType,uint32_t thId) {
 
   int addStatus = hashTable.Add(pos,dist,kType);
+  if(traceStream) {
+    int128_t X;
+    int128_t D;
+    uint64_t h;
+    HashTable::Convert(pos,dist,kType,&h,&X,&D);
+    TraceDP(h,&X,&D,thId,addStatus);
+  }
   if(addStatus== ADD_COLLISION)
     return CollisionCheck(&hashTable.kDist,hashTable.kType,dist,kType);
 
@@ -313,9 +455,11 @@ bool Kangaroo::AddToTable(Int *pos,Int *dist,uint32_t kType) {
 
 }
 
-bool Kangaroo::AddToTable(uint64_t h,int128_t *x,int128_t *d) {
+bool Kangaroo::AddToTable(uint64_t h,int128_t *x,int128_t *d,uint32_t thId) {
 
   int addStatus = hashTable.Add(h,x,d);
+  if(traceStream)
+    TraceDP(h,x,d,thId,addStatus);
   if(addStatus== ADD_COLLISION) {
 
     Int dist;
@@ -329,131 +473,475 @@ bool Kangaroo::AddToTable(uint64_t h,int128_t *x,int128_t *d) {
 
 }
 
+// Client local table, return ADD_DUPLICATE for a dead kangaroo (DP must not be sent)
+int Kangaroo::AddToLocalTable(Int *pos,Int *dist,uint32_t kType) {
+
+  int addStatus = localTable->Add(pos,dist,kType);
+
+  if(addStatus == ADD_OK) {
+
+    nbLocalDP++;
+    if(nbLocalDP >= maxLocalDP) {
+      // Table full, restart from an empty one
+      localTable->Reset();
+      nbLocalDP = 0;
+    }
+
+  } else if(addStatus == ADD_COLLISION) {
+
+    if(localTable->kType == kType) {
+
+      // Collision inside the same herd (four-kangaroo, or between the 2 wild herds)
+      if(fourKangaroo && kType == WILD && CheckWildPair(&localTable->kDist,dist))
+        localSolved = true;
+      else
+        addStatus = ADD_DUPLICATE;
+
+    } else {
+
+      // Tame/Wild collision, solve the key here, the DP is also sent to the server
+      Int Td;
+      Int Wd;
+      if(kType == TAME) {
+        Td.Set(dist);
+        Wd.Set(&localTable->kDist);
+      } else {
+        Td.Set(&localTable->kDist);
+        Wd.Set(dist);
+      }
+      localSolved = CheckKey(Td,Wd,0) || CheckKey(Td,Wd,1) || CheckKey(Td,Wd,2) || CheckKey(Td,Wd,3);
+
+    }
+
+  }
+
+  return addStatus;
+
+}
+
+// ----------------------------------------------------------------------------
+// Multi-key: one tame herd and one DP table shared by all keys. Wild DPs are
+// tagged with their key index in the upper bits of the stored distance.
 // ----------------------------------------------------------------------------
 
-void Kangaroo::SolveKeyCPU(TH_PARAM *ph) {
+void Kangaroo::InitMultiKey() {
 
-  vector<ITEM> dps;
-  double lastSent = 0;
+  uint32_t nbKey = (uint32_t)keysToSearch.size();
 
-  // Global init
-  int thId = ph->threadId;
+  keysShifted.clear();
+  for(keyIdx = 0; keyIdx < nbKey; keyIdx++) {
+    InitSearchKey();
+    keysShifted.push_back(keyToSearch);
+  }
+  keyIdx = 0;
+  InitSearchKey();
+
+  keySolved.assign(nbKey,false);
+  keyShiftedPriv.resize(nbKey);
+  keyRelations.clear();
+  nbSolvedKey = 0;
+  solvedVersion = 0;
+  nextWildKey = 0;
+
+  int keyBits = 1;
+  while((1ULL << keyBits) < nbKey) keyBits++;
+  keyTagShift = 126 - keyBits;
+  if(rangePower + 8 > keyTagShift) {
+    ::printf("Error: Too many keys (%d) for multi-key mode on a 2^%d range\n",nbKey,rangePower);
+    ::exit(-1);
+  }
 
-  // Create Kangaroos
-  ph->nbKangaroo = CPU_GRP_SIZE;
+  ::printf("Multi-key: %d keys, shared tame herd\n",nbKey);
 
+}
+
+// Remove the key tag of a wild distance and return the key index
+uint32_t Kangaroo::SplitKeyTag(Int *d) {
+
+  bool neg = d->bits64[3] > 0x7FFFFFFFFFFFFFFFULL;
+  if(neg) d->ModNegK1order();
+  uint32_t k = (uint32_t)(d->bits64[1] >> (keyTagShift - 64));
+  d->bits64[1] &= (1ULL << (keyTagShift - 64)) - 1;
+  if(neg) d->ModNegK1order();
+  return k;
+
+}
+
+// Next unsolved key for a new wild kangaroo (caller must own ghMutex)
+uint32_t Kangaroo::NextWildKey() {
+
+  uint32_t nbKey = (uint32_t)keysToSearch.size();
+  for(uint32_t i = 0; i < nbKey; i++) {
+    uint32_t k = nextWildKey;
+    nextWildKey = (nextWildKey + 1) % nbKey;
+    if(!keySolved[k])
+      return k;
+  }
+  return 0;
+
+}
+
+void Kangaroo::SetKeySolved(uint32_t k) {
+
+  // Shifted private key, used to solve related keys
+  keyShiftedPriv[k].Set(&foundKey);
+  keyShiftedPriv[k].ModSubK1order(&rangeStart);
 #ifdef USE_SYMMETRY
-  ph->symClass = new uint64_t[CPU_GRP_SIZE];
-  for(int i = 0; i<CPU_GRP_SIZE; i++) ph->symClass[i] = 0;
+  keyShiftedPriv[k].ModSubK1order(&rangeWidthDiv2);
 #endif
 
-  IntGroup *grp = new IntGroup(CPU_GRP_SIZE);
-  Int *dx = new Int[CPU_GRP_SIZE];
+  keySolved[k] = true;
+  nbSolvedKey++;
+  solvedVersion++;
+  if(nbSolvedKey == keysToSearch.size())
+    endOfSearch = true;
 
-  if(ph->px==NULL) {
+}
 
-    // Create Kangaroos, if not already loaded
-    ph->px = new Int[CPU_GRP_SIZE];
-    ph->py = new Int[CPU_GRP_SIZE];
-    ph->distance = new Int[CPU_GRP_SIZE];
-    CreateHerd(CPU_GRP_SIZE,ph->px,ph->py,ph->distance,TAME);
+bool Kangaroo::SolveKeyMK(uint32_t k,Int *Td,Int *Wd) {
 
+  keyIdx = k;
+  InitSearchKey();
+
+  if(CheckKey(*Td,*Wd,0) || CheckKey(*Td,*Wd,1) || CheckKey(*Td,*Wd,2) || CheckKey(*Td,*Wd,3)) {
+    SetKeySolved(k);
+    return true;
   }
 
-  if(keyIdx==0)
-    ::printf("SolveKeyCPU Thread %d: %d kangaroos\n",ph->threadId,CPU_GRP_SIZE);
+  ::printf("\n Unexpected wrong collision for key#%d !\n",k);
+  return false;
 
-  ph->hasStarted = true;
+}
+
+// Solve keys linked to a solved key by a wild/wild collision
+void Kangaroo::SolveRelatedKeys() {
+
+  bool progress = true;
+  while(progress && !endOfSearch) {
+
+    progress = false;
+    for(size_t i = 0; i < keyRelations.size(); i++) {
+
+      KEY_RELATION& r = keyRelations[i];
+      if(keySolved[r.k1] == keySolved[r.k2])
+        continue;
+
+      uint32_t a  = keySolved[r.k1] ? r.k2 : r.k1;
+      uint32_t b  = keySolved[r.k1] ? r.k1 : r.k2;
+      Int* da = keySolved[r.k1] ? &r.d2 : &r.d1;
+      Int* db = keySolved[r.k1] ? &r.d1 : &r.d2;
+
+      // ka +/- da = +/-(kb +/- db)
+      Int X1(&keyShiftedPriv[b]);
+      Int X2(&keyShiftedPriv[b]);
+      X1.ModAddK1order(db);
+      X2.ModSubK1order(db);
+
+      keyIdx = a;
+      InitSearchKey();
+      bool ok = false;
+      for(uint8_t t = 0; t < 4 && !ok; t++)
+        ok = CheckKey(X1,*da,t) || CheckKey(X2,*da,t);
+      if(ok) {
+        SetKeySolved(a);
+        progress = true;
+      }
+
+    }
+
+  }
+
+}
+
+// Add a DP in multi-key mode, return false if the kangaroo is dead (caller must own ghMutex)
+bool Kangaroo::AddToTableMK(Int *pos,Int *dist,uint32_t kType,uint32_t wKey) {
+
+  int128_t X;
+  int128_t D;
+  uint64_t h;
+
+  HashTable::Convert(pos,dist,kType,&h,&X,&D);
+  if(kType == WILD)
+    D.i64[1] |= (uint64_t)wKey << (keyTagShift - 64);
+
+  int addStatus = hashTable.Add(h,&X,&D);
+  if(addStatus == ADD_OK)
+    return true;
+  if(addStatus == ADD_DUPLICATE)
+    return false;
+
+  Int d2(&hashTable.kDist);
+  uint32_t type2 = hashTable.kType;
+  uint32_t k2 = (type2 == WILD) ? SplitKeyTag(&d2) : 0;
+
+  if(kType == TAME && type2 == TAME)
+    return false;
+
+  if(kType == WILD && type2 == WILD) {
+
+    if(k2 == wKey)
+      return false;
+
+    // Same path for both keys from now, keep the relation
+    KEY_RELATION r;
+    r.k1 = wKey;
+    r.d1.Set(dist);
+    r.k2 = k2;
+    r.d2.Set(&d2);
+    keyRelations.push_back(r);
+    SolveRelatedKeys();
+    return false;
+
+  }
+
+  // Tame/Wild collision
+  Int Td;
+  Int Wd;
+  uint32_t k;
+  if(kType == TAME) {
+    Td.Set(dist);
+    Wd.Set(&d2);
+    k = k2;
+  } else {
+    Td.Set(&d2);
+    Wd.Set(dist);
+    k = wKey;
+  }
+
+  if(k >= keysToSearch.size() || keySolved[k])
+    return true;
+
+  if(SolveKeyMK(k,&Td,&Wd))
+    SolveRelatedKeys();
+
+  return true;
+
+}
+
+// ----------------------------------------------------------------------------
+
+void Kangaroo::JumpHerd(int nbKangaroo,Int *px,Int *py,Int *d,uint64_t *symClass,IntGroup *grp,Int *dx,
+                        PerfCounters *perf) {
 
-  // Using Affine coord
+  // One jump for each kangaroo (affine coordinates, grouped inversion)
   Int dy;
   Int rx;
   Int ry;
   Int _s;
   Int _p;
+#ifndef USE_SYMMETRY
+  (void)symClass; // Only used with symmetry
+#endif
 
-  while(!endOfSearch) {
-
-    // Random walk
+  if(perf) perf->Phase(PERF_DX);
 
-    for(int g = 0; g < CPU_GRP_SIZE; g++) {
+  for(int g = 0; g < nbKangaroo; g++) {
 
 #ifdef USE_SYMMETRY
-      uint64_t jmp = ph->px[g].bits64[0] % (NB_JUMP/2) + (NB_JUMP / 2) * ph->symClass[g];
+    uint64_t jmp = (px[g].bits64[0] & (jumpMask >> 1)) + (nbJump / 2) * symClass[g];
 #else
-      uint64_t jmp = ph->px[g].bits64[0] % NB_JUMP;
+    uint64_t jmp = px[g].bits64[0] & jumpMask;
 #endif
 
-      Int *p1x = &jumpPointx[jmp];
-      Int *p2x = &ph->px[g];
-      dx[g].ModSub(p2x,p1x);
+    Int *p1x = &jumpPointx[jmp];
+    Int *p2x = &px[g];
+    dx[g].ModSub(p2x,p1x);
 
-    }
+  }
+
+  if(perf) perf->Phase(PERF_INV);
+
+  grp->Set(dx);
+  grp->ModInv();
 
-    grp->Set(dx);
-    grp->ModInv();
+  if(perf) perf->Phase(PERF_ADD);
 
-    for(int g = 0; g < CPU_GRP_SIZE; g++) {
+  for(int g = 0; g < nbKangaroo; g++) {
 
 #ifdef USE_SYMMETRY
-      uint64_t jmp = ph->px[g].bits64[0] % (NB_JUMP / 2) + (NB_JUMP / 2) * ph->symClass[g];
+    uint64_t jmp = (px[g].bits64[0] & (jumpMask >> 1)) + (nbJump / 2) * symClass[g];
 #else
-      uint64_t jmp = ph->px[g].bits64[0] % NB_JUMP;
+    uint64_t jmp = px[g].bits64[0] & jumpMask;
 #endif
 
-      Int *p1x = &jumpPointx[jmp];
-      Int *p1y = &jumpPointy[jmp];
-      Int *p2x = &ph->px[g];
-      Int *p2y = &ph->py[g];
+    Int *p1x = &jumpPointx[jmp];
+    Int *p1y = &jumpPointy[jmp];
+    Int *p2x = &px[g];
+    Int *p2y = &py[g];
 
-      dy.ModSub(p2y,p1y);
-      _s.ModMulK1(&dy,&dx[g]);
-      _p.ModSquareK1(&_s);
+    dy.ModSub(p2y,p1y);
+    _s.ModMulK1(&dy,&dx[g]);
+    _p.ModSquareK1(&_s);
 
-      rx.ModSub(&_p,p1x);
-      rx.ModSub(p2x);
+    rx.ModSub(&_p,p1x);
+    rx.ModSub(p2x);
 
-      ry.ModSub(p2x,&rx);
-      ry.ModMulK1(&_s);
-      ry.ModSub(p2y);
+    ry.ModSub(p2x,&rx);
+    ry.ModMulK1(&_s);
+    ry.ModSub(p2y);
 
-      ph->distance[g].ModAddK1order(&jumpDistance[jmp]);
+    d[g].ModAddK1order(&jumpDistance[jmp]);
 
 #ifdef USE_SYMMETRY
-      // Equivalence symmetry class switch
-      if( ry.ModPositiveK1() ) {
-        ph->distance[g].ModNegK1order();
-        ph->symClass[g] = !ph->symClass[g];
-      }
+    // Equivalence symmetry class switch
+    if( ry.ModPositiveK1() ) {
+      d[g].ModNegK1order();
+      symClass[g] = !symClass[g];
+    }
 #endif
 
-      ph->px[g].Set(&rx);
-      ph->py[g].Set(&ry);
+    px[g].Set(&rx);
+    py[g].Set(&ry);
+
+  }
+
+}
+
+// ----------------------------------------------------------------------------
+
+void Kangaroo::SolveKeyCPU(TH_PARAM *ph) {
+
+  vector<ITEM> dps;
+  vector<DEAD_KANGAROO> dead;
+  uint32_t batchId = 0;
+  double lastSent = 0;
+
+  // Global init
+  int thId = ph->threadId;
+
+  // Create Kangaroos
+  ph->nbKangaroo = CPU_GRP_SIZE;
+  PinThread(thId);
+
+#ifdef USE_SYMMETRY
+  ph->symClass = new uint64_t[CPU_GRP_SIZE];
+  for(int i = 0; i<CPU_GRP_SIZE; i++) ph->symClass[i] = 0;
+#endif
+
+  IntGroup *grp = new IntGroup(CPU_GRP_SIZE);
+  Int *dx = new Int[CPU_GRP_SIZE];
+
+  // Last DP batch sent before a kangaroo reset (client mode)
+  vector<uint32_t> resetBatch(clientMode ? CPU_GRP_SIZE : 0,0);
+
+  if(multiKey) {
+    ph->wildKey = new uint32_t[CPU_GRP_SIZE]();
+    ph->keyVersion = 0;
+  }
+
+  // Precompute, step of the last DP of each kangaroo (walk length)
+  vector<uint64_t> lastDP(precompMode ? CPU_GRP_SIZE : 0,0);
+  uint64_t nbStep = 0;
+
+  if(ph->px==NULL) {
+
+    // Create Kangaroos, if not already loaded
+    ph->px = new Int[CPU_GRP_SIZE];
+    ph->py = new Int[CPU_GRP_SIZE];
+    ph->distance = new Int[CPU_GRP_SIZE];
+    AdviseHerd(ph->px,ph->py,ph->distance,CPU_GRP_SIZE);
+    CreateHerd(CPU_GRP_SIZE,ph->px,ph->py,ph->distance,TAME,true,ph->wildKey);
+
+  } else {
+
+    // Loaded from a work file, move to the node of this thread
+    LocalizeHerd(ph);
+
+  }
 
+  if(keyIdx==0)
+    ::printf("SolveKeyCPU Thread %d: %d kangaroos\n",ph->threadId,CPU_GRP_SIZE);
+
+  // Hardware counters of this thread (-perf)
+  PerfCounters *perf = NULL;
+  if(perfMode) {
+    perf = new PerfCounters();
+    perf->Open();
+  }
+
+  ph->hasStarted = true;
+
+  while(!endOfSearch) {
+
+    // Multi-key, wild kangaroos of solved keys walk for another key
+    if(multiKey && ph->keyVersion != solvedVersion) {
+      LockStat(thId);
+      ph->keyVersion = solvedVersion;
+      for(int g = 0; g < CPU_GRP_SIZE && !endOfSearch; g++) {
+        if(KangarooType(g) == WILD && keySolved[ph->wildKey[g]])
+          CreateHerd(1,&ph->px[g],&ph->py[g],&ph->distance[g],g,false,&ph->wildKey[g]);
+      }
+      UNLOCK(ghMutex);
     }
 
+    // Random walk
+#ifdef USE_SYMMETRY
+    JumpHerd(CPU_GRP_SIZE,ph->px,ph->py,ph->distance,ph->symClass,grp,dx,perf);
+#else
+    JumpHerd(CPU_GRP_SIZE,ph->px,ph->py,ph->distance,NULL,grp,dx,perf);
+#endif
+
+    if(perf) perf->Phase(PERF_DP);
+
     if( clientMode ) {
 
       // Send DP to server
+      bool forceSend = false;
       for(int g = 0; g < CPU_GRP_SIZE; g++) {
         if(IsDP(ph->px[g].bits64[3])) {
+
+          stats[thId].nbDP++;
+          if(perf) perf->Phase(PERF_TABLE);
+          if(localTable) {
+            LockStat(thId);
+            int addStatus = AddToLocalTable(&ph->px[g],&ph->distance[g],KangarooType(g));
+            if(addStatus == ADD_DUPLICATE) {
+              // Dead kangaroo, reset it and drop the DP
+              CreateHerd(1,&ph->px[g],&ph->py[g],&ph->distance[g],g,false);
+              nbResetKangaroo++;
+              stats[thId].nbDead++;
+            }
+            UNLOCK(ghMutex);
+            if(perf) perf->Phase(PERF_DP);
+            if(addStatus == ADD_DUPLICATE)
+              continue;
+            forceSend |= (addStatus == ADD_COLLISION);
+          }
+
           ITEM it;
           it.x.Set(&ph->px[g]);
           it.d.Set(&ph->distance[g]);
           it.kIdx = g;
           dps.push_back(it);
+          if(perf) perf->Phase(PERF_DP);
+
         }
       }
 
       double now = Timer::get_tick();
-      if( now-lastSent > SEND_PERIOD ) {
-        LOCK(ghMutex);
-        SendToServer(dps,ph->threadId,0xFFFF);
+      if( forceSend || now-lastSent > sendPeriod ) {
+        if(perf) perf->Phase(PERF_TABLE);
+        LockStat(thId);
+        uint64_t n0 = Timer::get_ns();
+        SendToServer(dps,ph->threadId,0xFFFF,++batchId,dead);
+        stats[thId].netStall += Timer::get_ns() - n0;
+        // Reset kangaroos found dead by the server (ignore DP sent before a previous reset)
+        for(int i = 0; i < (int)dead.size(); i++) {
+          uint32_t k = dead[i].kIdx;
+          if(k < (uint32_t)CPU_GRP_SIZE && dead[i].batchId > resetBatch[k]) {
+            CreateHerd(1,&ph->px[k],&ph->py[k],&ph->distance[k],k,false);
+            resetBatch[k] = batchId;
+            nbResetKangaroo++;
+            stats[thId].nbDead++;
+          }
+        }
+        // Key solved localy, the DP has been sent to the server
+        if(localSolved) endOfSearch = true;
         UNLOCK(ghMutex);
         lastSent = now;
       }
 
-      if(!endOfSearch) counters[thId] += CPU_GRP_SIZE;
+      if(!endOfSearch) stats[thId].step += CPU_GRP_SIZE;
 
     } else {
 
@@ -461,42 +949,71 @@ void Kangaroo::SolveKeyCPU(TH_PARAM *ph) {
       for(int g = 0; g < CPU_GRP_SIZE && !endOfSearch; g++) {
 
         if(IsDP(ph->px[g].bits64[3])) {
-          LOCK(ghMutex);
+          stats[thId].nbDP++;
+          if(perf) perf->Phase(PERF_TABLE);
+          LockStat(thId);
           if(!endOfSearch) {
 
-            if(!AddToTable(&ph->px[g],&ph->distance[g],g % 2)) {
+            uint32_t kType = KangarooType(g);
+            bool added;
+            if(precompMode) {
+              added = AddToPrecompute(&ph->px[g],&ph->distance[g],nbStep - lastDP[g]);
+              lastDP[g] = nbStep;
+            } else if(multiKey) {
+              added = AddToTableMK(&ph->px[g],&ph->distance[g],kType,ph->wildKey[g]);
+            } else {
+              added = AddToTable(&ph->px[g],&ph->distance[g],kType,thId);
+            }
+            if(!added) {
               // Collision inside the same herd
               // We need to reset the kangaroo
-              CreateHerd(1,&ph->px[g],&ph->py[g],&ph->distance[g],g % 2,false);
+              CreateHerd(1,&ph->px[g],&ph->py[g],&ph->distance[g],g,false,
+                         ph->wildKey ? &ph->wildKey[g] : NULL);
               collisionInSameHerd++;
+              stats[thId].nbDead++;
             }
 
           }
           UNLOCK(ghMutex);
+          if(perf) perf->Phase(PERF_DP);
         }
 
-        if(!endOfSearch) counters[thId] ++;
+        if(!endOfSearch) stats[thId].step++;
 
       }
+      nbStep++;
 
     }
 
+    if(perf) perf->Phase(PERF_OTHER);
+
     // Save request
     if(saveRequest && !endOfSearch) {
+      uint64_t s0 = Timer::get_ns();
       ph->isWaiting = true;
       LOCK(saveMutex);
       ph->isWaiting = false;
       UNLOCK(saveMutex);
+      stats[thId].saveStall += Timer::get_ns() - s0;
     }
 
   }
 
+  if(perf) {
+    perf->Stop();
+    LOCK(ghMutex);
+    perfTotal.Add(perf);
+    UNLOCK(ghMutex);
+    delete perf;
+  }
+
   // Free
   delete grp;
   delete[] dx;
   safe_delete_array(ph->px);
   safe_delete_array(ph->py);
   safe_delete_array(ph->distance);
+  safe_delete_array(ph->wildKey);
 #ifdef USE_SYMMETRY
   safe_delete_array(ph->symClass);
 #endif
@@ -518,6 +1035,9 @@ void Kangaroo::SolveKeyGPU(TH_PARAM *ph) {
 
   vector<ITEM> dps;
   vector<ITEM> gpuFound;
+  vector<DEAD_KANGAROO> dead;
+  vector<uint32_t> resetBatch;
+  uint32_t batchId = 0;
   GPUEngine *gpu;
 
   gpu = new GPUEngine(ph->gridSizeX,ph->gridSizeY,ph->gpuId,65536 * 2);
@@ -537,20 +1057,19 @@ void Kangaroo::SolveKeyGPU(TH_PARAM *ph) {
     ph->py = new Int[ph->nbKangaroo];
     ph->distance = new Int[ph->nbKangaroo];
 
-    for(uint64_t i = 0; i<nbThread; i++) {
-      CreateHerd(GPU_GRP_SIZE,&(ph->px[i*GPU_GRP_SIZE]),
-                              &(ph->py[i*GPU_GRP_SIZE]),
-                              &(ph->distance[i*GPU_GRP_SIZE]),
-                              TAME);
-    }
+    CreateHerdMT(nbThread * GPU_GRP_SIZE,ph->px,ph->py,ph->distance);
   }
 
-#ifdef USE_SYMMETRY
-  gpu->SetWildOffset(&rangeWidthDiv4);
-#else
-  gpu->SetWildOffset(&rangeWidthDiv2);
-#endif
-  gpu->SetParams(dMask,jumpDistance,jumpPointx,jumpPointy);
+  // Wild distances are shifted by the start of the wild window on the GPU
+  Int wildOffset;
+  wildOffset.SetInt32(0);
+  if(herdStart[WILD] < 0) {
+    wildOffset.Set(&herdStartDist[WILD]);
+    wildOffset.ModNegK1order();
+  }
+  gpu->SetWildOffset(&wildOffset);
+  gpu->SetTameRatio(tameRatio);
+  gpu->SetParams(dMask,jumpDistance,jumpPointx,jumpPointy,nbJump);
   gpu->SetKangaroos(ph->px,ph->py,ph->distance);
 
   if(workFile.length()==0 || !saveKangaroo) {
@@ -572,17 +1091,66 @@ void Kangaroo::SolveKeyGPU(TH_PARAM *ph) {
   while(!endOfSearch) {
 
     gpu->Launch(gpuFound);
-    counters[thId] += ph->nbKangaroo * NB_RUN;
+    stats[thId].step += ph->nbKangaroo * NB_RUN;
+    stats[thId].nbDP += gpuFound.size();
 
     if( clientMode ) {
 
-      for(int i=0;i<(int)gpuFound.size();i++)
-        dps.push_back(gpuFound[i]);
+      bool forceSend = false;
+
+      if(localTable && gpuFound.size() > 0) {
+
+        LockStat(thId);
+        for(int i = 0; i < (int)gpuFound.size(); i++) {
+          uint32_t kType = KangarooType(gpuFound[i].kIdx);
+          int addStatus = AddToLocalTable(&gpuFound[i].x,&gpuFound[i].d,kType);
+          if(addStatus == ADD_DUPLICATE) {
+            // Dead kangaroo, reset it and drop the DP
+            Int px;
+            Int py;
+            Int d;
+            CreateHerd(1,&px,&py,&d,gpuFound[i].kIdx,false);
+            gpu->SetKangaroo(gpuFound[i].kIdx,&px,&py,&d);
+            nbResetKangaroo++;
+            stats[thId].nbDead++;
+          } else {
+            forceSend |= (addStatus == ADD_COLLISION);
+            dps.push_back(gpuFound[i]);
+          }
+        }
+        UNLOCK(ghMutex);
+
+      } else {
+
+        for(int i=0;i<(int)gpuFound.size();i++)
+          dps.push_back(gpuFound[i]);
+
+      }
 
       double now = Timer::get_tick();
-      if(now - lastSent > SEND_PERIOD) {
-        LOCK(ghMutex);
-        SendToServer(dps,ph->threadId,ph->gpuId);
+      if(forceSend || now - lastSent > sendPeriod) {
+        LockStat(thId);
+        uint64_t n0 = Timer::get_ns();
+        SendToServer(dps,ph->threadId,ph->gpuId,++batchId,dead);
+        stats[thId].netStall += Timer::get_ns() - n0;
+        // Reset kangaroos found dead by the server (ignore DP sent before a previous reset)
+        if(dead.size() > 0 && resetBatch.size() == 0)
+          resetBatch.resize(ph->nbKangaroo,0);
+        for(int i = 0; i < (int)dead.size(); i++) {
+          uint32_t k = dead[i].kIdx;
+          if(k < ph->nbKangaroo && dead[i].batchId > resetBatch[k]) {
+            Int px;
+            Int py;
+            Int d;
+            CreateHerd(1,&px,&py,&d,k,false);
+            gpu->SetKangaroo(k,&px,&py,&d);
+            resetBatch[k] = batchId;
+            nbResetKangaroo++;
+            stats[thId].nbDead++;
+          }
+        }
+        // Key solved localy, the DP has been sent to the server
+        if(localSolved) endOfSearch = true;
         UNLOCK(ghMutex);
         lastSent = now;
       }
@@ -591,21 +1159,22 @@ void Kangaroo::SolveKeyGPU(TH_PARAM *ph) {
 
       if(gpuFound.size() > 0) {
 
-        LOCK(ghMutex);
+        LockStat(thId);
 
         for(int g = 0; !endOfSearch && g < gpuFound.size(); g++) {
 
-          uint32_t kType = (uint32_t)(gpuFound[g].kIdx % 2);
+          uint32_t kType = KangarooType(gpuFound[g].kIdx);
 
-          if(!AddToTable(&gpuFound[g].x,&gpuFound[g].d,kType)) {
+          if(!AddToTable(&gpuFound[g].x,&gpuFound[g].d,kType,thId)) {
             // Collision inside the same herd
             // We need to reset the kangaroo
             Int px;
             Int py;
             Int d;
-            CreateHerd(1,&px,&py,&d,kType,false);
+            CreateHerd(1,&px,&py,&d,gpuFound[g].kIdx,false);
             gpu->SetKangaroo(gpuFound[g].kIdx,&px,&py,&d);
             collisionInSameHerd++;
+            stats[thId].nbDead++;
           }
 
         }
@@ -614,15 +1183,21 @@ void Kangaroo::SolveKeyGPU(TH_PARAM *ph) {
 
     }
 
+    // Distinguished bits raised at runtime (-maxram)
+    if(gpu->GetDPMask() != dMask)
+      gpu->SetDPMask(dMask);
+
     // Save request
     if(saveRequest && !endOfSearch) {
       // Get kangaroos
+      uint64_t s0 = Timer::get_ns();
       if(saveKangaroo)
         gpu->GetKangaroos(ph->px,ph->py,ph->distance);
       ph->isWaiting = true;
       LOCK(saveMutex);
       ph->isWaiting = false;
       UNLOCK(saveMutex);
+      stats[thId].saveStall += Timer::get_ns() - s0;
     }
 
   }
@@ -667,7 +1242,14 @@ void *_SolveKeyGPU(void *lpParam) {
 
 // ----------------------------------------------------------------------------
 
-void Kangaroo::CreateHerd(int nbKangaroo,Int *px,Int *py,Int *d,int firstType,bool lock) {
+void Kangaroo::CreateHerd(int nbKangaroo,Int *px,Int *py,Int *d,uint64_t firstIdx,bool lock,uint32_t *wKey) {
+
+  // Kangaroo j has the type of index firstIdx+j
+  if(herdStep && wKey == NULL && nbKangaroo >= HERD_STEP_MIN && rangePower > HERD_STEP_BIT + 1 &&
+     (GetHerdConfig() & 0xFFFFFF00) == (HERD_DEFAULT & 0xFFFFFF00) && !fourKangaroo) {
+    CreateHerdStep(nbKangaroo,px,py,d,firstIdx,lock);
+    return;
+  }
 
   vector<Int> pk;
   vector<Point> S;
@@ -683,28 +1265,14 @@ void Kangaroo::CreateHerd(int nbKangaroo,Int *px,Int *py,Int *d,int firstType,bo
 
   for(uint64_t j = 0; j<nbKangaroo; j++) {
 
-#ifdef USE_SYMMETRY
-
-    // Tame in [0..N/2]
-    d[j].Rand(rangePower - 1);
-    if((j+ firstType) % 2 == WILD) {
-      // Wild in [-N/4..N/4]
-      d[j].ModSubK1order(&rangeWidthDiv4);
-    }
-
-#else
-
-    // Tame in [0..N]
-    d[j].Rand(rangePower);
-    if((j + firstType) % 2 == WILD) {
-      // Wild in [-N/2..N/2]
-      d[j].ModSubK1order(&rangeWidthDiv2);
-    }
-
-#endif
-
+    uint32_t kType = KangarooType(firstIdx + j);
+    RandomStart(&d[j],firstIdx + j);
     pk.push_back(d[j]);
 
+    // Multi-key, choose the key of wild kangaroos
+    if(wKey && kType == WILD)
+      wKey[j] = NextWildKey();
+
   }
 
   if(lock) UNLOCK(ghMutex);
@@ -713,8 +1281,12 @@ void Kangaroo::CreateHerd(int nbKangaroo,Int *px,Int *py,Int *d,int firstType,bo
   S = secp->ComputePublicKeys(pk);
 
   for(uint64_t j = 0; j<nbKangaroo; j++) {
-    if((j + firstType) % 2 == TAME) {
+    if(KangarooType(firstIdx + j) == TAME) {
       Sp.push_back(Z);
+    } else if(wKey) {
+      Sp.push_back(keysShifted[wKey[j]]);
+    } else if(fourKangaroo && KangarooSub(firstIdx + j)) {
+      Sp.push_back(keyToSearchNeg);
     } else {
       Sp.push_back(keyToSearch);
     }
@@ -739,15 +1311,206 @@ void Kangaroo::CreateHerd(int nbKangaroo,Int *px,Int *py,Int *d,int firstType,bo
 
 // ----------------------------------------------------------------------------
 
+void Kangaroo::CreateHerdStepTable() {
+
+  // Step points (i+1).step.G, the table spans the starting interval
+  int wBits = rangePower;
+#ifdef USE_SYMMETRY
+  wBits--;
+#endif
+  herdStepBit = (wBits > HERD_STEP_BIT) ? wBits - HERD_STEP_BIT : 0;
+  herdStepSize.SetInt32(1);
+  herdStepSize.ShiftL(herdStepBit);
+
+  herdStepDist.resize(HERD_STEP_SIZE);
+  herdStepPerm.resize(HERD_STEP_SIZE);
+  Int dist;
+  dist.SetInt32(0);
+  for(int i = 0; i < HERD_STEP_SIZE; i++) {
+    dist.Add(&herdStepSize);
+    herdStepDist[i].Set(&dist);
+    herdStepPerm[i] = i;
+  }
+  herdStepPoint = secp->ComputePublicKeys(herdStepDist);
+  herdStepRange = rangePower;
+
+}
+
+// ----------------------------------------------------------------------------
+
+void Kangaroo::CreateHerdStep(int nbKangaroo,Int *px,Int *py,Int *d,uint64_t firstIdx,bool lock) {
+
+  // Kangaroo j = base[type] + (r_j+1).step.G, one affine addition (batch inversion) per kangaroo
+  // instead of a full scalar multiplication, r_j all different inside a group.
+  // The base point is the only scalar multiplication of a group.
+  vector<int> r;
+  vector<Point> P1;
+  vector<Point> P2;
+  r.resize(HERD_STEP_GRP);
+  P1.reserve(HERD_STEP_GRP);
+  P2.reserve(HERD_STEP_GRP);
+
+  for(int g = 0; g < nbKangaroo; g += HERD_STEP_GRP) {
+
+    int nb = nbKangaroo - g;
+    if(nb > HERD_STEP_GRP) nb = HERD_STEP_GRP;
+    bool hasType[2] = { false,false };
+    for(int j = 0; j < nb; j++)
+      hasType[KangarooType(firstIdx + g + j)] = true;
+
+    Int base[2];
+
+    if(lock) LOCK(ghMutex);
+
+    if(herdStepRange != rangePower)
+      CreateHerdStepTable();
+
+    // Random offset in [0..step], kangaroos of a group are spread over the whole interval
+    base[TAME].SetInt32(0);
+    base[WILD].SetInt32(0);
+    if(herdStepBit > 0) {
+      base[TAME].Rand(herdStepBit);
+      base[WILD].Rand(herdStepBit);
+    }
+#ifdef USE_SYMMETRY
+    // Tame in [0..N/2], wild in [-N/4..N/4]
+    base[WILD].ModSubK1order(&rangeWidthDiv4);
+#else
+    // Tame in [0..N], wild in [-N/2..N/2]
+    base[WILD].ModSubK1order(&rangeWidthDiv2);
+#endif
+
+    // Partial Fisher-Yates shuffle
+    for(int j = 0; j < nb; j++) {
+      int k = j + (int)(rndl() % (unsigned long)(HERD_STEP_SIZE - j));
+      int t = herdStepPerm[j];
+      herdStepPerm[j] = herdStepPerm[k];
+      herdStepPerm[k] = t;
+      r[j] = herdStepPerm[j];
+    }
+
+    if(lock) UNLOCK(ghMutex);
+
+    Point B[2];
+    if(hasType[TAME]) {
+      if(base[TAME].IsZero())
+        base[TAME].SetInt32(1);
+      B[TAME] = secp->ComputePublicKey(&base[TAME]);
+    }
+    if(hasType[WILD]) {
+      B[WILD] = secp->ComputePublicKey(&base[WILD]);
+      B[WILD] = secp->AddDirect(keyToSearch,B[WILD]);
+    }
+
+    P1.clear();
+    P2.clear();
+    for(int j = 0; j < nb; j++) {
+      uint32_t kType = KangarooType(firstIdx + g + j);
+      P1.push_back(B[kType]);
+      P2.push_back(herdStepPoint[r[j]]);
+      d[g + j].Set(&herdStepDist[r[j]]);
+      d[g + j].ModAddK1order(&base[kType]);
+    }
+
+    vector<Point> S = secp->AddDirect(P1,P2);
+
+    for(int j = 0; j < nb; j++) {
+
+      px[g + j].Set(&S[j].x);
+      py[g + j].Set(&S[j].y);
+
+#ifdef USE_SYMMETRY
+      // Equivalence symmetry class switch
+      if(py[g + j].ModPositiveK1())
+        d[g + j].ModNegK1order();
+#endif
+
+    }
+
+  }
+
+}
+
+// ----------------------------------------------------------------------------
+
+#ifdef WIN64
+DWORD WINAPI _CreateHerd(LPVOID lpParam) {
+#else
+void *_CreateHerd(void *lpParam) {
+#endif
+  TH_PARAM *p = (TH_PARAM *)lpParam;
+  p->obj->CreateHerdPart(p);
+  return 0;
+}
+
+void Kangaroo::CreateHerdPart(TH_PARAM *ph) {
+
+  CreateHerd((int)ph->nbKangaroo,ph->px,ph->py,ph->distance,ph->hStart);
+  ph->isRunning = false;
+
+}
+
+void Kangaroo::CreateHerdMT(uint64_t nbKangaroo,Int *px,Int *py,Int *d) {
+
+  // Split the herd in slices (hStart: index of the first kangaroo of the slice)
+  uint64_t slice = (nbKangaroo / (uint64_t)nbHerdThread + 1) & ~1ULL;
+  if(slice < HERD_MT_MIN) slice = HERD_MT_MIN;
+  int nbTh = (int)((nbKangaroo + slice - 1) / slice);
+
+  if(nbTh <= 1) {
+    CreateHerd((int)nbKangaroo,px,py,d,TAME);
+    return;
+  }
+
+  TH_PARAM *params = (TH_PARAM *)malloc(nbTh * sizeof(TH_PARAM));
+  THREAD_HANDLE *thHandles = (THREAD_HANDLE *)malloc(nbTh * sizeof(THREAD_HANDLE));
+  memset(params,0,nbTh * sizeof(TH_PARAM));
+
+  for(int i = 0; i < nbTh; i++) {
+    uint64_t start = (uint64_t)i * slice;
+    params[i].threadId = i;
+    params[i].isRunning = true;
+    params[i].nbKangaroo = (start + slice > nbKangaroo) ? nbKangaroo - start : slice;
+    params[i].hStart = (uint32_t)start;
+    params[i].px = px + start;
+    params[i].py = py + start;
+    params[i].distance = d + start;
+    thHandles[i] = LaunchThread(_CreateHerd,params + i);
+  }
+
+  JoinThreads(thHandles,nbTh);
+  FreeHandles(thHandles,nbTh);
+  free(params);
+  free(thHandles);
+
+}
+
+// ----------------------------------------------------------------------------
+
 void Kangaroo::CreateJumpTable() {
 
+  if(jumpFileDist.size() > 0) {
+    ScaleJumpTable();
+    return;
+  }
+
+  if(jumpMean == 0 && totalRW > 0) {
+    // Parallel kangaroos, optimal mean jump is about k.sqrt(N)/4
+    jumpMean = (int)((double)rangePower / 2.0 + log2((double)totalRW) - 2.0 + 0.5);
+    if(jumpMean > rangePower - 1) jumpMean = rangePower - 1;
+    if(jumpMean < 1) jumpMean = 1;
+  }
+
 #ifdef USE_SYMMETRY
   int jumpBit = rangePower / 2;
 #else
   int jumpBit = rangePower / 2 + 1;
 #endif
+  if(jumpMean > 0)
+    jumpBit = jumpMean + 1;
 
   if(jumpBit > 128) jumpBit = 128;
+  jumpMask = nbJump - 1;
   int maxRetry = 100;
   bool ok = false;
   double distAvg;
@@ -757,8 +1520,8 @@ void Kangaroo::CreateJumpTable() {
   //::printf("Jump Avg distance max: 2^%.2f\n",log2(maxAvg));
   
   // Kangaroo jumps
-  // Constant seed for compatibilty of workfiles
-  rseed(0x600DCAFE);
+  // Constant seed for compatibilty of workfiles (other seeds are jump set candidates of -optjump)
+  rseed(jumpSeed);
 
 #ifdef USE_SYMMETRY
   Int old;
@@ -791,14 +1554,14 @@ void Kangaroo::CreateJumpTable() {
     Int totalDist;
     totalDist.SetInt32(0);
 #ifdef USE_SYMMETRY
-    for(int i = 0; i < NB_JUMP/2; ++i) {
+    for(int i = 0; i < nbJump/2; ++i) {
       jumpDistance[i].Rand(jumpBit/2);
       jumpDistance[i].Mult(&u);
       if(jumpDistance[i].IsZero())
         jumpDistance[i].SetInt32(1);
       totalDist.Add(&jumpDistance[i]);
     }
-    for(int i = NB_JUMP / 2; i < NB_JUMP; ++i) {
+    for(int i = nbJump / 2; i < nbJump; ++i) {
       jumpDistance[i].Rand(jumpBit/2);
       jumpDistance[i].Mult(&v);
       if(jumpDistance[i].IsZero())
@@ -806,31 +1569,326 @@ void Kangaroo::CreateJumpTable() {
       totalDist.Add(&jumpDistance[i]);
     }
 #else
-    for(int i = 0; i < NB_JUMP; ++i) {
+    for(int i = 0; i < nbJump; ++i) {
       jumpDistance[i].Rand(jumpBit);
+      // Four-kangaroo, even jumps keep the parity of each herd
+      if(fourKangaroo)
+        jumpDistance[i].bits64[0] &= ~1ULL;
       if(jumpDistance[i].IsZero())
-        jumpDistance[i].SetInt32(1);
+        jumpDistance[i].SetInt32(fourKangaroo ? 2 : 1);
       totalDist.Add(&jumpDistance[i]);
   }
 #endif
-    distAvg = totalDist.ToDouble() / (double)(NB_JUMP);
+    distAvg = totalDist.ToDouble() / (double)(nbJump);
     ok = distAvg>minAvg && distAvg<maxAvg;
     maxRetry--;
   }
 
-  for(int i = 0; i < NB_JUMP; ++i) {
+  for(int i = 0; i < nbJump; ++i) {
     Point J = secp->ComputePublicKey(&jumpDistance[i]);
     jumpPointx[i].Set(&J.x);
     jumpPointy[i].Set(&J.y);
   }
 
-  ::printf("Jump Avg distance: 2^%.2f\n",log2(distAvg));
+  ::printf("Jump Avg distance: 2^%.2f [%d jumps]\n",log2(distAvg),nbJump);
 
   unsigned long seed = Timer::getSeed32();
   rseed(seed);
 
 }
 
+void Kangaroo::ScaleJumpTable() {
+
+  // Jump set of a jump file (-jf), distances scaled by sqrt(N) ratio
+  int shift = rangePower - jumpFileRange;
+  Int totalDist;
+  totalDist.SetInt32(0);
+  jumpMask = nbJump - 1;
+
+#ifdef USE_SYMMETRY
+  // Jumps are multiple of 2 primes depending on the range width
+  if(shift != 0) {
+    ::printf("Jump file %s built for range width 2^%d, cannot be scaled with symmetry\n",jumpFile.c_str(),jumpFileRange);
+    ::exit(-1);
+  }
+#endif
+
+  // Random low bits when scaling up, otherwise tame and wild could only
+  // meet if their starting distances are equal modulo the scale factor
+  rseed(jumpSeed);
+
+  for(int i = 0; i < nbJump; ++i) {
+    jumpDistance[i].Set(&jumpFileDist[i]);
+    if(shift >= 0) {
+      jumpDistance[i].ShiftL(shift / 2);
+      if(shift >= 2) {
+        Int low;
+        low.Rand(shift / 2);
+        jumpDistance[i].Add(&low);
+      }
+    } else {
+      jumpDistance[i].ShiftR((-shift) / 2);
+    }
+    if(shift & 1) {
+      // sqrt(2) ~ 181/128
+      jumpDistance[i].Mult((uint64_t)181);
+      jumpDistance[i].ShiftR(shift > 0 ? 7 : 8);
+    }
+    if(fourKangaroo)
+      jumpDistance[i].bits64[0] &= ~1ULL;
+    if(jumpDistance[i].IsZero())
+      jumpDistance[i].SetInt32(fourKangaroo ? 2 : 1);
+    totalDist.Add(&jumpDistance[i]);
+  }
+
+  rseed(Timer::getSeed32());
+
+  for(int i = 0; i < nbJump; ++i) {
+    Point J = secp->ComputePublicKey(&jumpDistance[i]);
+    jumpPointx[i].Set(&J.x);
+    jumpPointy[i].Set(&J.y);
+  }
+
+  ::printf("Jump Avg distance: 2^%.2f [%d jumps, %s]\n",log2(totalDist.ToDouble() / (double)nbJump),nbJump,
+           jumpFile.c_str());
+
+}
+
+// ----------------------------------------------------------------------------
+
+uint32_t Kangaroo::GetJumpConfig() {
+
+  // Stored in the version field of work files, 0 for the default jump table
+  // b31..b16 jump number, b15..b8 log2 of the mean jump (0 from range width), b3 four-kangaroo walk,
+  // b1 jump file, b0 set
+  uint32_t walk = fourKangaroo ? 8 : 0;
+  if(jumpFileDist.size() > 0)
+    return ((uint32_t)nbJump << 16) | walk | 3;
+  if(nbJump == NB_JUMP && jumpMean < 0 && !fourKangaroo)
+    return 0;
+  return ((uint32_t)nbJump << 16) | ((uint32_t)(jumpMean > 0 ? jumpMean : 0) << 8) | walk | 1;
+
+}
+
+bool Kangaroo::SetJumpConfig(uint32_t config,std::string from) {
+
+  int nb = NB_JUMP;
+  int mean = -1;
+  if(config) {
+    nb = (int)(config >> 16);
+    mean = (int)((config >> 8) & 0xFF);
+    if(mean == 0) mean = -1;
+  }
+
+  if(nb < 2 || nb > MAX_JUMP || (nb & (nb - 1)) != 0) {
+    ::printf("Invalid jump table configuration (%s): 0x%08X\n",from.c_str(),config);
+    return false;
+  }
+
+#ifdef USE_SYMMETRY
+  if(config & 8) {
+    ::printf("Four-kangaroo walk not supported with symmetry (%s)\n",from.c_str());
+    return false;
+  }
+#endif
+  if(fourKangaroo && (config & 8) == 0)
+    ::printf("Warning, walk forced to tame/wild (%s)\n",from.c_str());
+  fourKangaroo = (config & 8) != 0;
+
+  if(config & 2) {
+    // Jump set of a jump file, the same file must be given
+    if(jumpFileDist.size() == 0 || nb != nbJump) {
+      ::printf("Jump file (-jf) of %d jumps required (%s)\n",nb,from.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  if(jumpFileDist.size() > 0) {
+    ::printf("Warning, jump file %s ignored (%s)\n",jumpFile.c_str(),from.c_str());
+    jumpFileDist.clear();
+  }
+
+  if(GetJumpConfig() != config && (nbJump != NB_JUMP || jumpMean >= 0))
+    ::printf("Warning, jump table forced to %d jumps (%s)\n",nb,from.c_str());
+
+  nbJump = nb;
+  jumpMask = nb - 1;
+  jumpMean = mean;
+  return true;
+
+}
+
+// ----------------------------------------------------------------------------
+
+uint32_t Kangaroo::KangarooType(uint64_t idx) {
+
+  if(herdType >= 0)
+    return (uint32_t)herdType;
+  return HERD_TYPE(idx,tameRatio);
+
+}
+
+uint32_t Kangaroo::GetHerdConfig() {
+
+  // Stored in work files (after the version field, version b2 set) when not HERD_DEFAULT
+  return tameRatio | ((uint32_t)(herdStart[TAME] & 0xFF) << 8) | ((uint32_t)(herdStart[WILD] & 0xFF) << 16) |
+         ((uint32_t)(herdWidth[TAME] - 1) << 24) | ((uint32_t)(herdWidth[WILD] - 1) << 28);
+
+}
+
+bool Kangaroo::SetHerdConfig(uint32_t config,std::string from) {
+
+  uint32_t ratio = config & 0xFF;
+  int tStart = (int)(int8_t)((config >> 8) & 0xFF);
+  if(ratio == 0 || tStart < 0) {
+    ::printf("Invalid herd configuration (%s): 0x%08X\n",from.c_str(),config);
+    return false;
+  }
+
+  tameRatio = ratio;
+  herdStart[TAME] = tStart;
+  herdStart[WILD] = (int)(int8_t)((config >> 16) & 0xFF);
+  herdWidth[TAME] = (int)((config >> 24) & 0xF) + 1;
+  herdWidth[WILD] = (int)((config >> 28) & 0xF) + 1;
+  return true;
+
+}
+
+bool Kangaroo::SetHerdLayout(std::vector<double> &layout) {
+
+  // tameRatio[,tameStart,tameWidth,wildStart,wildWidth], start and width in range width unit
+  double l[5] = { 0.5,0.0,1.0,-0.5,1.0 };
+  if(layout.size() != 1 && layout.size() != 5) {
+    ::printf("Invalid herd layout, 1 or 5 values expected\n");
+    return false;
+  }
+  for(int i = 0; i < (int)layout.size(); i++)
+    l[i] = layout[i];
+
+  int ratio = (int)floor(l[0] * 256.0 + 0.5);
+  int tStart = (int)floor(l[1] * 64.0 + 0.5);
+  int tWidth = (int)floor(l[2] * 16.0 + 0.5);
+  int wStart = (int)floor(l[3] * 64.0 + 0.5);
+  int wWidth = (int)floor(l[4] * 16.0 + 0.5);
+  if(ratio < 1 || ratio > 255 || tStart < 0 || tStart > 127 || wStart < -128 || wStart > 127 ||
+     tWidth < 1 || tWidth > 16 || wWidth < 1 || wWidth > 16) {
+    ::printf("Invalid herd layout, tameRatio in ]0,1[, tameStart in [0,2[, wildStart in [-2,2[, widths in ]0,1]\n");
+    return false;
+  }
+
+  tameRatio = (uint32_t)ratio;
+  herdStart[TAME] = tStart;
+  herdStart[WILD] = wStart;
+  herdWidth[TAME] = tWidth;
+  herdWidth[WILD] = wWidth;
+  return true;
+
+}
+
+std::string Kangaroo::GetHerdInfo() {
+
+  char tmp[256];
+  sprintf(tmp,"%.1f%% tame [%.3f,%.3f] wild [%.3f,%.3f]",(double)tameRatio * 100.0 / 256.0,
+          (double)herdStart[TAME] / 64.0,(double)herdStart[TAME] / 64.0 + (double)herdWidth[TAME] / 16.0,
+          (double)herdStart[WILD] / 64.0,(double)herdStart[WILD] / 64.0 + (double)herdWidth[WILD] / 16.0);
+  return std::string(tmp);
+
+}
+
+void Kangaroo::InitHerdWindows() {
+
+  // Window starts, in unit of the starting interval W (N or N/2 with symmetry)
+  for(int t = 0; t < 2; t++) {
+#ifdef USE_SYMMETRY
+    herdStartDist[t].Set(&rangeWidthDiv2);
+#else
+    herdStartDist[t].Set(&rangeWidth);
+#endif
+    int s = herdStart[t];
+    herdStartDist[t].Mult((uint64_t)(s < 0 ? -s : s));
+    herdStartDist[t].ShiftR(6);
+    if(s < 0)
+      herdStartDist[t].ModNegK1order();
+  }
+
+}
+
+uint32_t Kangaroo::KangarooSub(uint64_t idx) {
+
+  // Four-kangaroo sub herd, tame: parity of the start, wild: k or -k
+  // (alternates over the indexes of each type)
+  uint64_t r = (KangarooType(idx) == TAME) ? tameRatio : 256 - tameRatio;
+  return (uint32_t)((idx * r) >> 8) & 1;
+
+}
+
+void Kangaroo::RandomStart(Int *d,uint64_t idx) {
+
+  uint32_t kType = KangarooType(idx);
+
+  if(fourKangaroo) {
+    // Jumps are even, tame in [0..N] with the parity of the sub herd,
+    // wild at k+w or (N-k)+w, w even in [-N/16..N/16] (same parity as k)
+    if(kType == TAME) {
+      d->Rand(rangePower);
+      d->bits64[0] = (d->bits64[0] & ~1ULL) | KangarooSub(idx);
+    } else {
+      Int o(&rangeWidthDiv8);
+      o.ShiftR(1);
+      o.bits64[0] &= ~1ULL;
+      d->Rand(rangePower - 3);
+      d->bits64[0] &= ~1ULL;
+      d->ModSubK1order(&o);
+      if(KangarooSub(idx)) {
+        Int n(&rangeWidth);
+        n.bits64[0] &= ~1ULL;
+        d->ModAddK1order(&n);
+      }
+    }
+    return;
+  }
+
+#ifdef USE_SYMMETRY
+  // Default: tame in [0..N/2], wild in [-N/4..N/4]
+  d->Rand(rangePower - 1);
+#else
+  // Default: tame in [0..N], wild in [-N/2..N/2]
+  d->Rand(rangePower);
+#endif
+  if(herdWidth[kType] < 16) {
+    d->Mult((uint64_t)herdWidth[kType]);
+    d->ShiftR(4);
+  }
+  if(herdStart[kType] != 0)
+    d->ModAddK1order(&herdStartDist[kType]);
+
+}
+
+double Kangaroo::HerdFactor() {
+
+  // Expected cost relative to the default herd, tame/wild collision rate taken
+  // proportional to t.(1-t).overlap/(tameWidth.wildWidth), the overlap of the
+  // windows being averaged over the key position
+  double t = (double)tameRatio / 256.0;
+  double tS = (double)herdStart[TAME] / 64.0;
+  double tE = tS + (double)herdWidth[TAME] / 16.0;
+  double ov = 0.0;
+  for(int i = 0; i < 256; i++) {
+    double k = ((double)i + 0.5) / 256.0;
+    double wS = k + (double)herdStart[WILD] / 64.0;
+    double wE = wS + (double)herdWidth[WILD] / 16.0;
+    double o = ((wE < tE) ? wE : tE) - ((wS > tS) ? wS : tS);
+    if(o > 0.0) ov += o;
+  }
+  ov /= 256.0;
+  if(ov < 1e-3) ov = 1e-3;
+
+  double w = (double)herdWidth[TAME] * (double)herdWidth[WILD] / 256.0;
+  return sqrt((w / ov) * 0.75 * 0.25 / (t * (1.0 - t)));
+
+}
+
 // ----------------------------------------------------------------------------
 
 void Kangaroo::ComputeExpected(double dp,double *op,double *ram,double *overHead) {
@@ -861,6 +1919,13 @@ void Kangaroo::ComputeExpected(double dp,double *op,double *ram,double *overHead
   // DP Overhead
   *op = Z0 * pow(N * (k * theta + sqrt(N)),1.0 / 3.0);
 
+  // Herd layout (-herd), four-kangaroo walk (-4k)
+  if(herdType < 0) {
+    double f = fourKangaroo ? FOUR_KANGAROO_GAIN : HerdFactor();
+    *op *= f;
+    avgDP0 *= f;
+  }
+
   *ram = (double)sizeof(HASH_ENTRY) * (double)HASH_SIZE + // Table
          (double)sizeof(ENTRY *) * (double)(HASH_SIZE * 4) + // Allocation overhead
          (double)(sizeof(ENTRY) + sizeof(ENTRY *)) * (*op / theta); // Entries
@@ -886,6 +1951,7 @@ void Kangaroo::InitRange() {
   rangeWidthDiv4.ShiftR(1);
   rangeWidthDiv8.Set(&rangeWidthDiv4);
   rangeWidthDiv8.ShiftR(1);
+  InitHerdWindows();
 
 }
 
@@ -927,6 +1993,20 @@ void Kangaroo::Run(int nbThread,std::vector<int> gpuId,std::vector<int> gridSize
 
 #endif
 
+  // Group size, thread count and placement (once)
+  if(autoTune && nbCPUThread > 0) {
+    AutoTune();
+    autoTune = false;
+  }
+
+  // NUMA nodes (once), the pinning of -autotune wins
+  if(numaMode && nbCPUThread > 0) {
+    if(cpuPin.size() == 0)
+      InitNuma();
+    numaMode = false;
+  }
+  hashTable.AdviseHugePages();
+
   uint64_t totalThread = (uint64_t)nbCPUThread + (uint64_t)nbGPUThread;
   if(totalThread == 0) {
     ::printf("No CPU or GPU thread, exiting.\n");
@@ -937,7 +2017,7 @@ void Kangaroo::Run(int nbThread,std::vector<int> gpuId,std::vector<int> gridSize
   THREAD_HANDLE *thHandles = (THREAD_HANDLE *)malloc(totalThread * sizeof(THREAD_HANDLE));
 
   memset(params, 0,totalThread * sizeof(TH_PARAM));
-  memset(counters, 0, sizeof(counters));
+  memset(stats,0,sizeof(stats));
   ::printf("Number of CPU thread: %d\n", nbCPUThread);
 
 #ifdef WITHGPU
@@ -970,10 +2050,34 @@ void Kangaroo::Run(int nbThread,std::vector<int> gpuId,std::vector<int> gridSize
       saveKangaroo = true;
   }
 
+  if(fourKangaroo && nbGPUThread > 0) {
+    ::printf("Four-kangaroo walk is CPU only\n");
+    ::exit(-1);
+  }
+
   InitRange();
+
+  // Precomputed tame trails, launch only wild kangaroos
+  if(tableFile.length() > 0) {
+    if(!LoadPrecompute(tableFile))
+      ::exit(-1);
+    herdType = WILD;
+  }
+
   CreateJumpTable();
 
   ::printf("Number of kangaroos: 2^%.2f\n",log2((double)totalRW));
+  if(GetHerdConfig() != HERD_DEFAULT)
+    ::printf("Herd: %s\n",GetHerdInfo().c_str());
+  if(fourKangaroo)
+    ::printf("Walk: four-kangaroo (even jumps, tame even/odd, wild k/-k)\n");
+  if(perfMode) {
+    string info;
+    if(PerfCounters::Probe(info))
+      ::printf("Perf: %s\n",info.c_str());
+    else
+      ::printf("Perf: hardware counters unavailable, %s (phase times only)\n",info.c_str());
+  }
 
   if( !clientMode ) {
 
@@ -989,9 +2093,19 @@ void Kangaroo::Run(int nbThread,std::vector<int> gpuId,std::vector<int> gridSize
 
     if(initDPSize < 0)
       initDPSize = suggestedDP;
+    initDPSize = FitDP(initDPSize);
 
     ComputeExpected((double)initDPSize,&expectedNbOp,&expectedMem);
-    if(nbLoadedWalk == 0) ::printf("Suggested DP: %d\n",suggestedDP);
+    // Multi-key, all wild herds share the tame trails: about sqrt(nbKey) single key cost
+    if(multiKey)
+      expectedNbOp *= sqrt((double)keysToSearch.size());
+    if(nbLoadedWalk == 0 && herdType < 0) ::printf("Suggested DP: %d\n",suggestedDP);
+    if(herdType == WILD) {
+      double opT = ExpectedWithTable((double)initDPSize,precompCoverage,precompSpan);
+      ::printf("Expected operations (standard): 2^%.2f\n",log2(expectedNbOp));
+      ::printf("Expected speedup (table): x%.1f\n",expectedNbOp / opT);
+      expectedNbOp = opT;
+    }
     ::printf("Expected operations: 2^%.2f\n",log2(expectedNbOp));
     ::printf("Expected RAM: %.1fMB\n",expectedMem);
 
@@ -1000,81 +2114,70 @@ void Kangaroo::Run(int nbThread,std::vector<int> gpuId,std::vector<int> gridSize
     keyIdx = 0;
     InitSearchKey();
 
+    if(localTable)
+      ::printf("Local DP table: %.0f entries max\n",(double)maxLocalDP);
+
   }
 
   SetDP(initDPSize);
+  InitMetrics();
 
   // Fetch kangaroos (if any)
   FectchKangaroos(params);
 
-//#define STATS
-#ifdef STATS
-
-    CPU_GRP_SIZE = 1024;
-    for(; CPU_GRP_SIZE <= 1024; CPU_GRP_SIZE *= 4) {
-
-      uint64_t totalCount = 0;
-      uint64_t totalDead = 0;
-
-#endif
-
-    for(keyIdx = 0; keyIdx < keysToSearch.size(); keyIdx++) {
+  for(keyIdx = 0; keyIdx < keysToSearch.size(); keyIdx++) {
 
-      InitSearchKey();
-
-      endOfSearch = false;
-      collisionInSameHerd = 0;
-
-      // Reset conters
-      memset(counters,0,sizeof(counters));
-
-      // Lanch CPU threads
-      for(int i = 0; i < nbCPUThread; i++) {
-        params[i].threadId = i;
-        params[i].isRunning = true;
-        thHandles[i] = LaunchThread(_SolveKeyCPU,params + i);
-      }
+    InitSearchKey();
+    if(multiKey)
+      InitMultiKey();
+    if(herdType == WILD)
+      ImportPrecompute();
+    StartTrace();
+
+    endOfSearch = false;
+    keyFound = false;
+    collisionInSameHerd = 0;
+    double tk = Timer::get_tick();
+
+    // Reset conters
+    memset(stats,0,sizeof(stats));
+    perfTotal.Reset();
+
+    // Lanch CPU threads
+    for(int i = 0; i < nbCPUThread; i++) {
+      params[i].threadId = i;
+      params[i].isRunning = true;
+      thHandles[i] = LaunchThread(_SolveKeyCPU,params + i);
+    }
 
 #ifdef WITHGPU
 
-      // Launch GPU threads
-      for(int i = 0; i < nbGPUThread; i++) {
-        int id = nbCPUThread + i;
-        params[id].threadId = 0x80L + i;
-        params[id].isRunning = true;
-        params[id].gpuId = gpuId[i];
-        thHandles[id] = LaunchThread(_SolveKeyGPU,params + id);
-      }
+    // Launch GPU threads
+    for(int i = 0; i < nbGPUThread; i++) {
+      int id = nbCPUThread + i;
+      params[id].threadId = 0x80L + i;
+      params[id].isRunning = true;
+      params[id].gpuId = gpuId[i];
+      thHandles[id] = LaunchThread(_SolveKeyGPU,params + id);
+    }
 
 #endif
 
+    // Wait for end
+    Process(params,"MK/s");
+    JoinThreads(thHandles,nbCPUThread + nbGPUThread);
+    FreeHandles(thHandles,nbCPUThread + nbGPUThread);
+    hashTable.Reset();
 
-      // Wait for end
-      Process(params,"MK/s");
-      JoinThreads(thHandles,nbCPUThread + nbGPUThread);
-      FreeHandles(thHandles,nbCPUThread + nbGPUThread);
-      hashTable.Reset();
+    if(benchMode)
+      AddBenchResult(Timer::get_tick() - tk);
 
-#ifdef STATS
-
-      uint64_t count = getCPUCount() + getGPUCount();
-      totalCount += count;
-      totalDead += collisionInSameHerd;
-      double SN = pow(2.0,rangePower / 2.0);
-      double avg = (double)totalCount / (double)(keyIdx + 1);
-      ::printf("\n[%3d] 2^%.3f Dead:%d Avg:2^%.3f DeadAvg:%.1f (%.3f %.3f sqrt(N))\n",
-                              keyIdx, log2((double)count), (int)collisionInSameHerd, 
-                              log2(avg), (double)totalDead / (double)(keyIdx + 1),
-                              avg/SN,expectedNbOp/SN);
-    }
-    string fName = "DP" + ::to_string(dpSize) + ".txt";
-    FILE *f = fopen(fName.c_str(),"a");
-    fprintf(f,"%d %f\n",CPU_GRP_SIZE*nbCPUThread,(double)totalCount);
-    fclose(f);
-
-#endif
+    // All keys processed together
+    if(multiKey)
+      break;
 
   }
+  CloseTrace();
 
   double t1 = Timer::get_tick();
 
@@ -38,10 +38,13 @@ typedef int SOCKET;
 
 #include <string>
 #include <vector>
+#include <map>
+#include <atomic>
 #include "SECPK1/SECP256k1.h"
 #include "HashTable.h"
 #include "SECPK1/IntGroup.h"
 #include "GPU/GPUEngine.h"
+#include "Perf.h"
 
 #ifdef WIN64
 typedef HANDLE THREAD_HANDLE;
@@ -78,9 +81,13 @@ typedef struct {
 #ifdef USE_SYMMETRY
   uint64_t *symClass; // Last jump
 #endif
+
+  uint32_t *wildKey;   // Multi-key, key index of wild kangaroos
+  uint32_t keyVersion; // Multi-key, last solved key count seen by the thread
   
   SOCKET clientSock;
   char  *clientInfo;
+  uint32_t clientId;
 
   uint32_t hStart;
   uint32_t hStop;
@@ -114,25 +121,133 @@ typedef struct {
 typedef struct {
   uint32_t nbDP;
   DP *dp;
+  uint32_t clientId; // 0 if the client does not handle dead kangaroo reset
+  uint32_t threadId;
+  uint32_t batchId;
 } DP_CACHE;
 
+// Dead kangaroo to be reset by a client
+typedef struct {
+
+  uint32_t kIdx;
+  uint32_t batchId; // DP batch where the kangaroo was found dead
+
+} DEAD_KANGAROO;
+
+// Per thread statistics, one cache line per thread, written only by its thread
+// and read without lock by Process()
+typedef struct alignas(64) {
+
+  uint64_t step;      // Kangaroo jumps
+  uint64_t nbDP;      // Distinguished points found
+  uint64_t nbDead;    // Dead kangaroo resets
+  uint64_t lockWait;  // Time waiting for ghMutex (ns)
+  uint64_t saveStall; // Time parked on saveMutex during a save (ns)
+  uint64_t netStall;  // Time spent in server requests (ns)
+
+} THREAD_STATS;
+
+// Dead kangaroos of a client (per client thread)
+typedef std::map<uint32_t,std::vector<DEAD_KANGAROO>> DEAD_LIST;
+
+// Client connection to a server shard
+typedef struct {
+
+  std::string ip;
+  int port;
+  SOCKET sock;
+  bool isConnected;
+  char *hostInfo;
+  int hostInfoLength;
+  int hostAddrType;
+  std::string status;
+  uint32_t version;
+
+} SHARD_CONN;
+
+// Relay, origin of a forwarded DP
+typedef struct {
+
+  uint32_t clientId;
+  uint32_t threadId;
+  uint32_t batchId;
+  uint32_t kIdx;
+
+} RELAY_ORIGIN;
+
+// Server, DP received from a client (metrics)
+typedef struct {
+
+  std::string info;   // ip:port
+  uint64_t nbDP;
+  uint64_t lastDP;    // nbDP at the previous metrics update
+  double dpRate;
+
+} CLIENT_METRIC;
+
+// Multi-key, two wild kangaroos of different keys at the same point
+typedef struct {
+
+  uint32_t k1;
+  Int d1;
+  uint32_t k2;
+  Int d2;
+
+} KEY_RELATION;
+
+// Precomputed tame DP
+typedef struct {
+
+  uint32_t h;
+  int128_t x;
+  int128_t d;
+  uint64_t weight; // Total length of the walks that reached this DP
+
+} PRECOMP_DP;
+
+// Benchmark result of a key
+typedef struct {
+
+  double count;  // Total number of jumps
+  double dead;   // Collisions in the same herd
+  double time;   // Time to solve (herd creation included)
+  bool solved;
+
+} BENCH_KEY;
+
 // Work file type
 #define HEADW  0xFA6A8001  // Full work file
 #define HEADK  0xFA6A8002  // Kangaroo only file
 #define HEADKS 0xFA6A8003  // Compressed Kangaroo only file
+#define HEADP  0xFA6A8004  // Precomputed tame DP table
+#define HEADJ  0xFA6A8005  // Jump file
 
 // Number of Hash entry per partition
 #define H_PER_PART (HASH_SIZE / MERGE_PART)
 
+// Points of the success probability curve (50%, 90%, 99%)
+#define NB_SUCC_POINT 3
+
 class Kangaroo {
 
 public:
 
   Kangaroo(Secp256K1 *secp,int32_t initDPSize,bool useGpu,std::string &workFile,std::string &iWorkFile,
            uint32_t savePeriod,bool saveKangaroo,bool saveKangarooByServer,double maxStep,int wtimeout,int sport,int ntimeout,
-           std::string serverIp,std::string outputFile,bool splitWorkfile);
+           std::string serverIp,std::string outputFile,bool splitWorkfile,int localTableSize,int shardIdx,int nbShard,bool multiKey,
+           std::string tableFile,int nbJump,int jumpMean,std::string jumpFile,bool herdStep,int maxRam,
+           std::vector<double> herdLayout,bool fourKangaroo,std::string metricsFile,int metricsPort,
+           bool perfMode,bool autoTune,bool numaMode,double sendPeriod,std::string traceName);
   void Run(int nbThread,std::vector<int> gpuId,std::vector<int> gridSize);
   void RunServer();
+  void RunRelay();
+  void Precompute(int nbThread,std::string &fileName,int nbEntry);
+  void OptimizeJump(int nbThread,std::string &fileName,int rangeBits,int nbCandidate,int nbSolve);
+  void BenchSolve(int nbThread,std::vector<int> gpuId,std::vector<int> gridSize,int nbKey,int rangeBits,
+                  std::string &reportFile);
+  void MicroBench(std::string &reportFile,int nbRun,double runTime);
+  void FloodTest(int nbConn,double dpRate,std::string plantKey,double delay);
+  void ReplayTrace(std::string &fileName,bool pace,bool ingest,std::string &reportFile);
   bool ParseConfigFile(std::string &fileName);
   bool LoadWork(std::string &fileName);
   void Check(std::vector<int> gpuId,std::vector<int> gridSize);
@@ -149,30 +264,77 @@ public:
   // Threaded procedures
   void SolveKeyCPU(TH_PARAM *p);
   void SolveKeyGPU(TH_PARAM *p);
+  void SimulateSolve(TH_PARAM *p);
+  void FloodThread(TH_PARAM *p);
+  void CreateHerdPart(TH_PARAM *p);
+  void FilterTablePart(TH_PARAM *p);
   bool HandleRequest(TH_PARAM *p);
   bool MergePartition(TH_PARAM* p);
   bool CheckPartition(TH_PARAM* p);
   bool CheckWorkFile(TH_PARAM* p);
   void ProcessServer();
+  void ProcessRelay();
+  void MetricsServer();
+  void TuneThread(TH_PARAM *p);
 
-  void AddConnectedClient();
-  void RemoveConnectedClient();
+  void AddConnectedClient(TH_PARAM *p);
+  void RemoveConnectedClient(TH_PARAM *p);
   void RemoveConnectedKangaroo(uint64_t nb);
 
 private:
 
   bool IsDP(uint64_t x);
   void SetDP(int size);
-  void CreateHerd(int nbKangaroo,Int *px, Int *py, Int *d, int firstType,bool lock=true);
+  void CreateHerd(int nbKangaroo,Int *px, Int *py, Int *d, uint64_t firstIdx,bool lock=true,uint32_t *wKey=NULL);
+  void CreateHerdMT(uint64_t nbKangaroo,Int *px,Int *py,Int *d);
+  void CreateHerdStep(int nbKangaroo,Int *px,Int *py,Int *d,uint64_t firstIdx,bool lock);
+  void CreateHerdStepTable();
   void CreateJumpTable();
-  bool AddToTable(uint64_t h,int128_t *x,int128_t *d);
-  bool AddToTable(Int *pos,Int *dist,uint32_t kType);
-  bool SendToServer(std::vector<ITEM> &dp,uint32_t threadId,uint32_t gpuId);
+  void ScaleJumpTable();
+  bool LoadJumpFile(std::string &fileName);
+  bool SaveJumpFile(std::string &fileName);
+  void AddBenchResult(double solveTime);
+  void JumpHerd(int nbKangaroo,Int *px,Int *py,Int *d,uint64_t *symClass,IntGroup *grp,Int *dx,
+                PerfCounters *perf = NULL);
+  uint32_t GetJumpConfig();
+  bool SetJumpConfig(uint32_t config,std::string from);
+  uint32_t KangarooType(uint64_t idx);
+  uint32_t GetHerdConfig();
+  bool SetHerdConfig(uint32_t config,std::string from);
+  bool SetHerdLayout(std::vector<double> &layout);
+  std::string GetHerdInfo();
+  void InitHerdWindows();
+  uint32_t KangarooSub(uint64_t idx);
+  void RandomStart(Int *d,uint64_t idx);
+  double HerdFactor();
+  bool AddToTable(uint64_t h,int128_t *x,int128_t *d,uint32_t thId);
+  bool AddToTable(Int *pos,Int *dist,uint32_t kType,uint32_t thId);
+  int AddToLocalTable(Int *pos,Int *dist,uint32_t kType);
+  bool SendToServer(std::vector<ITEM> &dp,uint32_t threadId,uint32_t gpuId,uint32_t batchId,std::vector<DEAD_KANGAROO> &dead);
+  bool SendDPToServer(std::vector<DP> &dp,uint32_t threadId,uint32_t gpuId,uint32_t batchId,std::vector<DEAD_KANGAROO> &dead);
+  bool SendToShard(DP *dp,uint32_t nbDP,uint32_t threadId,uint32_t gpuId,uint32_t batchId,std::vector<DEAD_KANGAROO> &dead);
   bool CheckKey(Int d1,Int d2,uint8_t type);
   bool CollisionCheck(Int* d1,uint32_t type1,Int* d2,uint32_t type2);
+  bool CheckWildPair(Int *d1,Int *d2);
   void ComputeExpected(double dp,double *op,double *ram,double* overHead = NULL);
+  double ProjectedRAM(int dp);
+  int FitDP(int dp);
+  void AdaptDP(bool lock);
+  uint64_t FilterTable();
   void InitRange();
   void InitSearchKey();
+  void InitMultiKey();
+  bool AddToTableMK(Int *pos,Int *dist,uint32_t kType,uint32_t wKey);
+  uint32_t SplitKeyTag(Int *d);
+  bool SolveKeyMK(uint32_t k,Int *Td,Int *Wd);
+  void SetKeySolved(uint32_t k);
+  void SolveRelatedKeys();
+  uint32_t NextWildKey();
+  bool AddToPrecompute(Int *pos,Int *dist,uint64_t walkLength);
+  bool SavePrecompute(std::string &fileName);
+  bool LoadPrecompute(std::string &fileName);
+  void ImportPrecompute();
+  double ExpectedWithTable(double dp,double coverage,double span);
   std::string GetTimeStr(double s);
   bool Output(Int* pk,char sInfo,int sType);
 
@@ -200,20 +362,65 @@ private:
   int Write(SOCKET sock,char *buf,int bufsize,int timeout);
   int Read(SOCKET sock,char *buf,int bufsize,int timeout);
   bool GetConfigFromServer();
+  bool GetConfigFromShard(int s);
+  void SelectShard(int s);
+  void StopShards(int except);
+  void RouteDeadKangaroos(std::vector<DP_CACHE>& dead);
+  void SetUpstreamKangaroo();
+  static uint32_t GetShard(uint64_t h,uint32_t nbShard);
   bool ConnectToServer(SOCKET *retSock);
   void InitSocket();
   void WaitForServer();
   int32_t GetServerStatus();
   bool SendKangaroosToServer(std::string& fileName,std::vector<int128_t>& kangs);
   bool GetKangaroosFromServer(std::string& fileName,std::vector<int128_t>& kangs);
+  bool SendKangaroosToServerV3(std::string& fileName,std::vector<int128_t>& kangs);
+  bool GetKangaroosFromServerV3(std::string& fileName,std::vector<int128_t>& kangs);
+  bool SendKangaroosStream(SOCKET sock,std::string& fileName,std::vector<int128_t>& kangs,Int *checkSum,int32_t *status);
+  bool GetKangaroosStream(std::string& fileName,std::vector<int128_t>& kangs,Int *checkSum);
+  int SendFile(SOCKET sock,FILE *f,uint64_t offset,uint64_t size,int timeout);
+  void SetSocketBuffer(SOCKET sock,int size);
+  static void AddCheckSum(Int *checkSum,int128_t *K,uint64_t nb);
+  bool SendFlood(SOCKET sock,DP *dp,uint32_t nbDP,uint32_t threadId,uint32_t batchId);
+  void PlantDP(DP *dp,Int *d,uint32_t type);
+
+  // Auto-tuning (-autotune)
+  void AutoTune();
+  void InitNuma();
+  void PinNode(int thId);
+  void AdviseHerd(Int *px,Int *py,Int *d,uint64_t n);
+  void LocalizeHerd(TH_PARAM *ph);
+  void PrintHugePages();
+  void InitSuccess(bool server);
+  double SuccessProb(double ops);
+  double SuccessOps(double p);
+  void UpdateSuccess(double ops,double dead,double opRate);
+  std::string GetSuccessStr();
+  void PrintSuccess();
+  void StartTrace();
+  void CloseTrace();
+  void TraceDP(uint64_t h,int128_t *x,int128_t *d,uint32_t thId,int status);
+  double TuneRun(int grpSize,int nbThread);
+  bool LoadTune(std::string &key,int *grpSize,int *nbThread,int *placement);
+  void SaveTune(std::string &key,int grpSize,int nbThread,int placement,double rate);
+  void PinThread(int thId);
+
+  // Metrics (-metrics, -metricsport)
+  void InitMetrics();
+  void UpdateMetrics(bool server,double keyRate,double gpuKeyRate,double count);
+  std::string GetMetricsJSON(double now,bool server,double keyRate,double gpuKeyRate,double count,double eta);
+  std::string GetMetricsText(bool server,double keyRate,double gpuKeyRate,double count,double eta);
+  void SaveDone(double duration);
 
 #ifdef WIN64
   HANDLE ghMutex;
   HANDLE saveMutex;
+  HANDLE metricsMutex;
   THREAD_HANDLE LaunchThread(LPTHREAD_START_ROUTINE func,TH_PARAM *p);
 #else
   pthread_mutex_t  ghMutex;
   pthread_mutex_t  saveMutex;
+  pthread_mutex_t  metricsMutex;
   THREAD_HANDLE LaunchThread(void *(*func) (void *), TH_PARAM *p);
 #endif
 
@@ -223,13 +430,15 @@ private:
 
   uint64_t getCPUCount();
   uint64_t getGPUCount();
+  void GetThreadStats(THREAD_STATS *total);
+  void LockStat(int thId);
   bool isAlive(TH_PARAM *p);
   bool hasStarted(TH_PARAM *p);
   bool isWaiting(TH_PARAM *p);
 
   Secp256K1 *secp;
   HashTable hashTable;
-  uint64_t counters[256];
+  THREAD_STATS stats[256];
   int  nbCPUThread;
   int  nbGPUThread;
   double startTime;
@@ -246,21 +455,90 @@ private:
   uint64_t dMask;
   uint32_t dpSize;
   int32_t initDPSize;
+  int maxRam;          // DP table budget in MB (-maxram), 0: disabled
   uint64_t collisionInSameHerd;
   std::vector<Point> keysToSearch;
   Point keyToSearch;
   Point keyToSearchNeg;
   uint32_t keyIdx;
+  Int foundKey;
   bool endOfSearch;
+
+  // Multi-key (shared tame herd)
+  bool multiKey;
+  std::vector<Point> keysShifted;
+  std::vector<bool> keySolved;
+  std::vector<Int> keyShiftedPriv;
+  std::vector<KEY_RELATION> keyRelations;
+  uint32_t nbSolvedKey;
+  uint32_t solvedVersion;
+  uint32_t nextWildKey;
+  int keyTagShift;
+
+  // Precomputed tame DP table
+  int herdType;                   // -1: tame and wild, TAME or WILD only
+  std::string tableFile;
+  bool precompMode;
+  uint64_t precompTarget;
+  std::vector<PRECOMP_DP> precompTable;
+  std::map<std::pair<uint64_t,uint64_t>,uint32_t> precompIndex;
+  double precompCoverage;
+  double precompSpan;
+
+  // Solve benchmark (-bench-solve)
+  bool benchMode;
+  bool keyFound;
+  std::vector<BENCH_KEY> benchResult;
+
   bool useGpu;
   double expectedNbOp;
   double expectedMem;
+
+  // Success probability (live model)
+  static const double succPoint[NB_SUCC_POINT];
+  double succMu;                  // Mean operations without DP overhead
+  double succOverHead;            // DP overhead (operations)
+  double succProb;                // Probability reached
+  double succTime[NB_SUCC_POINT]; // Time to each point, -1: passed or unknown
+  bool succHint;                  // Last point passed, hint printed
   double maxStep;
   uint64_t totalRW;
 
-  Int jumpDistance[NB_JUMP];
-  Int jumpPointx[NB_JUMP];
-  Int jumpPointy[NB_JUMP];
+  int nbJump;       // Power of 2
+  uint64_t jumpMask;
+  int32_t jumpMean; // log2 of the mean jump, -1: from range width, 0: from kangaroo number
+  uint32_t jumpSeed;
+  std::string jumpFile;
+  std::vector<Int> jumpFileDist; // Jump set of a jump file (-jf)
+  int jumpFileRange;             // Range width the jump set was built for
+
+  // Herd layout (-herd)
+  uint32_t tameRatio;                 // Tame share in 1/256
+  int herdStart[2];                   // Start of the tame/wild start window in 1/64 of W
+  int herdWidth[2];                   // Width of the tame/wild start window in 1/16 of W
+  Int herdStartDist[2];               // Start of the windows (mod order)
+  uint32_t fileHerdConfig;            // Herd configuration read by ReadHeader
+  bool fourKangaroo;                  // Four-kangaroo walk (-4k), two tame and two wild (k,-k) herds
+
+  // Herd creation
+  bool herdStep;                      // Incremental starting points (-hs)
+  int herdStepRange;                  // Range width of the step table
+  int herdStepBit;                    // log2 of the step
+  int nbHerdThread;
+  Int herdStepSize;
+  std::vector<Int> herdStepDist;
+  std::vector<Point> herdStepPoint;
+  std::vector<int> herdStepPerm;
+
+  // Jump set simulation (-optjump)
+  Int simPriv;
+  std::vector<double> simOps;
+  uint64_t simDead;
+  uint64_t simCycle;
+  uint64_t simFail;
+  Int jumpDistance[MAX_JUMP];
+  Int jumpPointx[MAX_JUMP];
+  Int jumpPointy[MAX_JUMP];
 
   int CPU_GRP_SIZE;
 
@@ -282,7 +560,8 @@ private:
 
   // Network stuff
   int port;
-  std::string lastError;
+  static thread_local std::string lastError; // Per thread (flood senders, bulk transfers)
+  double sendPeriod;              // DP send and server flush period (-sendperiod)
   std::string serverIp;
   char *hostInfo;
   int   hostInfoLength;
@@ -294,8 +573,78 @@ private:
   std::vector<DP_CACHE> localCache;
   std::string serverStatus;
   int connectedClient;
+  uint32_t lastClientId;
+  std::map<uint32_t,DEAD_LIST> deadKangaroos;
+  uint32_t serverVersion;
+  uint64_t nbResetKangaroo;
+
+  // DP table sharding (by hash bucket)
+  std::vector<SHARD_CONN> shards; // Client
+  int curShard;                   // Client, shard currently loaded in serverConn
+  uint32_t shardIdx;              // Server
+  uint32_t nbShard;               // Server
+  uint64_t nbWrongShard;          // Server, DP received for another shard
+
+  // Relay
+  bool relayMode;
+  int listenPort;
+  uint32_t relayBatch;
+  std::map<uint32_t,std::vector<RELAY_ORIGIN>> relayOrigin; // Forwarded DP per upstream batch
+  uint64_t relayIn;
+  uint64_t relayOut;
+
+  // Client local DP table
+  HashTable *localTable;
+  uint64_t nbLocalDP;
+  uint64_t maxLocalDP;
+  bool localSolved;
   uint32_t pid;
 
+  // Metrics
+  std::string metricsFile;        // JSON lines output (-metrics)
+  int metricsPort;                // Prometheus text endpoint on 127.0.0.1 (-metricsport), 0: disabled
+  FILE *metricsStream;
+  bool metricsRunning;
+  std::string metricsText;        // Last Prometheus snapshot, protected by metricsMutex
+  std::map<uint32_t,CLIENT_METRIC> clientMetrics; // Server, per client DP counters (ghMutex)
+  double lastMetricsTime;
+  uint64_t lastMetricsDP;
+  uint32_t nbSave;
+  double lastSaveTime;
+  double totalSaveTime;
+  std::atomic<uint64_t> netRx;    // Bytes received and sent on the network (all sockets)
+  std::atomic<uint64_t> netTx;
+
+  // DP trace (-dptrace)
+  std::string traceName;
+  FILE *traceStream;              // Written by AddToTable() (ghMutex or server thread)
+  double traceStart;
+  uint64_t traceCount;
+
+  // Hardware counter profiling (-perf)
+  bool perfMode;
+  PerfCounters perfTotal;         // Sum of the CPU threads, protected by ghMutex
+
+  // Auto-tuning (-autotune)
+  bool autoTune;
+  std::vector<int> cpuPin;        // Logical CPU of each CPU thread, empty: not pinned
+
+  // NUMA placement (-numa)
+  bool numaMode;
+  std::vector<std::vector<int>> numaCpus; // Allowed CPUs of each node, empty: single node or disabled
+
+  // Server flood test (-floodtest)
+  std::vector<SOCKET> floodSock;  // One server client per connection
+  std::vector<uint8_t> floodUp;   // Connection state, 0: reconnect before next request
+  double floodRate;               // Total DP/s sent
+  bool floodPlant;                // Planted collision (-floodkey)
+  Int plantTd;                    // Distances of the planted tame and wild kangaroos
+  Int plantWd;
+  double plantDelay;
+  double plantTime;               // Time the planted pair was sent, 0: not yet
+  std::atomic<uint64_t> floodBackup;
+  std::atomic<uint64_t> floodError;
+
 };
 
 #endif // KANGAROOH
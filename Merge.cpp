@@ -56,6 +56,7 @@ bool Kangaroo::MergeWork(std::string& file1,std::string& file2,std::string& dest
   FILE* f1 = ReadHeader(file1,&v1,HEADW);
   if(f1 == NULL)
     return false;
+  uint32_t herd1 = fileHerdConfig;
 
   uint32_t dp1;
   Point k1;
@@ -88,6 +89,7 @@ bool Kangaroo::MergeWork(std::string& file1,std::string& file2,std::string& dest
     fclose(f1);
     return true;
   }
+  uint32_t herd2 = fileHerdConfig;
 
   uint32_t dp2;
   Point k2;
@@ -112,6 +114,13 @@ bool Kangaroo::MergeWork(std::string& file1,std::string& file2,std::string& dest
     return true;
   }
 
+  if(herd1 != herd2) {
+    ::printf("MergeWork: cannot merge workfile of different herd configuration\n");
+    fclose(f1);
+    fclose(f2);
+    return true;
+  }
+
   k2.z.SetInt32(1);
   if(!secp->EC(k2)) {
     ::printf("MergeWork: key2 does not lie on elliptic curve\n");
@@ -176,6 +185,10 @@ bool Kangaroo::MergeWork(std::string& file1,std::string& file2,std::string& dest
     return true;
   }
   dpSize = (dp1 < dp2) ? dp1 : dp2;
+
+  // Keep the jump table of the source files
+  SetJumpConfig(v1,file1);
+  SetHerdConfig(herd1,file1);
   if( !SaveHeader(tmpName,f,HEADW,count1 + count2,time1 + time2) ) {
     fclose(f1);
     fclose(f2);
@@ -0,0 +1,288 @@
+/*
+* This file is part of the BSGS distribution (https://github.com/JeanLucPons/Kangaroo).
+* Copyright (c) 2020 Jean Luc PONS.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Kangaroo.h"
+#include "Timer.h"
+#include <string.h>
+#include <time.h>
+#define _USE_MATH_DEFINES
+#include <math.h>
+#ifndef WIN64
+#include <pthread.h>
+#endif
+
+using namespace std;
+
+// ----------------------------------------------------------------------------
+
+#ifdef WIN64
+DWORD WINAPI _metricsServer(LPVOID lpParam) {
+#else
+void *_metricsServer(void *lpParam) {
+#endif
+  TH_PARAM *p = (TH_PARAM *)lpParam;
+  p->obj->MetricsServer();
+  free(p);
+  return 0;
+}
+
+void Kangaroo::InitMetrics() {
+
+  if(metricsFile.length() > 0 && metricsStream == NULL) {
+    metricsStream = fopen(metricsFile.c_str(),"a");
+    if(metricsStream == NULL) {
+      ::printf("Error: Cannot open %s for writing\n",metricsFile.c_str());
+      ::printf("%s\n",::strerror(errno));
+      ::exit(-1);
+    }
+    ::printf("Metrics: %s (JSON lines)\n",metricsFile.c_str());
+  }
+
+  if(metricsPort > 0 && !metricsRunning) {
+    metricsRunning = true;
+    TH_PARAM *p = (TH_PARAM *)malloc(sizeof(TH_PARAM));
+    ::memset(p,0,sizeof(TH_PARAM));
+    LaunchThread(_metricsServer,p);
+  }
+
+}
+
+// ----------------------------------------------------------------------------
+
+void Kangaroo::SaveDone(double duration) {
+
+  nbSave++;
+  lastSaveTime = duration;
+  totalSaveTime += duration;
+
+}
+
+// ----------------------------------------------------------------------------
+
+// Called by Process() and ProcessServer() at each status line
+void Kangaroo::UpdateMetrics(bool server,double keyRate,double gpuKeyRate,double count) {
+
+  if(metricsStream == NULL && metricsPort <= 0)
+    return;
+
+  double now = Timer::get_tick();
+  double dt = now - lastMetricsTime;
+  if(lastMetricsTime == 0.0) dt = now - startTime;
+  if(dt <= 0.0) dt = 1.0;
+  lastMetricsTime = now;
+
+  // Per client DP rate
+  LOCK(ghMutex);
+  for(auto it = clientMetrics.begin(); it != clientMetrics.end(); it++) {
+    CLIENT_METRIC &c = it->second;
+    c.dpRate = (double)(c.nbDP - c.lastDP) / dt;
+    c.lastDP = c.nbDP;
+  }
+  UNLOCK(ghMutex);
+
+  // ETA, from the key rate or, on a server, from the DP rate
+  double eta = -1.0;
+  if(server) {
+    uint64_t nbDP = hashTable.GetNbItem();
+    double dpRate = (nbDP > lastMetricsDP) ? (double)(nbDP - lastMetricsDP) / dt : 0.0;
+    double expectedDP = expectedNbOp / pow(2.0,dpSize) / (double)nbShard;
+    lastMetricsDP = nbDP;
+    if(dpRate > 0.0 && !relayMode)
+      eta = fmax(expectedDP - (double)nbDP,0.0) / dpRate;
+  } else if(!clientMode && !precompMode && keyRate > 0.0) {
+    eta = fmax(expectedNbOp - count,0.0) / keyRate;
+  }
+
+  if(metricsStream) {
+    string line = GetMetricsJSON((double)time(NULL),server,keyRate,gpuKeyRate,count,eta);
+    ::fprintf(metricsStream,"%s\n",line.c_str());
+    ::fflush(metricsStream);
+  }
+
+  if(metricsPort > 0) {
+    string text = GetMetricsText(server,keyRate,gpuKeyRate,count,eta);
+    LOCK(metricsMutex);
+    metricsText.swap(text);
+    UNLOCK(metricsMutex);
+  }
+
+}
+
+// ----------------------------------------------------------------------------
+
+static const char *GetMode(bool server,bool relay,bool client,bool precomp) {
+
+  if(relay) return "relay";
+  if(server) return "server";
+  if(client) return "client";
+  if(precomp) return "precompute";
+  return "standalone";
+
+}
+
+static string Num(double v) {
+
+  // JSON has no NaN, unknown values are null
+  char tmp[64];
+  if(v < 0.0 || isnan(v) || isinf(v))
+    return "null";
+  ::sprintf(tmp,"%.3f",v);
+  return string(tmp);
+
+}
+
+string Kangaroo::GetMetricsJSON(double now,bool server,double keyRate,double gpuKeyRate,double count,double eta) {
+
+  char tmp[1024];
+  string s;
+
+  ::sprintf(tmp,"{\"time\":%.0f,\"mode\":\"%s\",\"key\":%d,\"end\":%s,\"uptime\":%.3f,",
+            now,GetMode(server,relayMode,clientMode,precompMode),keyIdx,endOfSearch ? "true" : "false",
+            Timer::get_tick() - startTime);
+  s.append(tmp);
+  ::sprintf(tmp,"\"key_rate_cpu\":%.1f,\"key_rate_gpu\":%.1f,\"count\":%.0f,\"kangaroos\":%.0f,",
+            keyRate - gpuKeyRate,gpuKeyRate,count,(double)totalRW);
+  s.append(tmp);
+  ::sprintf(tmp,"\"dp_bits\":%d,\"dp_count\":%.0f,\"dp_expected\":%.1f,\"dead\":%.0f,\"reset\":%.0f,\"table_mb\":%.3f,",
+            dpSize,(double)hashTable.GetNbItem(),expectedNbOp / pow(2.0,dpSize) / (double)nbShard,
+            (double)collisionInSameHerd,(double)nbResetKangaroo,hashTable.GetSizeMB());
+  s.append(tmp);
+
+  ::sprintf(tmp,"\"clients\":%d,\"client_dp_rate\":{",server ? connectedClient : 0);
+  s.append(tmp);
+  LOCK(ghMutex);
+  for(auto it = clientMetrics.begin(); it != clientMetrics.end(); it++) {
+    if(it != clientMetrics.begin()) s.append(",");
+    ::sprintf(tmp,"\"%s\":%.2f",it->second.info.c_str(),it->second.dpRate);
+    s.append(tmp);
+  }
+  UNLOCK(ghMutex);
+  s.append("},");
+
+  THREAD_STATS st;
+  GetThreadStats(&st);
+  ::sprintf(tmp,"\"net_rx_bytes\":%.0f,\"net_tx_bytes\":%.0f,\"net_stall\":%.3f,",
+            (double)netRx,(double)netTx,(double)st.netStall / 1e9);
+  s.append(tmp);
+
+  ::sprintf(tmp,"\"save_count\":%u,\"save_last\":%.3f,\"save_total\":%.3f,\"expected_time\":%s,\"eta\":%s,",
+            nbSave,lastSaveTime,totalSaveTime,
+            Num((!server && !clientMode && keyRate > 0.0) ? expectedNbOp / keyRate : -1.0).c_str(),Num(eta).c_str());
+  s.append(tmp);
+
+  // Success probability and time to 50%, 90%, 99% (null: passed or unknown)
+  bool success = (server && !relayMode) || (!server && !clientMode && !precompMode);
+  ::sprintf(tmp,"\"success\":%s,\"success_time\":[%s,%s,%s]}",Num(success ? succProb : -1.0).c_str(),
+            Num(success ? succTime[0] : -1.0).c_str(),Num(success ? succTime[1] : -1.0).c_str(),
+            Num(success ? succTime[2] : -1.0).c_str());
+  s.append(tmp);
+
+  return s;
+
+}
+
+// ----------------------------------------------------------------------------
+
+static void AddMetric(string &s,const char *name,const char *type,const char *help) {
+
+  s.append("# HELP ");
+  s.append(name);
+  s.append(" ");
+  s.append(help);
+  s.append("\n# TYPE ");
+  s.append(name);
+  s.append(" ");
+  s.append(type);
+  s.append("\n");
+
+}
+
+static void AddValue(string &s,const char *name,const char *labels,double v) {
+
+  char tmp[512];
+  if(isnan(v))
+    ::sprintf(tmp,"%s%s NaN\n",name,labels);
+  else
+    ::sprintf(tmp,"%s%s %.15g\n",name,labels,v);
+  s.append(tmp);
+
+}
+
+#define GAUGE(name,help,v) AddMetric(s,name,"gauge",help);AddValue(s,name,"",v);
+#define COUNTER(name,help,v) AddMetric(s,name,"counter",help);AddValue(s,name,"",v);
+
+string Kangaroo::GetMetricsText(bool server,double keyRate,double gpuKeyRate,double count,double eta) {
+
+  string s;
+  char labels[256];
+
+  ::sprintf(labels,"{mode=\"%s\"}",GetMode(server,relayMode,clientMode,precompMode));
+  AddMetric(s,"kangaroo_info","gauge","Running mode");
+  AddValue(s,"kangaroo_info",labels,1.0);
+
+  GAUGE("kangaroo_uptime_seconds","Time since the start of the search",Timer::get_tick() - startTime);
+  GAUGE("kangaroo_key","Index of the key being solved",(double)keyIdx);
+  AddMetric(s,"kangaroo_key_rate","gauge","Jumps per second (smoothed)");
+  AddValue(s,"kangaroo_key_rate","{device=\"cpu\"}",keyRate - gpuKeyRate);
+  AddValue(s,"kangaroo_key_rate","{device=\"gpu\"}",gpuKeyRate);
+  GAUGE("kangaroo_count","Total jumps, including the loaded work file",count);
+  GAUGE("kangaroo_kangaroos","Number of kangaroos",(double)totalRW);
+  GAUGE("kangaroo_dp_bits","Distinguished point size",(double)dpSize);
+  GAUGE("kangaroo_dp_count","Distinguished points in the table",(double)hashTable.GetNbItem());
+  GAUGE("kangaroo_dp_expected","Expected distinguished points in the table at the solution",
+        expectedNbOp / pow(2.0,dpSize) / (double)nbShard);
+  COUNTER("kangaroo_dead_total","Collisions in the same herd (dead kangaroos)",(double)collisionInSameHerd);
+  COUNTER("kangaroo_reset_total","Client, kangaroos reset by the server or the local table",(double)nbResetKangaroo);
+  GAUGE("kangaroo_table_megabytes","Allocated DP table size",hashTable.GetSizeMB());
+  GAUGE("kangaroo_clients","Connected clients",(double)(server ? connectedClient : 0));
+
+  AddMetric(s,"kangaroo_client_dp_rate","gauge","Distinguished points per second received from a client");
+  LOCK(ghMutex);
+  for(auto it = clientMetrics.begin(); it != clientMetrics.end(); it++) {
+    ::sprintf(labels,"{client=\"%s\"}",it->second.info.c_str());
+    AddValue(s,"kangaroo_client_dp_rate",labels,it->second.dpRate);
+  }
+  AddMetric(s,"kangaroo_client_dp_total","counter","Distinguished points received from a client");
+  for(auto it = clientMetrics.begin(); it != clientMetrics.end(); it++) {
+    ::sprintf(labels,"{client=\"%s\"}",it->second.info.c_str());
+    AddValue(s,"kangaroo_client_dp_total",labels,(double)it->second.nbDP);
+  }
+  UNLOCK(ghMutex);
+
+  THREAD_STATS st;
+  GetThreadStats(&st);
+  AddMetric(s,"kangaroo_network_bytes_total","counter","Bytes on the network (all sockets)");
+  AddValue(s,"kangaroo_network_bytes_total","{direction=\"rx\"}",(double)netRx);
+  AddValue(s,"kangaroo_network_bytes_total","{direction=\"tx\"}",(double)netTx);
+  COUNTER("kangaroo_network_stall_seconds_total","Client, walker thread time spent sending DP",(double)st.netStall / 1e9);
+  COUNTER("kangaroo_save_total","Work file saves",(double)nbSave);
+  GAUGE("kangaroo_save_last_seconds","Duration of the last work file save",lastSaveTime);
+  COUNTER("kangaroo_save_seconds_total","Total time spent saving the work file",totalSaveTime);
+  GAUGE("kangaroo_expected_seconds","Expected search time",(!server && !clientMode && keyRate > 0.0) ? expectedNbOp / keyRate : NAN);
+  GAUGE("kangaroo_eta_seconds","Expected remaining time",eta < 0.0 ? NAN : eta);
+
+  bool success = (server && !relayMode) || (!server && !clientMode && !precompMode);
+  GAUGE("kangaroo_success_probability","Success probability reached (live model)",success ? succProb : NAN);
+  AddMetric(s,"kangaroo_success_seconds","gauge","Time to a point of the success curve (NaN: passed or unknown)");
+  for(int i = 0; i < NB_SUCC_POINT; i++) {
+    ::sprintf(labels,"{p=\"%g\"}",succPoint[i]);
+    AddValue(s,"kangaroo_success_seconds",labels,(success && succTime[i] >= 0.0) ? succTime[i] : NAN);
+  }
+
+  return s;
+
+}
@@ -0,0 +1,369 @@
+/*
+* This file is part of the BSGS distribution (https://github.com/JeanLucPons/Kangaroo).
+* Copyright (c) 2020 Jean Luc PONS.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Microbenchmarks (make bench), linked with all objects except main.o
+
+#include "Kangaroo.h"
+#include "Timer.h"
+#include "SECPK1/IntGroup.h"
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+using namespace std;
+
+typedef struct {
+
+  string name;
+  int param;
+  double nbOp;     // Operations per run
+  double ns;       // Median ns/op
+  double minNs;    // Best run ns/op
+  double spread;   // (max-min)/median
+
+} MBENCH;
+
+static vector<MBENCH> mbResults;
+static volatile uint64_t mbSink;
+
+// Warm-up run then nbRun timed runs, setup is not timed
+#define MEASURE(name,param,nbOp,setup,...) {           \
+  vector<double> _t;                                     \
+  for(int _r = -1; _r < nbRun; _r++) {                   \
+    setup;                                               \
+    double _t0 = Timer::get_tick();                      \
+    __VA_ARGS__;                                         \
+    double _t1 = Timer::get_tick();                      \
+    if(_r >= 0) _t.push_back(_t1 - _t0);                 \
+  }                                                      \
+  AddResult(name,param,(double)(nbOp),_t); }
+
+// Number of operations for a run of about runTime seconds
+#define CALIBRATE(n,...) {                               \
+  n = 256;                                               \
+  double _e = 0.0;                                       \
+  while(_e < runTime / 4.0) {                            \
+    n *= 2;                                              \
+    double _t0 = Timer::get_tick();                      \
+    __VA_ARGS__;                                         \
+    _e = Timer::get_tick() - _t0;                        \
+  }                                                      \
+  n = (uint64_t)((double)n * runTime / _e) + 1; }
+
+// ----------------------------------------------------------------------------
+
+static void AddResult(const char *name,int param,double nbOp,vector<double> &t) {
+
+  MBENCH b;
+  sort(t.begin(),t.end());
+  b.name = string(name);
+  b.param = param;
+  b.nbOp = nbOp;
+  b.ns = t[t.size() / 2] * 1e9 / nbOp;
+  b.minNs = t[0] * 1e9 / nbOp;
+  b.spread = (t[t.size() - 1] - t[0]) / t[t.size() / 2];
+  mbResults.push_back(b);
+
+  ::printf("%-18s %8d %12.2f ns/op %14.0f op/s [min %.2f, spread %.1f%%]\n",name,param,b.ns,1e9 / b.ns,
+           b.minNs,b.spread * 100.0);
+
+}
+
+static void RandEntries(vector<Int> &x,vector<Int> &d,uint64_t nb) {
+
+  x.resize(nb);
+  d.resize(nb);
+  for(uint64_t i = 0; i < nb; i++) {
+    x[i].Rand(256);
+    d[i].Rand(64);
+  }
+
+}
+
+static void FillTable(HashTable *t,uint64_t nb) {
+
+  Int x;
+  Int d;
+  for(uint64_t i = 0; i < nb; i++) {
+    x.Rand(256);
+    d.Rand(64);
+    t->Add(&x,&d,(uint32_t)(i & 1));
+  }
+
+}
+
+// ----------------------------------------------------------------------------
+
+void Kangaroo::MicroBench(std::string &reportFile,int nbRun,double runTime) {
+
+  uint64_t n;
+
+  // Same data for each run of the benchmark
+  rseed(0x600DCAFE);
+
+  ::printf("%-18s %8s\n","Benchmark","Param");
+
+  // Field arithmetic
+  Int a;
+  Int b;
+  Int r;
+  a.Rand(256);
+  a.Mod(Int::GetFieldCharacteristic());
+  b.Rand(256);
+  b.Mod(Int::GetFieldCharacteristic());
+
+  r.Set(&a);
+  CALIBRATE(n,for(uint64_t i = 0; i < n; i++) r.ModMulK1(&b));
+  MEASURE("ModMulK1",0,n,r.Set(&a),for(uint64_t i = 0; i < n; i++) r.ModMulK1(&b));
+  mbSink += r.bits64[0];
+
+  CALIBRATE(n,for(uint64_t i = 0; i < n; i++) r.ModSquareK1(&r));
+  MEASURE("ModSquareK1",0,n,r.Set(&a),for(uint64_t i = 0; i < n; i++) r.ModSquareK1(&r));
+  mbSink += r.bits64[0];
+
+  CALIBRATE(n,for(uint64_t i = 0; i < n; i++) r.ModInv());
+  MEASURE("ModInv",0,n,r.Set(&a),for(uint64_t i = 0; i < n; i++) r.ModInv());
+  mbSink += r.bits64[0];
+
+  // Batch inversion, ns per element
+  int grpSize[] = { 16,64,256,1024,4096 };
+  for(int s = 0; s < 5; s++) {
+    int sz = grpSize[s];
+    IntGroup grp(sz);
+    Int *v = new Int[sz];
+    Int *v0 = new Int[sz];
+    for(int i = 0; i < sz; i++) {
+      v0[i].Rand(256);
+      v0[i].Mod(Int::GetFieldCharacteristic());
+      v[i].Set(&v0[i]);
+    }
+    grp.Set(v);
+    CALIBRATE(n,for(uint64_t i = 0; i < n; i++) grp.ModInv());
+    MEASURE("IntGroup::ModInv",sz,n * sz,for(int i = 0; i < sz; i++) v[i].Set(&v0[i]),
+            for(uint64_t i = 0; i < n; i++) grp.ModInv());
+    mbSink += v[0].bits64[0];
+    delete[] v;
+    delete[] v0;
+  }
+
+  // One SolveKeyCPU group step (jump and DP test), ns per kangaroo
+  rangeStart.SetInt32(1);
+  rangeStart.ShiftL(64);
+  rangeEnd.Set(&rangeStart);
+  rangeEnd.Add(&rangeStart);
+  rangeEnd.SubOne();
+  Int k;
+  k.Rand(64);
+  k.Add(&rangeStart);
+  keysToSearch.clear();
+  keysToSearch.push_back(secp->ComputePublicKey(&k));
+  keyIdx = 0;
+  totalRW = CPU_GRP_SIZE;
+  InitRange();
+  InitSearchKey();
+  CreateJumpTable();
+  SetDP(16);
+
+  Int *px = new Int[CPU_GRP_SIZE];
+  Int *py = new Int[CPU_GRP_SIZE];
+  Int *pd = new Int[CPU_GRP_SIZE];
+  Int *dx = new Int[CPU_GRP_SIZE];
+  uint64_t *symClass = new uint64_t[CPU_GRP_SIZE]();
+  IntGroup *grp = new IntGroup(CPU_GRP_SIZE);
+  AdviseHerd(px,py,pd,CPU_GRP_SIZE);
+  CreateHerd(CPU_GRP_SIZE,px,py,pd,0,false);
+  uint64_t nbDP = 0;
+  CALIBRATE(n,for(uint64_t i = 0; i < n; i++) JumpHerd(CPU_GRP_SIZE,px,py,pd,symClass,grp,dx));
+  MEASURE("JumpHerd",CPU_GRP_SIZE,n * CPU_GRP_SIZE,(void)0,
+          for(uint64_t i = 0; i < n; i++) {
+            JumpHerd(CPU_GRP_SIZE,px,py,pd,symClass,grp,dx);
+            for(int g = 0; g < CPU_GRP_SIZE; g++)
+              nbDP += IsDP(px[g].bits64[3]);
+          });
+  mbSink += nbDP;
+  delete grp;
+  delete[] px;
+  delete[] py;
+  delete[] pd;
+  delete[] dx;
+  delete[] symClass;
+
+  // Hash table insertion at various fill levels (random entries, batch of 2^14 per run)
+  const uint64_t addBatch = 1ULL << 14;
+  vector<Int> ex;
+  vector<Int> ed;
+  RandEntries(ex,ed,addBatch * (nbRun + 1));
+  uint64_t fill[] = { 0,1ULL << 20,1ULL << 22 };
+  HashTable *t = new HashTable();
+  for(int f = 0; f < 3; f++) {
+    t->Reset();
+    FillTable(t,fill[f]);
+    uint64_t pos = 0;
+    MEASURE("HashTable::Add",(int)(fill[f] >> 10),addBatch,(void)0,
+            for(uint64_t i = 0; i < addBatch; i++,pos++) t->Add(&ex[pos],&ed[pos],(uint32_t)(pos & 1)));
+  }
+  ex.clear();
+  ed.clear();
+
+  // Table files, 2^20 entries per table, ns per entry
+  const uint64_t nbEntry = 1ULL << 20;
+  HashTable *t2 = new HashTable();
+  t->Reset();
+  FillTable(t,nbEntry);
+  FillTable(t2,nbEntry);
+  FILE *f1 = tmpfile();
+  FILE *f2 = tmpfile();
+  FILE *fd = tmpfile();
+  if(f1 == NULL || f2 == NULL || fd == NULL) {
+    ::printf("MicroBench: Cannot create temporary file\n");
+    ::printf("%s\n",::strerror(errno));
+    ::exit(-1);
+  }
+
+  MEASURE("SaveTable",(int)(nbEntry >> 10),nbEntry,rewind(f1),t->SaveTable(f1,0,HASH_SIZE,false); fflush(f1));
+  t2->SaveTable(f2,0,HASH_SIZE,false);
+  fflush(f2);
+
+  MEASURE("LoadTable",(int)(nbEntry >> 10),nbEntry,rewind(f1); t2->Reset(),t2->LoadTable(f1));
+
+  uint32_t hDP;
+  uint32_t hDuplicate;
+  Int d1;
+  Int d2;
+  uint32_t k1;
+  uint32_t k2;
+  MEASURE("MergeH",(int)(nbEntry >> 9),2 * nbEntry,rewind(f1); rewind(f2); rewind(fd),
+          for(uint32_t h = 0; h < HASH_SIZE; h++) HashTable::MergeH(h,f1,f2,fd,&hDP,&hDuplicate,&d1,&k1,&d2,&k2);
+          fflush(fd));
+
+  fclose(f1);
+  fclose(f2);
+  fclose(fd);
+  t->Reset();
+  t2->Reset();
+  delete t;
+  delete t2;
+
+  if(reportFile.length() == 0)
+    return;
+
+  FILE *f = fopen(reportFile.c_str(),"w");
+  if(f == NULL) {
+    ::printf("MicroBench: Cannot open %s for writing\n",reportFile.c_str());
+    ::printf("%s\n",::strerror(errno));
+    return;
+  }
+
+  ::fprintf(f,"{\n");
+  ::fprintf(f,"  \"version\": \"%s\",\n",RELEASE);
+#ifdef USE_SYMMETRY
+  ::fprintf(f,"  \"symmetry\": true,\n");
+#else
+  ::fprintf(f,"  \"symmetry\": false,\n");
+#endif
+  ::fprintf(f,"  \"runs\": %d,\n",nbRun);
+  ::fprintf(f,"  \"run_time\": %.3f,\n",runTime);
+  ::fprintf(f,"  \"results\": [\n");
+  for(size_t i = 0; i < mbResults.size(); i++) {
+    MBENCH *m = &mbResults[i];
+    ::fprintf(f,"    {\"name\": \"%s\", \"param\": %d, \"ops\": %.0f, \"ns_per_op\": %.3f, \"ops_per_s\": %.0f, "
+              "\"min_ns_per_op\": %.3f, \"spread\": %.4f}%s\n",m->name.c_str(),m->param,m->nbOp,m->ns,1e9 / m->ns,
+              m->minNs,m->spread,(i + 1 < mbResults.size()) ? "," : "");
+  }
+  ::fprintf(f,"  ]\n");
+  ::fprintf(f,"}\n");
+  ::fclose(f);
+
+  ::printf("Report saved: %s\n",reportFile.c_str());
+
+}
+
+// ----------------------------------------------------------------------------
+
+static void printUsage() {
+
+  printf("Usage: kangaroo-bench [-o reportFile] [-r nbRun] [-rt runTime] [-hp thp|tlb] [-replay traceFile [-pace] [-ingest]]\n");
+  printf(" -o reportFile: Save results to reportFile (JSON)\n");
+  printf(" -r nbRun: Number of timed runs per benchmark (median is reported), default is 7\n");
+  printf(" -rt runTime: Duration of a run in millisec, default is 100\n");
+  printf(" -hp thp|tlb: Huge pages for the DP table entries and herds (see -hugepages)\n");
+  printf(" -replay traceFile: Replay a DP trace (see -dptrace) into HashTable::Add instead of the microbenchmarks\n");
+  printf(" -pace: Replay at the recorded pace, default is as fast as possible\n");
+  printf(" -ingest: Replay into the server ingest path (AddToTable, collision check)\n");
+  exit(0);
+
+}
+
+int main(int argc,char *argv[]) {
+
+  string reportFile = "";
+  int nbRun = 7;
+  int runTime = 100;
+  string traceFile = "";
+  bool pace = false;
+  bool ingest = false;
+
+  for(int a = 1; a < argc; a++) {
+    if(strcmp(argv[a],"-o") == 0 && a + 1 < argc) {
+      reportFile = string(argv[++a]);
+    } else if(strcmp(argv[a],"-r") == 0 && a + 1 < argc) {
+      nbRun = atoi(argv[++a]);
+    } else if(strcmp(argv[a],"-rt") == 0 && a + 1 < argc) {
+      runTime = atoi(argv[++a]);
+    } else if(strcmp(argv[a],"-hp") == 0 && a + 1 < argc) {
+      a++;
+      if(strcmp(argv[a],"thp") == 0) HashTable::SetHugePages(HUGE_PAGE_THP);
+      else if(strcmp(argv[a],"tlb") == 0) HashTable::SetHugePages(HUGE_PAGE_TLB);
+      else printUsage();
+    } else if(strcmp(argv[a],"-replay") == 0 && a + 1 < argc) {
+      traceFile = string(argv[++a]);
+    } else if(strcmp(argv[a],"-pace") == 0) {
+      pace = true;
+    } else if(strcmp(argv[a],"-ingest") == 0) {
+      ingest = true;
+    } else {
+      printUsage();
+    }
+  }
+
+  if(nbRun < 1 || runTime < 1) {
+    printf("Invalid nbRun or runTime argument\n");
+    exit(-1);
+  }
+
+#ifdef USE_SYMMETRY
+  printf("Kangaroo v" RELEASE " microbenchmarks (with symmetry)\n");
+#else
+  printf("Kangaroo v" RELEASE " microbenchmarks\n");
+#endif
+
+  Timer::Init();
+  Secp256K1 *secp = new Secp256K1();
+  secp->Init();
+
+  string empty = "";
+  vector<double> herdLayout;
+  Kangaroo *v = new Kangaroo(secp,-1,false,empty,empty,60,false,false,0.0,3000,17403,3000,"","",false,0,0,1,false,
+                             "",NB_JUMP,-1,"",false,0,herdLayout,false,"",0,false,false,false,SEND_PERIOD,"");
+  if(traceFile.length() > 0)
+    v->ReplayTrace(traceFile,pace,ingest,reportFile);
+  else
+    v->MicroBench(reportFile,nbRun,(double)runTime / 1000.0);
+
+  return 0;
+
+}
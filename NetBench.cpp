@@ -0,0 +1,435 @@
+/*
+* This file is part of the BSGS distribution (https://github.com/JeanLucPons/Kangaroo).
+* Copyright (c) 2020 Jean Luc PONS.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Distributed solve benchmark (make netbench, Linux): a local server and N CPU clients
+// are started as separate kangaroo processes for each point of the sweep
+
+#include "Constants.h"
+#include "Timer.h"
+#include "SECPK1/SECP256k1.h"
+#include "SECPK1/Random.h"
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+#define NB_TIMEOUT 120.0 // Default run timeout (s)
+
+typedef struct {
+
+  int nbClient;
+  int dp;
+  double sendPeriod;
+  int run;
+  bool solved;
+  double time;       // Time to solution (first client started -> key found by the server)
+  double nbDP;       // DP in the server table at the solution
+  double dpRate;     // Server ingest DP/s
+  double rxBytes;    // Server, bytes received (all clients)
+  double txBytes;    // Server, bytes sent
+  double stall;      // Clients, time spent sending DP (sum)
+  double stallRatio; // Clients, stall / walk time
+  double count;      // Clients, total jumps
+
+} NBENCH;
+
+// ----------------------------------------------------------------------------
+
+static void printUsage() {
+
+  printf("Usage: kangaroo-netbench [-o reportFile] [-n nbClient,...] [-d dpBit,...] [-sp sendPeriod,...]\n");
+  printf("                         [-r nbRun] [-b rangeBits] [-port port] [-timeout s] [-k kangarooPath]\n");
+  printf(" -o reportFile: JSON report, default is netbench.json\n");
+  printf(" -n nbClient,...: Number of clients (one CPU thread each), default is 1,2,4\n");
+  printf(" -d dpBit,...: Distinguished bits of the server, default is 8,12\n");
+  printf(" -sp sendPeriod,...: DP send period in seconds (-sendperiod), default is 0.5,2\n");
+  printf(" -r nbRun: Runs per point (median is reported), default is 3\n");
+  printf(" -b rangeBits: Keys in [2^rangeBits,2^(rangeBits+1)-1], default is 40\n");
+  printf(" -port port: Server port, default is 17500\n");
+  printf(" -timeout s: Run timeout, default is %.0f\n",NB_TIMEOUT);
+  printf(" -k kangarooPath: Kangaroo binary, default is ./kangaroo\n");
+  exit(0);
+
+}
+
+static void getList(const char *name,char *v,vector<double> &l) {
+
+  l.clear();
+  char *s = strtok(v,",");
+  while(s) {
+    char *end;
+    double d = strtod(s,&end);
+    if(end == s || *end != 0) {
+      printf("Invalid %s argument, number list expected\n",name);
+      exit(-1);
+    }
+    l.push_back(d);
+    s = strtok(NULL,",");
+  }
+  if(l.size() == 0) {
+    printf("Invalid %s argument, number list expected\n",name);
+    exit(-1);
+  }
+
+}
+
+// ----------------------------------------------------------------------------
+
+static pid_t Launch(vector<string> &args,string logFile) {
+
+  // The log of the previous run must not be seen by WaitFor()
+  remove(logFile.c_str());
+  fflush(stdout);
+  pid_t pid = fork();
+  if(pid < 0) {
+    printf("NetBench: fork failed: %s\n",strerror(errno));
+    exit(-1);
+  }
+
+  if(pid == 0) {
+    if(freopen(logFile.c_str(),"w",stdout) == NULL) _exit(127);
+    dup2(fileno(stdout),2);
+    vector<char *> argv;
+    for(size_t i = 0; i < args.size(); i++)
+      argv.push_back((char *)args[i].c_str());
+    argv.push_back(NULL);
+    execv(argv[0],argv.data());
+    _exit(127);
+  }
+
+  return pid;
+
+}
+
+static void Stop(pid_t pid) {
+
+  // The metrics of the last status line are kept, no clean shutdown is needed
+  if(waitpid(pid,NULL,WNOHANG) != 0)
+    return;
+  kill(pid,SIGKILL);
+  waitpid(pid,NULL,0);
+
+}
+
+static bool FileContains(string fileName,const char *pattern) {
+
+  FILE *f = fopen(fileName.c_str(),"r");
+  if(f == NULL) return false;
+  bool found = false;
+  char line[4096];
+  while(!found && fgets(line,sizeof(line),f))
+    found = strstr(line,pattern) != NULL;
+  fclose(f);
+  return found;
+
+}
+
+// Value of a numeric field in the last JSON line of a -metrics file
+static double GetMetric(string fileName,const char *field) {
+
+  FILE *f = fopen(fileName.c_str(),"r");
+  if(f == NULL) return 0.0;
+  char line[8192];
+  string last;
+  while(fgets(line,sizeof(line),f))
+    last = string(line);
+  fclose(f);
+
+  string key = "\"" + string(field) + "\":";
+  size_t pos = last.find(key);
+  if(pos == string::npos) return 0.0;
+  return strtod(last.c_str() + pos + key.length(),NULL);
+
+}
+
+static bool WaitFor(string fileName,const char *pattern,pid_t pid,double timeout) {
+
+  double t0 = Timer::get_tick();
+  while(Timer::get_tick() - t0 < timeout) {
+    if(FileContains(fileName,pattern))
+      return true;
+    if(waitpid(pid,NULL,WNOHANG) != 0)
+      return false;
+    Timer::SleepMillis(10);
+  }
+  return false;
+
+}
+
+// ----------------------------------------------------------------------------
+
+static NBENCH Run(string &kangaroo,string &dir,string &cfg,int port,int nbClient,int dp,double sendPeriod,
+                  int run,double timeout) {
+
+  NBENCH r;
+  memset(&r,0,sizeof(r));
+  r.nbClient = nbClient;
+  r.dp = dp;
+  r.sendPeriod = sendPeriod;
+  r.run = run;
+
+  char tmp[64];
+  string sp = to_string(port);
+  ::sprintf(tmp,"%g",sendPeriod);
+  string period = string(tmp);
+
+  string serverLog = dir + "/server.log";
+  string serverMetrics = dir + "/server.json";
+  remove(serverMetrics.c_str());
+  vector<string> args = { kangaroo,"-s","-sp",sp,"-d",to_string(dp),"-sendperiod",period,
+                          "-metrics",serverMetrics,cfg };
+  pid_t server = Launch(args,serverLog);
+  if(!WaitFor(serverLog,"listening",server,10.0)) {
+    printf("NetBench: server did not start, see %s\n",serverLog.c_str());
+    Stop(server);
+    exit(-1);
+  }
+
+  double t0 = Timer::get_tick();
+  vector<pid_t> clients;
+  for(int i = 0; i < nbClient; i++) {
+    string m = dir + "/client" + to_string(i) + ".json";
+    remove(m.c_str());
+    args = { kangaroo,"-t","1","-c","127.0.0.1","-sp",sp,"-sendperiod",period,"-metrics",m };
+    clients.push_back(Launch(args,dir + "/client" + to_string(i) + ".log"));
+  }
+
+  r.solved = WaitFor(serverLog,"Priv:",server,timeout);
+  r.time = Timer::get_tick() - t0;
+
+  // Last metrics of the server, written when its flush loop ends
+  if(r.solved)
+    WaitFor(serverMetrics,"\"end\":true",server,sendPeriod + 5.0);
+
+  // Clients get the end status at their next send
+  double t1 = Timer::get_tick();
+  for(int i = 0; i < nbClient; i++) {
+    while(waitpid(clients[i],NULL,WNOHANG) == 0 && Timer::get_tick() - t1 < sendPeriod + 5.0)
+      Timer::SleepMillis(10);
+    Stop(clients[i]);
+  }
+  Stop(server);
+
+  r.nbDP = GetMetric(serverMetrics,"dp_count");
+  r.dpRate = r.nbDP / r.time;
+  r.rxBytes = GetMetric(serverMetrics,"net_rx_bytes");
+  r.txBytes = GetMetric(serverMetrics,"net_tx_bytes");
+  double walkTime = 0.0;
+  for(int i = 0; i < nbClient; i++) {
+    string m = dir + "/client" + to_string(i) + ".json";
+    r.stall += GetMetric(m,"net_stall");
+    r.count += GetMetric(m,"count");
+    walkTime += GetMetric(m,"uptime");
+  }
+  r.stallRatio = (walkTime > 0.0) ? r.stall / walkTime : 0.0;
+
+  return r;
+
+}
+
+static double Median(vector<NBENCH> &runs,double NBENCH::*field) {
+
+  vector<double> v;
+  for(size_t i = 0; i < runs.size(); i++)
+    if(runs[i].solved) v.push_back(runs[i].*field);
+  if(v.size() == 0) return 0.0;
+  sort(v.begin(),v.end());
+  return v[v.size() / 2];
+
+}
+
+// ----------------------------------------------------------------------------
+
+int main(int argc,char *argv[]) {
+
+  string reportFile = "netbench.json";
+  string kangaroo = "./kangaroo";
+  vector<double> nbClients = { 1,2,4 };
+  vector<double> dps = { 8,12 };
+  vector<double> periods = { 0.5,2.0 };
+  int nbRun = 3;
+  int rangeBits = 40;
+  int port = 17500;
+  double timeout = NB_TIMEOUT;
+
+  for(int a = 1; a < argc; a++) {
+    if(strcmp(argv[a],"-o") == 0 && a + 1 < argc) {
+      reportFile = string(argv[++a]);
+    } else if(strcmp(argv[a],"-n") == 0 && a + 1 < argc) {
+      getList("nbClient",argv[++a],nbClients);
+    } else if(strcmp(argv[a],"-d") == 0 && a + 1 < argc) {
+      getList("dpBit",argv[++a],dps);
+    } else if(strcmp(argv[a],"-sp") == 0 && a + 1 < argc) {
+      getList("sendPeriod",argv[++a],periods);
+    } else if(strcmp(argv[a],"-r") == 0 && a + 1 < argc) {
+      nbRun = atoi(argv[++a]);
+    } else if(strcmp(argv[a],"-b") == 0 && a + 1 < argc) {
+      rangeBits = atoi(argv[++a]);
+    } else if(strcmp(argv[a],"-port") == 0 && a + 1 < argc) {
+      port = atoi(argv[++a]);
+    } else if(strcmp(argv[a],"-timeout") == 0 && a + 1 < argc) {
+      timeout = atof(argv[++a]);
+    } else if(strcmp(argv[a],"-k") == 0 && a + 1 < argc) {
+      kangaroo = string(argv[++a]);
+    } else {
+      printUsage();
+    }
+  }
+
+  if(nbRun < 1 || rangeBits < 16 || rangeBits > 125 || port < 1 || port > 65535 || timeout <= 0.0) {
+    printf("Invalid nbRun, rangeBits, port or timeout argument\n");
+    exit(-1);
+  }
+  for(size_t i = 0; i < nbClients.size(); i++)
+    if(nbClients[i] < 1 || nbClients[i] > 256) { printf("Invalid nbClient argument, 1..256 expected\n"); exit(-1); }
+  for(size_t i = 0; i < dps.size(); i++)
+    if(dps[i] < 0 || dps[i] > 64) { printf("Invalid dpBit argument, 0..64 expected\n"); exit(-1); }
+  for(size_t i = 0; i < periods.size(); i++)
+    if(periods[i] < 0.01) { printf("Invalid sendPeriod argument, 0.01 min\n"); exit(-1); }
+
+  if(access(kangaroo.c_str(),X_OK) != 0) {
+    printf("NetBench: %s not found, build it first (make)\n",kangaroo.c_str());
+    exit(-1);
+  }
+
+  printf("Kangaroo v" RELEASE " distributed solve benchmark\n");
+
+  Timer::Init();
+  Secp256K1 *secp = new Secp256K1();
+  secp->Init();
+
+  char dirTemplate[] = "/tmp/kangaroo-netbench-XXXXXX";
+  if(mkdtemp(dirTemplate) == NULL) {
+    printf("NetBench: mkdtemp failed: %s\n",strerror(errno));
+    exit(-1);
+  }
+  string dir = string(dirTemplate);
+  string cfg = dir + "/key.txt";
+
+  // Range [2^rangeBits,2^(rangeBits+1)-1], the keys of a run index are the same for each point of the sweep
+  Int rangeStart;
+  Int rangeEnd;
+  rangeStart.SetInt32(1);
+  rangeStart.ShiftL(rangeBits);
+  rangeEnd.Set(&rangeStart);
+  rangeEnd.Add(&rangeStart);
+  rangeEnd.SubOne();
+  vector<string> keys;
+  rseed(0x600DCAFE);
+  for(int i = 0; i < nbRun; i++) {
+    Int k;
+    k.Rand(rangeBits);
+    k.Add(&rangeStart);
+    Point P = secp->ComputePublicKey(&k);
+    keys.push_back(secp->GetPublicKeyHex(true,P));
+  }
+
+  printf("Range: 2^%d, %d run(s) per point, logs in %s\n",rangeBits,nbRun,dir.c_str());
+  printf("%7s %3s %6s %8s %10s %10s %10s %10s %8s\n","Clients","DP","Period","Solved","Time(s)","DP/s",
+         "Rx(KB)","Tx(KB)","Stall");
+
+  vector<NBENCH> results;
+  vector<NBENCH> summary;
+
+  for(size_t n = 0; n < nbClients.size(); n++) {
+    for(size_t d = 0; d < dps.size(); d++) {
+      for(size_t p = 0; p < periods.size(); p++) {
+
+        vector<NBENCH> runs;
+        for(int r = 0; r < nbRun; r++) {
+          FILE *f = fopen(cfg.c_str(),"w");
+          if(f == NULL) {
+            printf("NetBench: Cannot open %s for writing\n",cfg.c_str());
+            exit(-1);
+          }
+          ::fprintf(f,"%s\n%s\n%s\n",rangeStart.GetBase16().c_str(),rangeEnd.GetBase16().c_str(),keys[r].c_str());
+          ::fclose(f);
+          runs.push_back(Run(kangaroo,dir,cfg,port,(int)nbClients[n],(int)dps[d],periods[p],r,timeout));
+          results.push_back(runs.back());
+        }
+
+        NBENCH s;
+        memset(&s,0,sizeof(s));
+        s.nbClient = (int)nbClients[n];
+        s.dp = (int)dps[d];
+        s.sendPeriod = periods[p];
+        for(int r = 0; r < nbRun; r++)
+          if(runs[r].solved) s.run++;
+        s.solved = s.run == nbRun;
+        s.time = Median(runs,&NBENCH::time);
+        s.nbDP = Median(runs,&NBENCH::nbDP);
+        s.dpRate = Median(runs,&NBENCH::dpRate);
+        s.rxBytes = Median(runs,&NBENCH::rxBytes);
+        s.txBytes = Median(runs,&NBENCH::txBytes);
+        s.stall = Median(runs,&NBENCH::stall);
+        s.stallRatio = Median(runs,&NBENCH::stallRatio);
+        s.count = Median(runs,&NBENCH::count);
+        summary.push_back(s);
+
+        printf("%7d %3d %6.2f %4d/%-3d %10.3f %10.1f %10.1f %10.1f %7.2f%%\n",s.nbClient,s.dp,s.sendPeriod,s.run,nbRun,
+               s.time,s.dpRate,s.rxBytes / 1024.0,s.txBytes / 1024.0,s.stallRatio * 100.0);
+
+      }
+    }
+  }
+
+  FILE *f = fopen(reportFile.c_str(),"w");
+  if(f == NULL) {
+    printf("NetBench: Cannot open %s for writing\n",reportFile.c_str());
+    printf("%s\n",::strerror(errno));
+    exit(-1);
+  }
+
+  ::fprintf(f,"{\n");
+  ::fprintf(f,"  \"version\": \"%s\",\n",RELEASE);
+  ::fprintf(f,"  \"range_bits\": %d,\n",rangeBits);
+  ::fprintf(f,"  \"runs\": %d,\n",nbRun);
+  ::fprintf(f,"  \"timeout\": %.1f,\n",timeout);
+  for(int pass = 0; pass < 2; pass++) {
+    vector<NBENCH> &v = (pass == 0) ? results : summary;
+    ::fprintf(f,"  \"%s\": [\n",(pass == 0) ? "results" : "summary");
+    for(size_t i = 0; i < v.size(); i++) {
+      NBENCH *b = &v[i];
+      ::fprintf(f,"    {\"clients\": %d, \"dp_bits\": %d, \"send_period\": %.3f, ",b->nbClient,b->dp,b->sendPeriod);
+      if(pass == 0)
+        ::fprintf(f,"\"run\": %d, \"solved\": %s, ",b->run,b->solved ? "true" : "false");
+      else
+        ::fprintf(f,"\"solved_runs\": %d, ",b->run);
+      ::fprintf(f,"\"time\": %.3f, \"dp_count\": %.0f, \"ingest_dp_per_s\": %.1f, \"server_rx_bytes\": %.0f, "
+                "\"server_tx_bytes\": %.0f, \"client_stall\": %.3f, \"client_stall_ratio\": %.5f, \"count\": %.0f}%s\n",
+                b->time,b->nbDP,b->dpRate,b->rxBytes,b->txBytes,b->stall,b->stallRatio,b->count,
+                (i + 1 < v.size()) ? "," : "");
+    }
+    ::fprintf(f,"  ]%s\n",(pass == 0) ? "," : "");
+  }
+  ::fprintf(f,"}\n");
+  ::fclose(f);
+
+  printf("Report saved: %s\n",reportFile.c_str());
+
+  return 0;
+
+}
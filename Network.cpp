@@ -26,6 +26,7 @@
 #include <signal.h>
 #ifndef WIN64
 #include <pthread.h>
+#include <sys/sendfile.h>
 #else
 #include "WindowsErrors.h"
 #endif
@@ -33,6 +34,7 @@
 using namespace std;
 
 static SOCKET serverSock = 0;
+thread_local string Kangaroo::lastError;
 
 // ------------------------------------------------------------------------------------------------------
 // Common part
@@ -42,12 +44,18 @@ static SOCKET serverSock = 0;
 #define WAIT_FOR_READ  1
 #define WAIT_FOR_WRITE 2
 
-#define SERVER_VERSION 3
+#define SERVER_VERSION 9
 
 #define SERVER_HEADER 0x67DEDDC1
 
 #define KANG_PER_BLOCK 2048
 
+// Streamed kangaroo transfer (version >= 5)
+#define KANG_PER_STREAM_BLOCK (1<<16)          // 1MB per block
+#define BULK_SOCKET_BUFFER    (4*1024*1024)
+#define BULK_RETRY            4
+#define KANG_FILE_VERSION     1                // Compressed kangaroo file with checksum trailer
+
 // Commands
 #define SERVER_GETCONFIG 0
 #define SERVER_STATUS    1
@@ -55,6 +63,14 @@ static SOCKET serverSock = 0;
 #define SERVER_SETKNB    3
 #define SERVER_SAVEKANG  4
 #define SERVER_LOADKANG  5
+#define SERVER_SENDDPR   6  // Send DP and get back dead kangaroos (version >= 4)
+#define SERVER_SAVEKANGS 7  // Streamed and resumable SERVER_SAVEKANG (version >= 5)
+#define SERVER_LOADKANGS 8  // Streamed and resumable SERVER_LOADKANG (version >= 5)
+#define SERVER_GETSHARD  9  // Get shard index and shard count (version >= 6)
+#define SERVER_STOP      10 // Key solved by another shard (version >= 6)
+#define SERVER_GETJUMP   11 // Get jump table configuration (version >= 7)
+#define SERVER_GETDP     12 // Get current distinguished bits number (version >= 8)
+#define SERVER_GETHERD   13 // Get herd configuration (version >= 9)
 #define SERVER_RESETDEAD  'R'
 
 // Status
@@ -62,6 +78,9 @@ static SOCKET serverSock = 0;
 #define SERVER_END           1
 #define SERVER_BACKUP        2
 
+// Maximum number of dead kangaroos returned per SERVER_SENDDPR
+#define MAX_DEAD_PER_REPLY 65536
+
 
 #ifdef WIN64
 
@@ -106,6 +125,12 @@ string GetNetworkError() {
 #define GETFREE(name,s,b,bl,t,x)  if( (nbRead=Read(s,(char *)(b),bl,t))<0 ) { ::printf("\nReadError(" name "): %s\n",lastError.c_str()); isConnected = false; ::free(x); close_socket(s); return false; }
 #define PUTFREE(name,s,b,bl,t,x)  if( (nbWrite=Write(s,(char *)(b),bl,t))<0 ) { ::printf("\nWriteError(" name "): %s\n",lastError.c_str()); isConnected = false; ::free(x); close_socket(s); return false; }
 
+// Same without changing the connection state of the instance (server side, extra connections)
+#define SGET(name,s,b,bl,t)  if( (nbRead=Read(s,(char *)(b),bl,t))<0 ) { ::printf("\nReadError(" name "): %s\n",lastError.c_str()); close_socket(s); return false; }
+#define SPUT(name,s,b,bl,t)  if( (nbWrite=Write(s,(char *)(b),bl,t))<0 ) { ::printf("\nWriteError(" name "): %s\n",lastError.c_str()); close_socket(s); return false; }
+#define SGETFREE(name,s,b,bl,t,x)  if( (nbRead=Read(s,(char *)(b),bl,t))<0 ) { ::printf("\nReadError(" name "): %s\n",lastError.c_str()); ::free(x); close_socket(s); return false; }
+#define SPUTFREE(name,s,b,bl,t,x)  if( (nbWrite=Write(s,(char *)(b),bl,t))<0 ) { ::printf("\nWriteError(" name "): %s\n",lastError.c_str()); ::free(x); close_socket(s); return false; }
+
 void sig_handler(int signo) {
   if(signo == SIGINT) {
     ::printf("\nTerminated\n");
@@ -186,6 +211,8 @@ int Kangaroo::Write(SOCKET sock,char *buf,int bufsize,int timeout) {
     return -1;
   }
 
+  netTx += total_written;
+
   if(bufsize != 0) {
     lastError = "Failed to send entire buffer";
     return -1;
@@ -229,6 +256,8 @@ int Kangaroo::Read(SOCKET sock,char *buf,int bufsize,int timeout) { // Timeout i
     return -1;
   }
 
+  netRx += total_read;
+
   if(rd == 0) {
     lastError = "Connection closed";
     return -1;
@@ -238,6 +267,97 @@ int Kangaroo::Read(SOCKET sock,char *buf,int bufsize,int timeout) { // Timeout i
 
 }
 
+// Send a file section (zero copy when available)
+int Kangaroo::SendFile(SOCKET sock,FILE *f,uint64_t offset,uint64_t size,int timeout) {
+
+  uint64_t total_written = 0;
+
+#ifdef WIN64
+
+  char *buf = (char *)malloc(KANG_PER_STREAM_BLOCK * 16);
+  FSeek(f,offset);
+  while(size > 0) {
+    uint32_t toSend = (size > KANG_PER_STREAM_BLOCK * 16) ? KANG_PER_STREAM_BLOCK * 16 : (uint32_t)size;
+    if(::fread(buf,1,toSend,f) != toSend) {
+      lastError = "Unexpected end of file";
+      free(buf);
+      return -1;
+    }
+    if(Write(sock,buf,toSend,timeout) < 0) {
+      free(buf);
+      return -1;
+    }
+    size -= toSend;
+    total_written += toSend;
+  }
+  free(buf);
+
+#else
+
+  int fd = fileno(f);
+  off_t off = (off_t)offset;
+  ssize_t written = 0;
+
+  while(size > 0) {
+
+    // Wait
+    if(!WaitFor(sock,timeout,WAIT_FOR_WRITE))
+      return -1;
+
+    size_t toSend = (size > KANG_PER_STREAM_BLOCK * 16) ? KANG_PER_STREAM_BLOCK * 16 : (size_t)size;
+    do
+      written = sendfile(sock,fd,&off,toSend);
+    while(written == -1 && (errno == EINTR || errno == EAGAIN));
+
+    if(written <= 0)
+      break;
+
+    total_written += written;
+    size -= written;
+
+  }
+
+  netTx += total_written;
+
+  if(written < 0) {
+    lastError = GetNetworkError();
+    return -1;
+  }
+
+  if(size != 0) {
+    lastError = "Unexpected end of file";
+    return -1;
+  }
+
+#endif
+
+  return (int)(total_written > 0x7FFFFFFF ? 0x7FFFFFFF : total_written);
+
+}
+
+// Larger socket buffers for bulk transfer
+void Kangaroo::SetSocketBuffer(SOCKET sock,int size) {
+
+  if(setsockopt(sock,SOL_SOCKET,SO_SNDBUF,(char *)&size,sizeof(size)) < 0 ||
+     setsockopt(sock,SOL_SOCKET,SO_RCVBUF,(char *)&size,sizeof(size)) < 0) {
+    ::printf("\nWarning: Couldn't set socket buffer size: %s\n",GetNetworkError().c_str());
+  }
+
+}
+
+// Kangaroo checksum (sum of 128bit compressed kangaroos)
+void Kangaroo::AddCheckSum(Int *checkSum,int128_t *K,uint64_t nb) {
+
+  Int k;
+  for(uint64_t i = 0; i < nb; i++) {
+    k.SetInt32(0);
+    k.bits64[1] = K[i].i64[1];
+    k.bits64[0] = K[i].i64[0];
+    checkSum->Add(&k);
+  }
+
+}
+
 void Kangaroo::InitSocket() {
 
 #ifdef WIN64
@@ -301,20 +421,60 @@ bool Kangaroo::HandleRequest(TH_PARAM *p) {
       ::printf("\nNew connection from %s\n",p->clientInfo);
 
       // Send config to the client
-      PUT("Version",p->clientSock,&version,sizeof(uint32_t),ntimeout);
-      PUT("RangeStart",p->clientSock,rangeStart.bits64,32,ntimeout);
-      PUT("RangeEnd",p->clientSock,rangeEnd.bits64,32,ntimeout);
-      PUT("KeyX",p->clientSock,keysToSearch[keyIdx].x.bits64,32,ntimeout);
-      PUT("KeyY",p->clientSock,keysToSearch[keyIdx].y.bits64,32,ntimeout);
-      PUT("DP",p->clientSock,&initDPSize,sizeof(int32_t),ntimeout);
+      SPUT("Version",p->clientSock,&version,sizeof(uint32_t),ntimeout);
+      SPUT("RangeStart",p->clientSock,rangeStart.bits64,32,ntimeout);
+      SPUT("RangeEnd",p->clientSock,rangeEnd.bits64,32,ntimeout);
+      SPUT("KeyX",p->clientSock,keysToSearch[keyIdx].x.bits64,32,ntimeout);
+      SPUT("KeyY",p->clientSock,keysToSearch[keyIdx].y.bits64,32,ntimeout);
+      SPUT("DP",p->clientSock,&initDPSize,sizeof(int32_t),ntimeout);
+
+    } break;
 
+    // ----------------------------------------------------------------------------------------
+
+    case SERVER_GETJUMP: {
+      uint32_t jumpConfig = GetJumpConfig();
+      SPUT("JumpConfig",p->clientSock,&jumpConfig,sizeof(uint32_t),ntimeout);
+    } break;
+
+    // ----------------------------------------------------------------------------------------
+
+    case SERVER_GETHERD: {
+      uint32_t herdConfig = GetHerdConfig();
+      SPUT("HerdConfig",p->clientSock,&herdConfig,sizeof(uint32_t),ntimeout);
+    } break;
+
+    // ----------------------------------------------------------------------------------------
+
+    case SERVER_GETDP: {
+      int32_t dp = (int32_t)dpSize;
+      SPUT("DP",p->clientSock,&dp,sizeof(int32_t),ntimeout);
+    } break;
+
+    // ----------------------------------------------------------------------------------------
+
+    case SERVER_GETSHARD: {
+      SPUT("shardIdx",p->clientSock,&shardIdx,sizeof(uint32_t),ntimeout);
+      SPUT("nbShard",p->clientSock,&nbShard,sizeof(uint32_t),ntimeout);
+    } break;
+
+    // ----------------------------------------------------------------------------------------
+
+    case SERVER_STOP: {
+      if(nbShard > 1 && !endOfSearch) {
+        ::printf("\nKey#%2d solved by another shard (notified by %s)\n",keyIdx,p->clientInfo);
+        endOfSearch = true;
+      }
     } break;
 
     // ----------------------------------------------------------------------------------------
 
     case SERVER_SETKNB: {
-      GET("nbKangaroo",p->clientSock,&p->nbKangaroo,sizeof(uint64_t),ntimeout);
-      totalRW += p->nbKangaroo;
+      // Can be sent again to update the kangaroo number (relay)
+      uint64_t nbKangaroo;
+      SGET("nbKangaroo",p->clientSock,&nbKangaroo,sizeof(uint64_t),ntimeout);
+      totalRW += nbKangaroo - p->nbKangaroo;
+      p->nbKangaroo = nbKangaroo;
     } break;
 
     // ----------------------------------------------------------------------------------------
@@ -322,9 +482,9 @@ bool Kangaroo::HandleRequest(TH_PARAM *p) {
     case SERVER_RESETDEAD: {
       char response[5];
       collisionInSameHerd = 0;
-      GET("flush",p->clientSock,&response,2,ntimeout);
+      SGET("flush",p->clientSock,&response,2,ntimeout);
       sprintf(response,"OK\n");
-      PUT("resp",p->clientSock,&response,3,ntimeout);
+      SPUT("resp",p->clientSock,&response,3,ntimeout);
     } break;
 
     // ----------------------------------------------------------------------------------------
@@ -341,20 +501,20 @@ bool Kangaroo::HandleRequest(TH_PARAM *p) {
       uint32_t header = HEADKS;
       uint32_t version = 0;
 
-      GET("fileNameLenght",p->clientSock,&strSize,sizeof(uint32_t),ntimeout);
+      SGET("fileNameLenght",p->clientSock,&strSize,sizeof(uint32_t),ntimeout);
       if(strSize >= 256) {
         ::printf("\nFileName too long (MAX=256) %s\n",p->clientInfo);
         CLIENT_ABORT();
       }
 
-      GET("fileName",p->clientSock,&fileName,strSize,ntimeout);
+      SGET("fileName",p->clientSock,&fileName,strSize,ntimeout);
       fileName[strSize] = 0;
       FILE* f = fopen(fileName,"rb");
       if(f == NULL) {
         // No backup
         ::printf("LoadKang: Cannot open %s for reading\n",fileName);
         ::printf("%s\n",::strerror(errno));
-        PUT("nbKangaroo",p->clientSock,&nbKangaroo,sizeof(uint64_t),ntimeout);
+        SPUT("nbKangaroo",p->clientSock,&nbKangaroo,sizeof(uint64_t),ntimeout);
         break;
       }
 
@@ -375,7 +535,7 @@ bool Kangaroo::HandleRequest(TH_PARAM *p) {
       ::fread(&version,sizeof(uint32_t),1,f);
       ::fread(&nbKangaroo,sizeof(uint64_t),1,f);
 
-      PUT("nbKangaroo",p->clientSock,&nbKangaroo,sizeof(uint64_t),ntimeout);
+      SPUT("nbKangaroo",p->clientSock,&nbKangaroo,sizeof(uint64_t),ntimeout);
 
       checkSum.SetInt32(0);
       KBuff = (int128_t*)malloc(KANG_PER_BLOCK * sizeof(int128_t));
@@ -397,7 +557,7 @@ bool Kangaroo::HandleRequest(TH_PARAM *p) {
           checkSum.Add(&K);
         }
 
-        PUTFREE("packet",p->clientSock,KBuff,nbK * 16,ntimeout,KBuff);
+        SPUTFREE("packet",p->clientSock,KBuff,nbK * 16,ntimeout,KBuff);
 
         nbKangaroo -= nbK;
 
@@ -405,7 +565,7 @@ bool Kangaroo::HandleRequest(TH_PARAM *p) {
 
       free(KBuff);
 
-      PUT("checkSum",p->clientSock,checkSum.bits64,32,ntimeout);
+      SPUT("checkSum",p->clientSock,checkSum.bits64,32,ntimeout);
 
       ::fclose(f);
 
@@ -427,15 +587,15 @@ bool Kangaroo::HandleRequest(TH_PARAM *p) {
       uint32_t header = HEADKS;
       uint32_t version = 0;
 
-      GET("fileNameLenght",p->clientSock,&fileNameSize,sizeof(uint32_t),ntimeout);
+      SGET("fileNameLenght",p->clientSock,&fileNameSize,sizeof(uint32_t),ntimeout);
       if(fileNameSize >= 256) {
         ::printf("\nFileName too long (MAX=256) %s\n",p->clientInfo);
         CLIENT_ABORT();
       }
 
-      GET("fileName",p->clientSock,&fileName,fileNameSize,ntimeout);
+      SGET("fileName",p->clientSock,&fileName,fileNameSize,ntimeout);
       fileName[fileNameSize]=0;
-      GET("nbKangaroo",p->clientSock,&nbKangaroo,sizeof(uint64_t),ntimeout);
+      SGET("nbKangaroo",p->clientSock,&nbKangaroo,sizeof(uint64_t),ntimeout);
 
       strcpy(fileNameTmp,fileName);
       strcat(fileNameTmp,".tmp");
@@ -469,7 +629,7 @@ bool Kangaroo::HandleRequest(TH_PARAM *p) {
           nbK = (uint32_t)nbKangaroo;
         }
 
-        GETFREE("packet",p->clientSock,KBuff,nbK * 16,ntimeout,KBuff);
+        SGETFREE("packet",p->clientSock,KBuff,nbK * 16,ntimeout,KBuff);
 
         for(uint32_t k = 0; k < nbK; k++) {
           ::fwrite(&KBuff[k],16,1,f);
@@ -488,7 +648,7 @@ bool Kangaroo::HandleRequest(TH_PARAM *p) {
       ::fclose(f);
 
       K.SetInt32(0);
-      GET("checksum",p->clientSock,K.bits64,32,ntimeout);
+      SGET("checksum",p->clientSock,K.bits64,32,ntimeout);
 
       if(!K.IsEqual(&checkSum)) {
         ::printf("\nWarning, Kangaroo backup wrong checksum %s\n",fileName);
@@ -499,20 +659,244 @@ bool Kangaroo::HandleRequest(TH_PARAM *p) {
 
     } break;
 
+    // ----------------------------------------------------------------------------------------
+
+    case SERVER_LOADKANGS: {
+
+      Int checkSum;
+      uint64_t nbKangaroo = 0;
+      uint64_t start;
+      uint32_t strSize;
+      char fileName[256];
+      uint32_t header = HEADKS;
+      uint32_t version = 0;
+
+      SGET("fileNameLenght",p->clientSock,&strSize,sizeof(uint32_t),ntimeout);
+      if(strSize >= 256) {
+        ::printf("\nFileName too long (MAX=256) %s\n",p->clientInfo);
+        CLIENT_ABORT();
+      }
+
+      SGET("fileName",p->clientSock,&fileName,strSize,ntimeout);
+      fileName[strSize] = 0;
+      checkSum.SetInt32(0);
+
+      FILE* f = fopen(fileName,"rb");
+      if(f == NULL) {
+        // No backup
+        ::printf("LoadKang: Cannot open %s for reading\n",fileName);
+        ::printf("%s\n",::strerror(errno));
+        SPUT("nbKangaroo",p->clientSock,&nbKangaroo,sizeof(uint64_t),ntimeout);
+        break;
+      }
+
+      if(::fread(&header,sizeof(uint32_t),1,f) != 1 || header != HEADKS) {
+        ::printf("LoadKang: %s Not a compressed kangaroo file\n",fileName);
+        ::fclose(f);
+        SPUT("nbKangaroo",p->clientSock,&nbKangaroo,sizeof(uint64_t),ntimeout);
+        break;
+      }
+
+      ::fread(&version,sizeof(uint32_t),1,f);
+      ::fread(&nbKangaroo,sizeof(uint64_t),1,f);
+
+      if(version >= KANG_FILE_VERSION) {
+
+        // Checksum trailer
+        FSeek(f,16 + nbKangaroo * 16);
+        if(::fread(checkSum.bits64,32,1,f) != 1) {
+          ::printf("LoadKang: %s truncated file\n",fileName);
+          nbKangaroo = 0;
+        }
+
+      } else {
+
+        // Old file, compute the checksum
+        int128_t* KBuff = (int128_t*)malloc(KANG_PER_STREAM_BLOCK * sizeof(int128_t));
+        uint64_t toRead = nbKangaroo;
+        while(toRead > 0) {
+          uint32_t nbK = (toRead > KANG_PER_STREAM_BLOCK) ? KANG_PER_STREAM_BLOCK : (uint32_t)toRead;
+          if(::fread(KBuff,16,nbK,f) != nbK) {
+            ::printf("LoadKang: %s truncated file\n",fileName);
+            nbKangaroo = 0;
+            break;
+          }
+          AddCheckSum(&checkSum,KBuff,nbK);
+          toRead -= nbK;
+        }
+        free(KBuff);
+
+      }
+
+      SetSocketBuffer(p->clientSock,BULK_SOCKET_BUFFER);
+      SPUT("nbKangaroo",p->clientSock,&nbKangaroo,sizeof(uint64_t),ntimeout);
+      if(nbKangaroo == 0) {
+        ::fclose(f);
+        break;
+      }
+      SPUT("checkSum",p->clientSock,checkSum.bits64,32,ntimeout);
+
+      // Resume position
+      SGET("start",p->clientSock,&start,sizeof(uint64_t),ntimeout);
+      if(start > nbKangaroo) {
+        ::printf("\nLoadKang: invalid start position from %s\n",p->clientInfo);
+        ::fclose(f);
+        CLIENT_ABORT();
+      }
+
+      if(SendFile(p->clientSock,f,16 + start * 16,(nbKangaroo - start) * 16,ntimeout) < 0) {
+        ::printf("\nWriteError(packet): %s\n",lastError.c_str());
+        ::fclose(f);
+        CLIENT_ABORT();
+      }
+
+      ::fclose(f);
+
+    } break;
+
+    // ----------------------------------------------------------------------------------------
+
+    case SERVER_SAVEKANGS: {
+
+      Int checkSum;
+      Int K;
+      uint64_t nbKangaroo;
+      uint64_t start = 0;
+      uint32_t fileNameSize;
+      char fileNameTmp[264];
+      char fileName[256];
+      uint32_t header = HEADKS;
+      uint32_t version = KANG_FILE_VERSION;
+      int32_t status = SERVER_OK;
+
+      SGET("fileNameLenght",p->clientSock,&fileNameSize,sizeof(uint32_t),ntimeout);
+      if(fileNameSize >= 256) {
+        ::printf("\nFileName too long (MAX=256) %s\n",p->clientInfo);
+        CLIENT_ABORT();
+      }
+
+      SGET("fileName",p->clientSock,&fileName,fileNameSize,ntimeout);
+      fileName[fileNameSize] = 0;
+      SGET("nbKangaroo",p->clientSock,&nbKangaroo,sizeof(uint64_t),ntimeout);
+      SGET("checksum",p->clientSock,K.bits64,32,ntimeout);
+
+      strcpy(fileNameTmp,fileName);
+      strcat(fileNameTmp,".tmp");
+
+      // Resume an interrupted transfer of the same size
+      checkSum.SetInt32(0);
+      FILE* f = fopen(fileNameTmp,"r+b");
+      if(f) {
+        uint32_t h = 0;
+        uint32_t v = 0;
+        uint64_t nb = 0;
+        ::fread(&h,sizeof(uint32_t),1,f);
+        ::fread(&v,sizeof(uint32_t),1,f);
+        ::fread(&nb,sizeof(uint64_t),1,f);
+        if(h == HEADKS && v == KANG_FILE_VERSION && nb == nbKangaroo) {
+          int128_t* KBuff = (int128_t*)malloc(KANG_PER_STREAM_BLOCK * sizeof(int128_t));
+          uint32_t nbK;
+          while((nbK = (uint32_t)::fread(KBuff,16,KANG_PER_STREAM_BLOCK,f)) > 0 && start + nbK <= nbKangaroo) {
+            AddCheckSum(&checkSum,KBuff,nbK);
+            start += nbK;
+          }
+          free(KBuff);
+          FSeek(f,16 + start * 16);
+        } else {
+          ::fclose(f);
+          f = NULL;
+        }
+      }
+
+      if(f == NULL) {
+        f = fopen(fileNameTmp,"wb");
+        if(f == NULL) {
+          ::printf("\nCannot open %s for writing\n",fileNameTmp);
+          ::printf("%s\n",::strerror(errno));
+          CLIENT_ABORT();
+        }
+        ::fwrite(&header,sizeof(uint32_t),1,f);
+        ::fwrite(&version,sizeof(uint32_t),1,f);
+        if(::fwrite(&nbKangaroo,sizeof(uint64_t),1,f) != 1) {
+          ::printf("\nCannot write to %s\n",fileNameTmp);
+          ::printf("%s\n",::strerror(errno));
+          ::fclose(f);
+          CLIENT_ABORT();
+        }
+      }
+
+      SetSocketBuffer(p->clientSock,BULK_SOCKET_BUFFER);
+      SPUT("start",p->clientSock,&start,sizeof(uint64_t),ntimeout);
+
+      int128_t* KBuff = (int128_t*)malloc(KANG_PER_STREAM_BLOCK * sizeof(int128_t));
+      uint64_t toRead = nbKangaroo - start;
+      bool writeOk = true;
+
+      while(toRead > 0) {
+
+        uint32_t nbK = (toRead > KANG_PER_STREAM_BLOCK) ? KANG_PER_STREAM_BLOCK : (uint32_t)toRead;
+        if((nbRead = Read(p->clientSock,(char *)KBuff,nbK * 16,ntimeout)) < 0) {
+          // Keep the temporary file for resume
+          ::printf("\nReadError(packet): %s\n",lastError.c_str());
+          free(KBuff);
+          ::fclose(f);
+          CLIENT_ABORT();
+        }
+        writeOk &= (::fwrite(KBuff,16,nbK,f) == nbK);
+        AddCheckSum(&checkSum,KBuff,nbK);
+        toRead -= nbK;
+
+      }
+
+      free(KBuff);
+
+      if(!writeOk) {
+        ::printf("\nCannot write to %s\n",fileNameTmp);
+        ::printf("%s\n",::strerror(errno));
+        status = SERVER_BACKUP;
+      } else if(!K.IsEqual(&checkSum)) {
+        ::printf("\nWarning, Kangaroo backup wrong checksum %s\n",fileName);
+        status = SERVER_BACKUP;
+      } else {
+        // Checksum trailer
+        writeOk = (::fwrite(checkSum.bits64,32,1,f) == 1);
+      }
+
+      ::fclose(f);
+
+      if(status == SERVER_OK && writeOk) {
+        remove(fileName);
+        rename(fileNameTmp,fileName);
+      } else {
+        remove(fileNameTmp);
+        status = SERVER_BACKUP;
+      }
+
+      SPUT("status",p->clientSock,&status,sizeof(int32_t),ntimeout);
+
+    } break;
+
+    // ----------------------------------------------------------------------------------------
+
     case SERVER_STATUS: {
 
       state = GetServerStatus();
-      PUT("Status",p->clientSock,&state,sizeof(int32_t),ntimeout);
+      SPUT("Status",p->clientSock,&state,sizeof(int32_t),ntimeout);
 
     } break;
 
     // ----------------------------------------------------------------------------------------
 
-    case SERVER_SENDDP: {
+    case SERVER_SENDDP:
+    case SERVER_SENDDPR: {
 
       DPHEADER head;
+      uint32_t batchId = 0;
 
-      GET("DPHeader",p->clientSock,&head,sizeof(DPHEADER),ntimeout);
+      SGET("DPHeader",p->clientSock,&head,sizeof(DPHEADER),ntimeout);
+      if(cmdBuff == SERVER_SENDDPR) {
+        SGET("BatchId",p->clientSock,&batchId,sizeof(uint32_t),ntimeout);
+      }
 
       if(head.header != SERVER_HEADER) {
 
@@ -531,9 +915,31 @@ bool Kangaroo::HandleRequest(TH_PARAM *p) {
         //::printf("%d DP from %s\n",nbDP,p->clientInfo.c_str());
 
         DP *dp = (DP *)malloc(sizeof(DP)* head.nbDP);
-        GETFREE("DP",p->clientSock,dp,sizeof(DP)* head.nbDP,ntimeout,dp);
+        SGETFREE("DP",p->clientSock,dp,sizeof(DP)* head.nbDP,ntimeout,dp);
         state = GetServerStatus();
-        PUTFREE("Status",p->clientSock,&state,sizeof(int32_t),ntimeout,dp);
+        SPUTFREE("Status",p->clientSock,&state,sizeof(int32_t),ntimeout,dp);
+
+        if(cmdBuff == SERVER_SENDDPR) {
+
+          // Send back kangaroos of this thread which have been found dead
+          vector<DEAD_KANGAROO> dead;
+          LOCK(ghMutex);
+          vector<DEAD_KANGAROO>& pending = deadKangaroos[p->clientId][head.threadId];
+          if(pending.size() > MAX_DEAD_PER_REPLY) {
+            dead.assign(pending.begin(),pending.begin() + MAX_DEAD_PER_REPLY);
+            pending.erase(pending.begin(),pending.begin() + MAX_DEAD_PER_REPLY);
+          } else {
+            dead.swap(pending);
+          }
+          UNLOCK(ghMutex);
+
+          uint32_t nbDead = (uint32_t)dead.size();
+          SPUTFREE("nbDead",p->clientSock,&nbDead,sizeof(uint32_t),ntimeout,dp);
+          if(nbDead > 0) {
+            SPUTFREE("Dead",p->clientSock,dead.data(),nbDead * sizeof(DEAD_KANGAROO),ntimeout,dp);
+          }
+
+        }
 
         if(nbRead != sizeof(DP)* head.nbDP) {
 
@@ -589,7 +995,11 @@ bool Kangaroo::HandleRequest(TH_PARAM *p) {
           DP_CACHE dc;
           dc.nbDP = head.nbDP;
           dc.dp = dp;
+          dc.clientId = (cmdBuff == SERVER_SENDDPR) ? p->clientId : 0;
+          dc.threadId = head.threadId;
+          dc.batchId = batchId;
           recvDP.push_back(dc);
+          clientMetrics[p->clientId].nbDP += head.nbDP;
           UNLOCK(ghMutex);
 
         }
@@ -618,9 +1028,9 @@ DWORD WINAPI _acceptThread(LPVOID lpParam) {
 void *_acceptThread(void *lpParam) {
 #endif
   TH_PARAM *p = (TH_PARAM *)lpParam;
-  p->obj->AddConnectedClient();
+  p->obj->AddConnectedClient(p);
   p->obj->HandleRequest(p);
-  p->obj->RemoveConnectedClient();
+  p->obj->RemoveConnectedClient(p);
   p->obj->RemoveConnectedKangaroo(p->nbKangaroo);
   p->isRunning = false;
   free(p->clientInfo);
@@ -643,7 +1053,7 @@ void Kangaroo::AcceptConnections(SOCKET server_soc) {
 
   SOCKET clientSock;
 
-  ::printf("Kangaroo server is ready and listening to TCP port %d ...\n",port);
+  ::printf("Kangaroo %s is ready and listening to TCP port %d ...\n",relayMode ? "relay" : "server",listenPort);
 
   while(true) {
 
@@ -676,6 +1086,46 @@ void Kangaroo::AcceptConnections(SOCKET server_soc) {
 
 }
 
+// Relay: server for local clients, client of the upstream server(s)
+void Kangaroo::RunRelay() {
+
+  relayMode = true;
+  totalRW = 0;
+
+  // Config of local clients comes from upstream
+  if(!GetConfigFromServer())
+    ::exit(0);
+
+  // DP table used to remove duplicates before forwarding
+  if(localTable == NULL)
+    localTable = new HashTable();
+
+  RunServer();
+
+}
+
+// Relay: update upstream kangaroo number (sum of local clients)
+void Kangaroo::SetUpstreamKangaroo() {
+
+  char cmd = SERVER_SETKNB;
+  int current = curShard;
+
+  for(int s = 0; s < (int)shards.size(); s++) {
+    SelectShard(s);
+    if(isConnected) {
+      if(Write(serverConn,&cmd,1,ntimeout) < 0 ||
+         Write(serverConn,(char *)&totalRW,sizeof(uint64_t),ntimeout) < 0) {
+        ::printf("\nSendToServer(SetKNb): %s\n",lastError.c_str());
+        close_socket(serverConn);
+        isConnected = false;
+      }
+    }
+  }
+
+  SelectShard(current);
+
+}
+
 // Starts the server
 void Kangaroo::RunServer() {
 
@@ -686,6 +1136,13 @@ void Kangaroo::RunServer() {
   InitRange();
   InitSearchKey();
 
+  if(GetHerdConfig() != HERD_DEFAULT)
+    ::printf("Herd: %s\n",GetHerdInfo().c_str());
+  if(fourKangaroo)
+    ::printf("Walk: four-kangaroo (even jumps, tame even/odd, wild k/-k)\n");
+
+  if(initDPSize >= 0)
+    initDPSize = FitDP(initDPSize);
   ComputeExpected((double)initDPSize,&expectedNbOp,&expectedMem);
   ::printf("Expected operations: 2^%.2f\n",log2(expectedNbOp));
   ::printf("Expected RAM: %.1fMB\n",expectedMem);
@@ -695,6 +1152,8 @@ void Kangaroo::RunServer() {
     exit(-1);
   }
   SetDP(initDPSize);
+  InitMetrics();
+  StartTrace();
 
   if(sizeof(DP) != 40) {
     ::printf("Error: Invalid DP size struct\n");
@@ -706,6 +1165,12 @@ void Kangaroo::RunServer() {
     exit(-1);
   }
 
+  if(nbShard > 1) {
+    ::printf("Shard: %d/%d [h=0x%05X..0x%05X]\n",shardIdx,nbShard,
+      (uint32_t)(((uint64_t)shardIdx * HASH_SIZE + nbShard - 1) / nbShard),
+      (uint32_t)(((uint64_t)(shardIdx + 1) * HASH_SIZE + nbShard - 1) / nbShard) - 1);
+  }
+
   if(saveKangaroo) {
     ::printf("Waring: Server does not support -ws, ignoring\n");
     saveKangaroo = false;
@@ -737,7 +1202,7 @@ void Kangaroo::RunServer() {
 
   memset(&soc_addr,0,sizeof(soc_addr));
   soc_addr.sin_family = AF_INET;
-  soc_addr.sin_port = htons(port);
+  soc_addr.sin_port = htons(listenPort);
   soc_addr.sin_addr.s_addr = htonl(INADDR_ANY);
 
   if(bind(serverSock,(struct sockaddr*)&soc_addr,sizeof(soc_addr))) {
@@ -760,6 +1225,62 @@ void Kangaroo::RunServer() {
 
 }
 
+// Metrics endpoint (Prometheus text), local port only
+void Kangaroo::MetricsServer() {
+
+  InitSocket();
+
+  SOCKET sock = socket(AF_INET,SOCK_STREAM,0);
+  if(sock < 0) {
+    ::printf("Warning: Metrics, invalid socket : %s\n",GetNetworkError().c_str());
+    return;
+  }
+
+  int32_t yes = 1;
+  setsockopt(sock,SOL_SOCKET,SO_REUSEADDR,(char *)&yes,sizeof(yes));
+
+  struct sockaddr_in soc_addr;
+  memset(&soc_addr,0,sizeof(soc_addr));
+  soc_addr.sin_family = AF_INET;
+  soc_addr.sin_port = htons(metricsPort);
+  soc_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if(bind(sock,(struct sockaddr*)&soc_addr,sizeof(soc_addr)) || listen(sock,8) < 0) {
+    ::printf("Warning: Metrics, can not listen to port %d: %s\n",metricsPort,GetNetworkError().c_str());
+    close_socket(sock);
+    return;
+  }
+
+  ::printf("Metrics: http://127.0.0.1:%d/metrics\n",metricsPort);
+
+  while(true) {
+
+    struct sockaddr_in client_add;
+    socklen_t len = sizeof(sockaddr_in);
+    SOCKET clientSock = accept(sock,(struct sockaddr*)&client_add,&len);
+    if(clientSock < 0)
+      continue;
+
+    // Request content is ignored, any path returns the last snapshot
+    char req[1024];
+    if(WaitFor(clientSock,ntimeout,WAIT_FOR_READ) > 0)
+      recv(clientSock,req,sizeof(req),0);
+
+    LOCK(metricsMutex);
+    string body = metricsText;
+    UNLOCK(metricsMutex);
+
+    char head[256];
+    ::sprintf(head,"HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %d\r\n"
+                   "Connection: close\r\n\r\n",(int)body.length());
+    string resp = string(head) + body;
+    Write(clientSock,(char *)resp.c_str(),(int)resp.length(),ntimeout);
+    close_socket(clientSock);
+
+  }
+
+}
+
 // ------------------------------------------------------------------------------------------------------
 // Client part
 // ------------------------------------------------------------------------------------------------------
@@ -872,9 +1393,7 @@ bool Kangaroo::ConnectToServer(SOCKET *retSock) {
   }
 
   int flag = 1;
-  struct protoent *p;
-  p = getprotobyname("tcp");
-  if(setsockopt(sock,p->p_proto,TCP_NODELAY,(char *)&flag,sizeof(flag)) == -1) {
+  if(setsockopt(sock,IPPROTO_TCP,TCP_NODELAY,(char *)&flag,sizeof(flag)) == -1) {
     lastError = "Socket error: setsockopt error TCP_NODELAY";
     close_socket(sock);
     return false;
@@ -975,12 +1494,33 @@ void Kangaroo::WaitForServer() {
 
     }
 
+    // Distinguished bits raised by the server (-maxram)
+    if(ok && !endOfSearch && serverVersion >= 8) {
+
+      char cmd = SERVER_GETDP;
+      int32_t dp = 0;
+      nbWrite = Write(serverConn,&cmd,1,ntimeout);
+      nbRead = (nbWrite > 0) ? Read(serverConn,(char *)(&dp),sizeof(int32_t),ntimeout) : nbWrite;
+      if(nbRead <= 0) {
+        if(nbRead < 0)
+          ::printf("\nRecvFromServer(DP): %s\n",lastError.c_str());
+        serverStatus = "Fault";
+        close_socket(serverConn);
+        isConnected = false;
+        ok = false;
+      } else if(dp > (int32_t)dpSize && dp <= 64) {
+        ::printf("\nServer raised DP size to %d\n",dp);
+        SetDP(dp);
+      }
+
+    }
+
   }
 
 }
 
 // Get Kangaroo from server
-bool Kangaroo::GetKangaroosFromServer(std::string& fileName,std::vector<int128_t>& kangs) {
+bool Kangaroo::GetKangaroosFromServerV3(std::string& fileName,std::vector<int128_t>& kangs) {
 
   int nbRead;
   int nbWrite;
@@ -1064,7 +1604,7 @@ bool Kangaroo::GetKangaroosFromServer(std::string& fileName,std::vector<int128_t
 }
 
 // Send Kangaroo to Server
-bool Kangaroo::SendKangaroosToServer(std::string& fileName,std::vector<int128_t>& kangs) {
+bool Kangaroo::SendKangaroosToServerV3(std::string& fileName,std::vector<int128_t>& kangs) {
 
   int nbWrite;
   uint32_t fileNameSize = (uint32_t)fileName.length();
@@ -1134,40 +1674,348 @@ bool Kangaroo::SendKangaroosToServer(std::string& fileName,std::vector<int128_t>
 
 }
 
-// Send DP to Server
-bool Kangaroo::SendToServer(std::vector<ITEM> &dps,uint32_t threadId,uint32_t gpuId) {
+// Streamed kangaroo upload, resume from the position given by the server
+bool Kangaroo::SendKangaroosStream(SOCKET sock,std::string& fileName,std::vector<int128_t>& kangs,Int *checkSum,int32_t *status) {
 
   int nbRead;
   int nbWrite;
-  uint32_t nbDP = (uint32_t)dps.size();
-  if(dps.size()==0)
+  uint32_t fileNameSize = (uint32_t)fileName.length();
+  uint64_t nbKangaroo = kangs.size();
+  uint64_t start;
+  uint32_t nbK;
+  char cmd = SERVER_SAVEKANGS;
+
+  SetSocketBuffer(sock,BULK_SOCKET_BUFFER);
+
+  SPUT("CMD",sock,&cmd,1,ntimeout);
+  SPUT("fileNameLenght",sock,&fileNameSize,sizeof(uint32_t),ntimeout);
+  SPUT("fileName",sock,fileName.c_str(),fileNameSize,ntimeout);
+  SPUT("nbKangaroo",sock,&nbKangaroo,sizeof(uint64_t),ntimeout);
+  SPUT("checksum",sock,checkSum->bits64,32,ntimeout);
+  SGET("start",sock,&start,sizeof(uint64_t),ntimeout);
+
+  if(start > nbKangaroo) {
+    ::printf("\nSaveKang: invalid start position from server\n");
+    close_socket(sock);
     return false;
+  }
 
-  WaitForServer();
+  if(start > 0)
+    ::printf("[Resume %.1fMB]",(double)(start * 16) / (1024.0*1024.0));
 
-  if(!endOfSearch) {
+  uint64_t point = (nbKangaroo / KANG_PER_STREAM_BLOCK) / 16;
+  uint64_t pointPrint = 0;
 
-    int32_t status;
+  while(start < nbKangaroo) {
+
+    pointPrint++;
+    if(pointPrint > point) {
+      ::printf(".");
+      pointPrint = 0;
+    }
+
+    nbK = (nbKangaroo - start > KANG_PER_STREAM_BLOCK) ? KANG_PER_STREAM_BLOCK : (uint32_t)(nbKangaroo - start);
+    SPUT("packet",sock,&kangs[start],nbK * 16,ntimeout);
+    start += nbK;
+
+  }
+
+  SGET("status",sock,status,sizeof(int32_t),ntimeout);
+
+  return true;
+
+}
+
+// Send Kangaroo to Server
+bool Kangaroo::SendKangaroosToServer(std::string& fileName,std::vector<int128_t>& kangs) {
+
+  Int checkSum;
+  int32_t status;
+  SOCKET sock;
+
+  checkSum.SetInt32(0);
+  AddCheckSum(&checkSum,kangs.data(),kangs.size());
+
+  for(int attempt = 0; attempt < BULK_RETRY; attempt++) {
+
+    // Kangaroo backups are handled by the first shard
+    LOCK(ghMutex);
+    int current = curShard;
+    SelectShard(0);
+    WaitForServer();
+    if(endOfSearch) {
+      SelectShard(current);
+      UNLOCK(ghMutex);
+      return true;
+    }
+
+    if(serverVersion < 5) {
+      // Old server, transfer on the connection shared with DP senders
+      bool ok = SendKangaroosToServerV3(fileName,kangs);
+      SelectShard(current);
+      UNLOCK(ghMutex);
+      return ok;
+    }
+
+    // Dedicated connection, DP senders and walkers keep running during the transfer
+    bool connected = ConnectToServer(&sock);
+    SelectShard(current);
+    UNLOCK(ghMutex);
+    if(!connected) {
+      ::printf("\nSaveKang: %s\n",lastError.c_str());
+      continue;
+    }
+
+    if(SendKangaroosStream(sock,fileName,kangs,&checkSum,&status)) {
+      close_socket(sock);
+      if(status == SERVER_OK)
+        return true;
+      ::printf("\nWarning, Kangaroo backup rejected by server %s\n",fileName.c_str());
+    }
+
+  }
+
+  ::printf("\nFailed to send %s to server\n",fileName.c_str());
+  return false;
+
+}
+
+// Streamed kangaroo download, resume from the number of kangaroos already received
+bool Kangaroo::GetKangaroosStream(std::string& fileName,std::vector<int128_t>& kangs,Int *checkSum) {
+
+  int nbRead;
+  int nbWrite;
+  uint32_t fileNameSize = (uint32_t)fileName.length();
+  uint64_t nbKangaroo = 0;
+  uint64_t start;
+  uint32_t nbK;
+  Int K;
+  char cmd = SERVER_LOADKANGS;
+
+  SetSocketBuffer(serverConn,BULK_SOCKET_BUFFER);
+
+  PUT("CMD",serverConn,&cmd,1,ntimeout);
+  PUT("fileNameLenght",serverConn,&fileNameSize,sizeof(uint32_t),ntimeout);
+  PUT("fileName",serverConn,fileName.c_str(),fileNameSize,ntimeout);
+  GET("nbKangaroo",serverConn,&nbKangaroo,sizeof(uint64_t),ntimeout);
+  if(nbKangaroo == 0) {
+    kangs.clear();
+    checkSum->SetInt32(0);
+    return true;
+  }
+
+  K.SetInt32(0);
+  GET("checkSum",serverConn,K.bits64,32,ntimeout);
+
+  // Restart from scratch if the file has changed since the previous attempt
+  start = kangs.size();
+  if(!K.IsEqual(checkSum) || start > nbKangaroo) {
+    kangs.clear();
+    start = 0;
+  }
+  checkSum->Set(&K);
+  kangs.reserve(nbKangaroo);
+
+  PUT("start",serverConn,&start,sizeof(uint64_t),ntimeout);
+
+  uint64_t point = (nbKangaroo / KANG_PER_STREAM_BLOCK) / 32;
+  uint64_t pointPrint = 0;
+  int128_t* KBuff = (int128_t*)malloc(KANG_PER_STREAM_BLOCK * sizeof(int128_t));
+
+  while(start < nbKangaroo) {
+
+    pointPrint++;
+    if(pointPrint > point) {
+      ::printf(".");
+      pointPrint = 0;
+    }
+
+    nbK = (nbKangaroo - start > KANG_PER_STREAM_BLOCK) ? KANG_PER_STREAM_BLOCK : (uint32_t)(nbKangaroo - start);
+    GETFREE("packet",serverConn,KBuff,nbK * 16,ntimeout,KBuff);
+    kangs.insert(kangs.end(),KBuff,KBuff + nbK);
+    start += nbK;
+
+  }
+
+  free(KBuff);
+  return true;
+
+}
+
+// Get Kangaroo from Server
+bool Kangaroo::GetKangaroosFromServer(std::string& fileName,std::vector<int128_t>& kangs) {
+
+  Int checkSum;
+  Int K;
+
+  checkSum.SetInt32(0);
+  kangs.clear();
+  SelectShard(0);
+
+  for(int attempt = 0; attempt < BULK_RETRY; attempt++) {
+
+    WaitForServer();
+    if(endOfSearch)
+      return true;
+
+    if(serverVersion < 5)
+      return GetKangaroosFromServerV3(fileName,kangs);
+
+    if(GetKangaroosStream(fileName,kangs,&checkSum)) {
 
-    // Send DP
-    DP *dp = (DP *)malloc(sizeof(DP)*nbDP);
-    for(uint32_t i = 0; i<nbDP; i++) {
+      K.SetInt32(0);
+      AddCheckSum(&K,kangs.data(),kangs.size());
+      if(K.IsEqual(&checkSum))
+        return true;
+
+      ::printf("\nWarning, Kangaroo backup wrong checksum %s\n",fileName.c_str());
+      kangs.clear();
+
+    }
+
+  }
+
+  ::printf("\nFailed to get %s from server\n",fileName.c_str());
+  return false;
+
+}
+
+// Shard owning the hash bucket h
+uint32_t Kangaroo::GetShard(uint64_t h,uint32_t nbShard) {
+  return (uint32_t)((h * nbShard) >> HASH_SIZE_BIT);
+}
+
+// Load connection of shard s in serverConn (caller must own ghMutex)
+void Kangaroo::SelectShard(int s) {
+
+  if(s == curShard)
+    return;
+
+  SHARD_CONN& c = shards[curShard];
+  c.sock = serverConn;
+  c.isConnected = isConnected;
+  c.ip = serverIp;
+  c.port = port;
+  c.hostInfo = hostInfo;
+  c.hostInfoLength = hostInfoLength;
+  c.hostAddrType = hostAddrType;
+  c.status = serverStatus;
+  c.version = serverVersion;
+
+  SHARD_CONN& n = shards[s];
+  serverConn = n.sock;
+  isConnected = n.isConnected;
+  serverIp = n.ip;
+  port = n.port;
+  hostInfo = n.hostInfo;
+  hostInfoLength = n.hostInfoLength;
+  hostAddrType = n.hostAddrType;
+  serverStatus = n.status;
+  serverVersion = n.version;
+
+  curShard = s;
+
+}
 
-      int128_t X;
-      int128_t D;
-      uint64_t h;
-      HashTable::Convert(&dps[i].x,&dps[i].d,dps[i].kIdx % 2,&h,&X,&D);
+// Notify other shards that the key has been solved
+void Kangaroo::StopShards(int except) {
 
-      dp[i].kIdx = (uint32_t)dps[i].kIdx;
-      dp[i].h = (uint32_t)h;
-      dp[i].x.i64[0] = X.i64[0];
-      dp[i].x.i64[1] = X.i64[1];
-      dp[i].d.i64[0] = D.i64[0];
-      dp[i].d.i64[1] = D.i64[1];
+  char cmd = SERVER_STOP;
+  int current = curShard;
 
+  for(int s = 0; s < (int)shards.size(); s++) {
+    if(s == except) continue;
+    SelectShard(s);
+    if(isConnected && serverVersion >= 6) {
+      if(Write(serverConn,&cmd,1,ntimeout) < 0)
+        ::printf("\nSendToServer(Stop): %s\n",lastError.c_str());
     }
+  }
+
+  SelectShard(current);
+
+}
+
+// Send DP to Server(s)
+bool Kangaroo::SendToServer(std::vector<ITEM> &dps,uint32_t threadId,uint32_t gpuId,uint32_t batchId,std::vector<DEAD_KANGAROO> &dead) {
+
+  dead.clear();
+  if(dps.size() == 0)
+    return false;
+
+  // Compress DP
+  vector<DP> dp(dps.size());
+  for(size_t i = 0; i < dps.size(); i++) {
+
+    int128_t X;
+    int128_t D;
+    uint64_t h;
+    HashTable::Convert(&dps[i].x,&dps[i].d,KangarooType(dps[i].kIdx),&h,&X,&D);
+
+    dp[i].kIdx = (uint32_t)dps[i].kIdx;
+    dp[i].h = (uint32_t)h;
+    dp[i].x.i64[0] = X.i64[0];
+    dp[i].x.i64[1] = X.i64[1];
+    dp[i].d.i64[0] = D.i64[0];
+    dp[i].d.i64[1] = D.i64[1];
+
+  }
+
+  bool ret = SendDPToServer(dp,threadId,gpuId,batchId,dead);
+  dps.clear();
+  return ret;
+
+}
+
+// Send compressed DP to Server(s)
+bool Kangaroo::SendDPToServer(std::vector<DP> &dps,uint32_t threadId,uint32_t gpuId,uint32_t batchId,std::vector<DEAD_KANGAROO> &dead) {
+
+  dead.clear();
+  if(dps.size() == 0)
+    return false;
+
+  if(shards.size() <= 1)
+    return SendToShard(dps.data(),(uint32_t)dps.size(),threadId,gpuId,batchId,dead);
+
+  // Route DP to the shard owning their hash bucket
+  uint32_t n = (uint32_t)shards.size();
+  vector< vector<DP> > sdps(n);
+  for(size_t i = 0; i < dps.size(); i++)
+    sdps[GetShard(dps[i].h,n)].push_back(dps[i]);
+
+  vector<DEAD_KANGAROO> sdead;
+  for(uint32_t s = 0; s < n && !endOfSearch; s++) {
+
+    if(sdps[s].size() == 0)
+      continue;
 
-    char cmd = SERVER_SENDDP;
+    SelectShard(s);
+    SendToShard(sdps[s].data(),(uint32_t)sdps[s].size(),threadId,gpuId,batchId,sdead);
+    dead.insert(dead.end(),sdead.begin(),sdead.end());
+
+    // Key solved on this shard
+    if(endOfSearch && serverStatus == "END")
+      StopShards(s);
+
+  }
+
+  return true;
+
+}
+
+// Send DP to the current shard
+bool Kangaroo::SendToShard(DP *dp,uint32_t nbDP,uint32_t threadId,uint32_t gpuId,uint32_t batchId,std::vector<DEAD_KANGAROO> &dead) {
+
+  int nbRead;
+  int nbWrite;
+  dead.clear();
+
+  WaitForServer();
+
+  if(!endOfSearch) {
+
+    int32_t status;
+    char cmd = (serverVersion >= 4) ? SERVER_SENDDPR : SERVER_SENDDP;
 
     DPHEADER head;
     head.header = SERVER_HEADER;
@@ -1176,13 +2024,31 @@ bool Kangaroo::SendToServer(std::vector<ITEM> &dps,uint32_t threadId,uint32_t gp
     head.threadId = threadId;
     head.gpuId = gpuId;
 
-    PUTFREE("CMD",serverConn,&cmd,1,ntimeout,dp);
-    PUTFREE("DPHeader",serverConn,&head,sizeof(DPHEADER),ntimeout,dp);
-    PUTFREE("DP",serverConn,dp,sizeof(DP)*nbDP,ntimeout,dp);
-    GETFREE("Status",serverConn,&status,sizeof(uint32_t),ntimeout,dp)
+    PUT("CMD",serverConn,&cmd,1,ntimeout);
+    PUT("DPHeader",serverConn,&head,sizeof(DPHEADER),ntimeout);
+    if(cmd == SERVER_SENDDPR) {
+      PUT("BatchId",serverConn,&batchId,sizeof(uint32_t),ntimeout);
+    }
+    PUT("DP",serverConn,dp,sizeof(DP)*nbDP,ntimeout);
+    GET("Status",serverConn,&status,sizeof(uint32_t),ntimeout)
+
+    if(cmd == SERVER_SENDDPR) {
+
+      // Kangaroos of this thread found dead by the server
+      uint32_t nbDead;
+      GET("nbDead",serverConn,&nbDead,sizeof(uint32_t),ntimeout);
+      if(nbDead > MAX_DEAD_PER_REPLY) {
+        ::printf("\nUnexpected number of dead kangaroo [%d] from server\n",nbDead);
+        isConnected = false;
+        close_socket(serverConn);
+        return false;
+      }
+      if(nbDead > 0) {
+        dead.resize(nbDead);
+        GET("Dead",serverConn,dead.data(),nbDead * sizeof(DEAD_KANGAROO),ntimeout);
+      }
 
-    dps.clear();
-    free(dp);
+    }
 
   }
 
@@ -1190,12 +2056,71 @@ bool Kangaroo::SendToServer(std::vector<ITEM> &dps,uint32_t threadId,uint32_t gp
 
 }
 
-void Kangaroo::AddConnectedClient() {
+// Send DP on a flood test connection (-floodtest), the dead kangaroos are ignored
+bool Kangaroo::SendFlood(SOCKET sock,DP *dp,uint32_t nbDP,uint32_t threadId,uint32_t batchId) {
+
+  int nbRead;
+  int nbWrite;
+  int32_t status;
+
+  char cmd = (serverVersion >= 4) ? SERVER_SENDDPR : SERVER_SENDDP;
+
+  DPHEADER head;
+  head.header = SERVER_HEADER;
+  head.nbDP = nbDP;
+  head.processId = pid;
+  head.threadId = threadId;
+  head.gpuId = 0;
+
+  SPUT("CMD",sock,&cmd,1,ntimeout);
+  SPUT("DPHeader",sock,&head,sizeof(DPHEADER),ntimeout);
+  if(cmd == SERVER_SENDDPR) {
+    SPUT("BatchId",sock,&batchId,sizeof(uint32_t),ntimeout);
+  }
+  SPUT("DP",sock,dp,sizeof(DP)*nbDP,ntimeout);
+  SGET("Status",sock,&status,sizeof(uint32_t),ntimeout);
+  if(status == SERVER_END)
+    endOfSearch = true;
+  else if(status == SERVER_BACKUP)
+    floodBackup++;
+
+  if(cmd == SERVER_SENDDPR) {
+    uint32_t nbDead;
+    SGET("nbDead",sock,&nbDead,sizeof(uint32_t),ntimeout);
+    if(nbDead > MAX_DEAD_PER_REPLY) {
+      ::printf("\nUnexpected number of dead kangaroo [%d] from server\n",nbDead);
+      close_socket(sock);
+      return false;
+    }
+    if(nbDead > 0) {
+      vector<DEAD_KANGAROO> dead(nbDead);
+      SGET("Dead",sock,dead.data(),nbDead * sizeof(DEAD_KANGAROO),ntimeout);
+    }
+  }
+
+  return true;
+
+}
+
+void Kangaroo::AddConnectedClient(TH_PARAM *p) {
+  LOCK(ghMutex);
   connectedClient++;
+  p->clientId = ++lastClientId;
+  deadKangaroos[p->clientId].clear();
+  CLIENT_METRIC &c = clientMetrics[p->clientId];
+  c.info = p->clientInfo;
+  c.nbDP = 0;
+  c.lastDP = 0;
+  c.dpRate = 0.0;
+  UNLOCK(ghMutex);
 }
 
-void Kangaroo::RemoveConnectedClient() {
+void Kangaroo::RemoveConnectedClient(TH_PARAM *p) {
+  LOCK(ghMutex);
   connectedClient--;
+  deadKangaroos.erase(p->clientId);
+  clientMetrics.erase(p->clientId);
+  UNLOCK(ghMutex);
 }
 
 void Kangaroo::RemoveConnectedKangaroo(uint64_t nb) {
@@ -1205,9 +2130,34 @@ void Kangaroo::RemoveConnectedKangaroo(uint64_t nb) {
 // Get configuration from server
 bool Kangaroo::GetConfigFromServer() {
 
+  for(int s = 0; s < (int)shards.size(); s++) {
+    SelectShard(s);
+    if(!GetConfigFromShard(s))
+      return false;
+  }
+  SelectShard(0);
+
+  if(shards.size() > 1)
+    ::printf("DP table sharded on %d servers\n",(int)shards.size());
+
+  return true;
+
+}
+
+bool Kangaroo::GetConfigFromShard(int s) {
+
   int nbRead;
   int nbWrite;
 
+  // Shard config must match the first one
+  Int rStart(&rangeStart);
+  Int rEnd(&rangeEnd);
+  Point key0;
+  int32_t dp0 = initDPSize;
+  uint32_t jump0 = GetJumpConfig();
+  uint32_t herd0 = GetHerdConfig();
+  if(s > 0) key0 = keysToSearch[0];
+
   if(!ConnectToServer(&serverConn)) {
     ::printf("Cannot connect to server: %s\n%s\n",serverIp.c_str(),lastError.c_str());
     return false;
@@ -1234,6 +2184,7 @@ bool Kangaroo::GetConfigFromServer() {
   GET("KeyY",serverConn,key.y.bits64,32,ntimeout);
   GET("DP",serverConn,&initDPSize,sizeof(int32_t),ntimeout);
 
+  serverVersion = version;
   if(version<3) {
     isConnected = false;
     close_socket(serverConn);
@@ -1241,6 +2192,59 @@ bool Kangaroo::GetConfigFromServer() {
     return false;
   }
 
+  // Jump table, older servers use the default one
+  uint32_t jumpConfig = 0;
+  if(version >= 7) {
+    cmd = SERVER_GETJUMP;
+    PUT("CMD",serverConn,&cmd,1,ntimeout);
+    GET("JumpConfig",serverConn,&jumpConfig,sizeof(uint32_t),ntimeout);
+  }
+
+  // Herd layout, older servers use the default one
+  uint32_t herdConfig = HERD_DEFAULT;
+  if(version >= 9) {
+    cmd = SERVER_GETHERD;
+    PUT("CMD",serverConn,&cmd,1,ntimeout);
+    GET("HerdConfig",serverConn,&herdConfig,sizeof(uint32_t),ntimeout);
+  }
+
+  if(s > 0 && (!rStart.IsEqual(&rangeStart) || !rEnd.IsEqual(&rangeEnd) || !key0.equals(key) || dp0 != initDPSize ||
+               jump0 != jumpConfig || herd0 != herdConfig)) {
+    isConnected = false;
+    close_socket(serverConn);
+    ::printf("Cannot connect to server: %s\nShard configuration differs from %s\n",serverIp.c_str(),shards[0].ip.c_str());
+    return false;
+  }
+
+  if(shards.size() > 1) {
+
+    uint32_t sIdx;
+    uint32_t sNb;
+    if(version < 6) {
+      isConnected = false;
+      close_socket(serverConn);
+      ::printf("Cannot connect to server: %s\nServer version must be >= 6 for sharding\n",serverIp.c_str());
+      return false;
+    }
+    cmd = SERVER_GETSHARD;
+    PUT("CMD",serverConn,&cmd,1,ntimeout);
+    GET("shardIdx",serverConn,&sIdx,sizeof(uint32_t),ntimeout);
+    GET("nbShard",serverConn,&sNb,sizeof(uint32_t),ntimeout);
+    if(sIdx != (uint32_t)s || sNb != (uint32_t)shards.size()) {
+      isConnected = false;
+      close_socket(serverConn);
+      ::printf("Cannot connect to server: %s\nServer is shard %d/%d, expected %d/%d\n",serverIp.c_str(),sIdx,sNb,s,(int)shards.size());
+      return false;
+    }
+
+  }
+
+  if(!SetJumpConfig(jumpConfig,"server " + serverIp) || !SetHerdConfig(herdConfig,"server " + serverIp)) {
+    isConnected = false;
+    close_socket(serverConn);
+    return false;
+  }
+
   // Set kangaroo number
   cmd = SERVER_SETKNB;
   PUT("CMD",serverConn,&cmd,1,ntimeout);
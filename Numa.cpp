@@ -0,0 +1,191 @@
+/*
+* This file is part of the BSGS distribution (https://github.com/JeanLucPons/Kangaroo).
+* Copyright (c) 2020 Jean Luc PONS.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Kangaroo.h"
+#include <string.h>
+#ifndef WIN64
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+#define MAX_NODE 1024
+
+// ----------------------------------------------------------------------------
+
+#ifndef WIN64
+
+// Parse a sysfs cpu list ("0-3,8-11")
+static void ParseCpuList(const char *s,vector<int> &cpus) {
+
+  while(*s) {
+    char *end;
+    int a = (int)strtol(s,&end,10);
+    if(end == s) break;
+    int b = a;
+    s = end;
+    if(*s == '-') {
+      b = (int)strtol(s + 1,&end,10);
+      s = end;
+    }
+    for(int c = a; c <= b; c++)
+      cpus.push_back(c);
+    while(*s == ',' || *s == '\n' || *s == ' ') s++;
+  }
+
+}
+
+#endif
+
+// Allowed CPUs of each NUMA node (-numa)
+void Kangaroo::InitNuma() {
+
+  numaCpus.clear();
+
+#ifndef WIN64
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if(sched_getaffinity(0,sizeof(set),&set) != 0) {
+    ::printf("NUMA: sched_getaffinity failed, threads not pinned\n");
+    return;
+  }
+
+  for(int n = 0; n < MAX_NODE; n++) {
+    char name[128];
+    char line[4096];
+    ::sprintf(name,"/sys/devices/system/node/node%d/cpulist",n);
+    FILE *f = fopen(name,"r");
+    if(f == NULL) continue;
+    vector<int> list;
+    vector<int> cpus;
+    if(fgets(line,sizeof(line),f))
+      ParseCpuList(line,list);
+    fclose(f);
+    for(int i = 0; i < (int)list.size(); i++)
+      if(list[i] < CPU_SETSIZE && CPU_ISSET(list[i],&set))
+        cpus.push_back(list[i]);
+    if(cpus.size() > 0) {
+      ::printf("NUMA: node %d, %d CPU(s)\n",n,(int)cpus.size());
+      numaCpus.push_back(cpus);
+    }
+  }
+
+  if(numaCpus.size() < 2) {
+    ::printf("NUMA: single node, threads not pinned\n");
+    numaCpus.clear();
+  }
+
+#else
+
+  ::printf("NUMA: not supported on Windows, threads not pinned\n");
+
+#endif
+
+}
+
+// ----------------------------------------------------------------------------
+
+// Pin a CPU thread to the CPUs of its node (round robin over the nodes)
+void Kangaroo::PinNode(int thId) {
+
+#ifndef WIN64
+  if(numaCpus.size() == 0)
+    return;
+  vector<int> &cpus = numaCpus[thId % numaCpus.size()];
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for(int i = 0; i < (int)cpus.size(); i++)
+    CPU_SET(cpus[i],&set);
+  pthread_setaffinity_np(pthread_self(),sizeof(set),&set);
+#endif
+
+}
+
+// ----------------------------------------------------------------------------
+
+// Huge pages for a herd, before its first touch
+void Kangaroo::AdviseHerd(Int *px,Int *py,Int *d,uint64_t n) {
+
+  if(HashTable::GetHugePages() == HUGE_PAGE_OFF)
+    return;
+  HashTable::AdviseHugePages(px,n * sizeof(Int));
+  HashTable::AdviseHugePages(py,n * sizeof(Int));
+  HashTable::AdviseHugePages(d,n * sizeof(Int));
+
+}
+
+// Called by the walker thread once pinned: herds loaded from a work file were touched by the main
+// thread, copy them so that their pages are local to the walker; back them with huge pages if requested.
+void Kangaroo::LocalizeHerd(TH_PARAM *ph) {
+
+  if(ph->px == NULL)
+    return;
+
+  if(numaCpus.size() == 0 && HashTable::GetHugePages() == HUGE_PAGE_OFF)
+    return;
+
+  uint64_t n = ph->nbKangaroo;
+  Int *px = new Int[n];
+  Int *py = new Int[n];
+  Int *d = new Int[n];
+  AdviseHerd(px,py,d,n);
+  for(uint64_t i = 0; i < n; i++) {
+    px[i].Set(&ph->px[i]);
+    py[i].Set(&ph->py[i]);
+    d[i].Set(&ph->distance[i]);
+  }
+  delete[] ph->px;
+  delete[] ph->py;
+  delete[] ph->distance;
+  ph->px = px;
+  ph->py = py;
+  ph->distance = d;
+
+}
+
+// ----------------------------------------------------------------------------
+
+// Huge pages backing the process (Linux)
+void Kangaroo::PrintHugePages() {
+
+#ifndef WIN64
+
+  if(HashTable::GetHugePages() == HUGE_PAGE_OFF)
+    return;
+
+  FILE *f = fopen("/proc/self/smaps_rollup","r");
+  if(f == NULL)
+    return;
+
+  char line[256];
+  uint64_t anon = 0;
+  uint64_t tlb = 0;
+  uint64_t v;
+  while(fgets(line,sizeof(line),f)) {
+    if(sscanf(line,"AnonHugePages: %lu kB",&v) == 1) anon += v;
+    else if(sscanf(line,"Private_Hugetlb: %lu kB",&v) == 1) tlb += v;
+    else if(sscanf(line,"Shared_Hugetlb: %lu kB",&v) == 1) tlb += v;
+  }
+  fclose(f);
+
+  ::printf("Huge pages: [THP %.1fMB][Hugetlb %.1fMB]\n",(double)anon / 1024.0,(double)tlb / 1024.0);
+
+#endif
+
+}
@@ -0,0 +1,405 @@
+/*
+* This file is part of the BSGS distribution (https://github.com/JeanLucPons/Kangaroo).
+* Copyright (c) 2020 Jean Luc PONS.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Kangaroo.h"
+#include "Timer.h"
+#include <string.h>
+#define _USE_MATH_DEFINES
+#include <math.h>
+#ifndef WIN64
+#include <pthread.h>
+#endif
+
+using namespace std;
+
+#define safe_delete_array(x) if(x) {delete[] x;x=NULL;}
+
+// Simulated solve given up after SIM_MAX_OP*sqrt(N) operations
+#define SIM_MAX_OP 64.0
+// Kangaroo walking more than SIM_CYCLE*2^dpBit without DP is considered in a cycle
+#define SIM_CYCLE 32
+
+#ifdef USE_SYMMETRY
+#define JUMP_SYM 1
+#else
+#define JUMP_SYM 0
+#endif
+
+// ----------------------------------------------------------------------------
+
+#ifdef WIN64
+DWORD WINAPI _SimulateSolve(LPVOID lpParam) {
+#else
+void *_SimulateSolve(void *lpParam) {
+#endif
+  TH_PARAM *p = (TH_PARAM *)lpParam;
+  p->obj->SimulateSolve(p);
+  return 0;
+}
+
+// ----------------------------------------------------------------------------
+
+void Kangaroo::SimulateSolve(TH_PARAM *ph) {
+
+  // Independent solve of the current key with a private herd and DP table
+  HashTable *table = new HashTable();
+  IntGroup *grp = new IntGroup(CPU_GRP_SIZE);
+  Int *dx = new Int[CPU_GRP_SIZE];
+  Int *px = new Int[CPU_GRP_SIZE];
+  Int *py = new Int[CPU_GRP_SIZE];
+  Int *d = new Int[CPU_GRP_SIZE];
+  uint64_t *symClass = new uint64_t[CPU_GRP_SIZE]();
+  vector<uint64_t> lastDP(CPU_GRP_SIZE,0);
+
+  CreateHerd(CPU_GRP_SIZE,px,py,d,TAME);
+  ph->hasStarted = true;
+
+  double maxOp = SIM_MAX_OP * pow(2.0,(double)rangePower / 2.0);
+  uint64_t cycleLimit = (uint64_t)SIM_CYCLE << dpSize;
+  uint64_t step = 0;
+  uint64_t ops = 0;
+  uint64_t dead = 0;
+  uint64_t cycle = 0;
+  bool solved = false;
+
+  while(!solved && (double)ops < maxOp) {
+
+    JumpHerd(CPU_GRP_SIZE,px,py,d,symClass,grp,dx);
+    step++;
+
+    for(int g = 0; g < CPU_GRP_SIZE && !solved; g++) {
+
+      bool reset = false;
+
+      if(IsDP(px[g].bits64[3])) {
+
+        lastDP[g] = step;
+        int addStatus = table->Add(&px[g],&d[g],KangarooType(g));
+        if(addStatus == ADD_DUPLICATE) {
+          reset = true;
+          dead++;
+        } else if(addStatus == ADD_COLLISION) {
+          if(table->kType == KangarooType(g)) {
+            // Collision inside the same herd
+            reset = true;
+            dead++;
+          } else {
+            // Same resolution as CheckKey(), the private key is known
+            Int Td(table->kType == TAME ? &table->kDist : &d[g]);
+            Int Wd(table->kType == TAME ? &d[g] : &table->kDist);
+            for(int type = 0; type < 4 && !solved; type++) {
+              Int pk(&Td);
+              Int w(&Wd);
+              if(type & 0x1) pk.ModNegK1order();
+              if(type & 0x2) w.ModNegK1order();
+              pk.ModAddK1order(&w);
+              solved = pk.IsEqual(&simPriv);
+              pk.ModNegK1order();
+              solved |= pk.IsEqual(&simPriv);
+            }
+            reset = !solved;
+          }
+        }
+
+      } else if(step - lastDP[g] > cycleLimit) {
+        reset = true;
+        cycle++;
+      }
+
+      if(reset) {
+        CreateHerd(1,&px[g],&py[g],&d[g],g);
+        symClass[g] = 0;
+        lastDP[g] = step;
+      }
+
+    }
+
+    ops += CPU_GRP_SIZE;
+
+  }
+
+  LOCK(ghMutex);
+  if(solved)
+    simOps.push_back((double)ops);
+  else
+    simFail++;
+  simDead += dead;
+  simCycle += cycle;
+  UNLOCK(ghMutex);
+
+  delete table;
+  delete grp;
+  delete[] dx;
+  delete[] px;
+  delete[] py;
+  delete[] d;
+  delete[] symClass;
+
+  ph->isRunning = false;
+
+}
+
+// ----------------------------------------------------------------------------
+
+void Kangaroo::OptimizeJump(int nbThread,std::string &fileName,int rangeBits,int nbCandidate,int nbSolve) {
+
+  double t0 = Timer::get_tick();
+
+  if(nbThread <= 0 || nbCandidate <= 0 || nbSolve <= 0 || rangeBits < 16 || rangeBits > 128) {
+    ::printf("OptimizeJump: invalid arguments\n");
+    ::exit(-1);
+  }
+
+  nbCPUThread = nbThread;
+  nbGPUThread = 0;
+  jumpFileDist.clear();
+
+  // One herd per simulated solve, solves run in parallel on all threads
+  totalRW = CPU_GRP_SIZE;
+  rangeStart.SetInt32(0);
+  rangeEnd.SetInt32(1);
+  rangeEnd.ShiftL(rangeBits);
+  rangeEnd.SubOne();
+  InitRange();
+
+  if(initDPSize < 0) {
+    double dpOverHead;
+    double op;
+    double ram;
+    initDPSize = (int)((double)rangePower / 2.0 - log2((double)totalRW));
+    if(initDPSize < 0) initDPSize = 0;
+    ComputeExpected((double)initDPSize,&op,&ram,&dpOverHead);
+    while(dpOverHead > 1.05 && initDPSize > 0) {
+      initDPSize--;
+      ComputeExpected((double)initDPSize,&op,&ram,&dpOverHead);
+    }
+  }
+  SetDP(initDPSize);
+  ComputeExpected((double)dpSize,&expectedNbOp,&expectedMem);
+
+  double sqrtN = pow(2.0,(double)rangePower / 2.0);
+  ::printf("Simulation: %d candidates, %d solves per candidate, %d kangaroos per solve\n",nbCandidate,nbSolve,
+           CPU_GRP_SIZE);
+  ::printf("Expected operations: %.3f sqrt(N)\n",expectedNbOp / sqrtN);
+
+  TH_PARAM *params = (TH_PARAM *)malloc(nbCPUThread * sizeof(TH_PARAM));
+  THREAD_HANDLE *thHandles = (THREAD_HANDLE *)malloc(nbCPUThread * sizeof(THREAD_HANDLE));
+
+  vector<uint32_t> seeds(nbCandidate);
+  vector<double> scores(nbCandidate);
+  vector<double> errs(nbCandidate);
+
+  for(int c = 0; c < nbCandidate; c++) {
+
+    // Candidate 0 is the default jump table
+    jumpSeed = 0x600DCAFE + (uint32_t)c * 0x9E3779B9;
+    CreateJumpTable();
+
+    simOps.clear();
+    simFail = 0;
+    simDead = 0;
+    simCycle = 0;
+
+    while((int)simOps.size() + (int)simFail < nbSolve) {
+
+      // New random key, all threads solve it with their own herd
+      Int k;
+      k.Rand(rangePower);
+      keysToSearch.clear();
+      keysToSearch.push_back(secp->ComputePublicKey(&k));
+      keyIdx = 0;
+      InitSearchKey();
+      simPriv.Set(&k);
+#ifdef USE_SYMMETRY
+      simPriv.ModSubK1order(&rangeWidthDiv2);
+#endif
+
+      int nbTh = nbSolve - (int)simOps.size() - (int)simFail;
+      if(nbTh > nbCPUThread) nbTh = nbCPUThread;
+      memset(params,0,nbCPUThread * sizeof(TH_PARAM));
+      for(int i = 0; i < nbTh; i++) {
+        params[i].threadId = i;
+        params[i].isRunning = true;
+        thHandles[i] = LaunchThread(_SimulateSolve,params + i);
+      }
+      JoinThreads(thHandles,nbTh);
+      FreeHandles(thHandles,nbTh);
+
+    }
+
+    // Average and standard deviation of operations (in sqrt(N)), failed solves count as the operation limit
+    for(uint64_t i = 0; i < simFail; i++)
+      simOps.push_back(SIM_MAX_OP * sqrtN);
+    double avg = 0.0;
+    double var = 0.0;
+    int n = (int)simOps.size();
+    for(int i = 0; i < n; i++)
+      avg += simOps[i] / sqrtN;
+    avg /= (double)n;
+    for(int i = 0; i < n; i++)
+      var += (simOps[i] / sqrtN - avg) * (simOps[i] / sqrtN - avg);
+    if(n > 1) var /= (double)(n - 1);
+    double err = sqrt(var / (double)n);
+
+    // The walk of a dead kangaroo (about 2^dpSize operations) or of a cycling one (cycleLimit) is lost,
+    // count it again: this part depends on the jump set only and grows with the number of kangaroos.
+    double dead = (double)simDead / (double)nbSolve;
+    double cycle = (double)simCycle / (double)nbSolve;
+    double lost = (dead * pow(2.0,(double)dpSize) + cycle * (double)((uint64_t)SIM_CYCLE << dpSize)) / sqrtN;
+
+    seeds[c] = jumpSeed;
+    scores[c] = avg + lost;
+    errs[c] = err;
+
+    ::printf("Candidate %3d [0x%08X]: %.3f sqrt(N) [Ops %.3f][Std %.3f][Err %.3f][Dead %.1f][Cycle %.1f][Fail %d]\n",
+             c,jumpSeed,scores[c],avg,sqrt(var),err,dead,cycle,(int)simFail);
+
+  }
+
+  free(params);
+  free(thHandles);
+
+  // Best and runner-up
+  int best = 0;
+  for(int c = 1; c < nbCandidate; c++)
+    if(scores[c] < scores[best]) best = c;
+  int second = -1;
+  for(int c = 0; c < nbCandidate; c++)
+    if(c != best && (second < 0 || scores[c] < scores[second])) second = c;
+
+  // Keep the best jump set only when it beats the runner-up by more than the error, default table otherwise
+  if(best != 0 && second >= 0) {
+    double diff = scores[second] - scores[best];
+    double err = sqrt(errs[best] * errs[best] + errs[second] * errs[second]);
+    if(diff <= err) {
+      ::printf("Best: [0x%08X] %.3f sqrt(N) not significant (%.3f over the runner-up, error %.3f), "
+               "increase nbSolve\n",seeds[best],scores[best],diff,err);
+      best = 0;
+    }
+  }
+
+  jumpSeed = seeds[best];
+  CreateJumpTable();
+  ::printf("Best: [0x%08X] %.3f sqrt(N)%s\n",seeds[best],scores[best],(best == 0) ? " (default table)" : "");
+  if(!SaveJumpFile(fileName))
+    ::exit(-1);
+
+  double t1 = Timer::get_tick();
+  ::printf("Done: Total time %s \n",GetTimeStr(t1 - t0).c_str());
+
+}
+
+// ----------------------------------------------------------------------------
+
+bool Kangaroo::SaveJumpFile(std::string &fileName) {
+
+  FILE *f = fopen(fileName.c_str(),"wb");
+  if(f == NULL) {
+    ::printf("SaveJumpFile: Cannot open %s for writing\n",fileName.c_str());
+    ::printf("%s\n",::strerror(errno));
+    return false;
+  }
+
+  uint32_t head = HEADJ;
+  uint32_t version = 0;
+  uint32_t rPower = rangePower;
+  uint32_t sym = JUMP_SYM;
+  uint32_t nb = nbJump;
+
+  ::fwrite(&head,sizeof(uint32_t),1,f);
+  ::fwrite(&version,sizeof(uint32_t),1,f);
+  ::fwrite(&rPower,sizeof(uint32_t),1,f);
+  ::fwrite(&sym,sizeof(uint32_t),1,f);
+  ::fwrite(&nb,sizeof(uint32_t),1,f);
+  ::fwrite(&jumpSeed,sizeof(uint32_t),1,f);
+  for(int i = 0; i < nbJump; i++) {
+    if(::fwrite(jumpDistance[i].bits64,16,1,f) != 1) {
+      ::printf("SaveJumpFile: Cannot write to %s\n",fileName.c_str());
+      ::printf("%s\n",::strerror(errno));
+      ::fclose(f);
+      return false;
+    }
+  }
+
+  ::fclose(f);
+  ::printf("Jump file saved: %s [%d jumps, range width 2^%d]\n",fileName.c_str(),nbJump,rangePower);
+  return true;
+
+}
+
+// ----------------------------------------------------------------------------
+
+bool Kangaroo::LoadJumpFile(std::string &fileName) {
+
+  FILE *f = fopen(fileName.c_str(),"rb");
+  if(f == NULL) {
+    ::printf("LoadJumpFile: Cannot open %s for reading\n",fileName.c_str());
+    ::printf("%s\n",::strerror(errno));
+    return false;
+  }
+
+  uint32_t head = 0;
+  uint32_t version;
+  uint32_t rPower;
+  uint32_t sym;
+  uint32_t nb;
+  uint32_t seed;
+
+  ::fread(&head,sizeof(uint32_t),1,f);
+  if(head != HEADJ) {
+    ::printf("LoadJumpFile: %s is not a jump file\n",fileName.c_str());
+    ::fclose(f);
+    return false;
+  }
+  ::fread(&version,sizeof(uint32_t),1,f);
+  ::fread(&rPower,sizeof(uint32_t),1,f);
+  ::fread(&sym,sizeof(uint32_t),1,f);
+  ::fread(&nb,sizeof(uint32_t),1,f);
+  ::fread(&seed,sizeof(uint32_t),1,f);
+
+  if(sym != JUMP_SYM) {
+    ::printf("LoadJumpFile: %s symmetry mismatch, compiled %s USE_SYMMETRY\n",fileName.c_str(),
+             JUMP_SYM ? "with" : "without");
+    ::fclose(f);
+    return false;
+  }
+  if(nb < 2 || nb > MAX_JUMP || (nb & (nb - 1)) != 0) {
+    ::printf("LoadJumpFile: %s invalid number of jumps %d\n",fileName.c_str(),nb);
+    ::fclose(f);
+    return false;
+  }
+
+  jumpFileDist.resize(nb);
+  for(uint32_t i = 0; i < nb; i++) {
+    jumpFileDist[i].SetInt32(0);
+    if(::fread(jumpFileDist[i].bits64,16,1,f) != 1) {
+      ::printf("LoadJumpFile: %s unexpected end of file\n",fileName.c_str());
+      ::fclose(f);
+      jumpFileDist.clear();
+      return false;
+    }
+  }
+  ::fclose(f);
+
+  nbJump = (int)nb;
+  jumpMask = nb - 1;
+  jumpSeed = seed;
+  jumpFileRange = (int)rPower;
+
+  return true;
+
+}
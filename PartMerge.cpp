@@ -225,12 +225,14 @@ bool Kangaroo::MergeWorkPartPart(std::string& part1Name,std::string& part2Name)
   double time1;
   Int RS1;
   Int RE1;
+  uint32_t herd1 = HERD_DEFAULT;
 
   if(!partIsEmpty) {
 
     FILE* f1 = ReadHeader(file1,&v1,HEADW);
     if(f1 == NULL)
       return false;
+    herd1 = fileHerdConfig;
 
     // Read global param
     ::fread(&dp1,sizeof(uint32_t),1,f1);
@@ -257,6 +259,7 @@ bool Kangaroo::MergeWorkPartPart(std::string& part1Name,std::string& part2Name)
   if(f2 == NULL) {
     return true;
   }
+  uint32_t herd2 = fileHerdConfig;
 
   uint32_t dp2;
   Point k2;
@@ -289,6 +292,12 @@ bool Kangaroo::MergeWorkPartPart(std::string& part1Name,std::string& part2Name)
       return true;
     }
 
+    if(herd1 != herd2) {
+      ::printf("MergeWorkPartPart: cannot merge workfile of different herd configuration\n");
+      ::fclose(f2);
+      return true;
+    }
+
     if(!RS1.IsEqual(&RS2) || !RE1.IsEqual(&RE2)) {
 
       ::printf("MergeWorkPartPart: File range differs\n");
@@ -311,6 +320,8 @@ bool Kangaroo::MergeWorkPartPart(std::string& part1Name,std::string& part2Name)
 
   } else {
 
+    v1 = v2;
+    herd1 = herd2;
     dp1 = dp2;
     k1 = k2;
     count1 = 0;
@@ -344,6 +355,10 @@ bool Kangaroo::MergeWorkPartPart(std::string& part1Name,std::string& part2Name)
     return true;
   }
   dpSize = (dp1 < dp2) ? dp1 : dp2;
+
+  // Keep the jump table of the source files
+  SetJumpConfig(v1,file1);
+  SetHerdConfig(herd1,file1);
   if(!SaveHeader(file1,f,HEADW,count1 + count2,time1 + time2)) {
     fclose(f2);
     return true;
@@ -478,6 +493,10 @@ bool Kangaroo::FillEmptyPartFromFile(std::string& partName,std::string& fileName
     ::printf("%s\n",::strerror(errno));
     return true;
   }
+
+  // Keep the jump table of the source file
+  SetJumpConfig(v1,fileName);
+  SetHerdConfig(fileHerdConfig,fileName);
   if(!SaveHeader(file1,f,HEADW,count1,time1)) {
     return true;
   }
@@ -555,6 +574,7 @@ bool Kangaroo::MergeWorkPart(std::string& partName,std::string& file2,bool print
   FILE* f1 = ReadHeader(file1,&v1,HEADW);
   if(f1 == NULL)
     return true;
+  uint32_t herd1 = fileHerdConfig;
 
   // Read global param
   ::fread(&dp1,sizeof(uint32_t),1,f1);
@@ -579,6 +599,7 @@ bool Kangaroo::MergeWorkPart(std::string& partName,std::string& file2,bool print
   if(f2 == NULL) {
     return true;
   }
+  uint32_t herd2 = fileHerdConfig;
 
   uint32_t dp2;
   Point k2;
@@ -609,6 +630,12 @@ bool Kangaroo::MergeWorkPart(std::string& partName,std::string& file2,bool print
     return true;
   }
 
+  if(herd1 != herd2) {
+    ::printf("MergeWorkPart: cannot merge workfile of different herd configuration\n");
+    ::fclose(f2);
+    return true;
+  }
+
   if(!RS1.IsEqual(&RS2) || !RE1.IsEqual(&RE2)) {
 
     ::printf("MergeWorkPart: File range differs\n");
@@ -657,6 +684,10 @@ bool Kangaroo::MergeWorkPart(std::string& partName,std::string& file2,bool print
     return true;
   }
   dpSize = (dp1 < dp2) ? dp1 : dp2;
+
+  // Keep the jump table of the source files
+  SetJumpConfig(v1,file1);
+  SetHerdConfig(herd1,file1);
   if(!SaveHeader(file1,f,HEADW,count1 + count2,time1 + time2)) {
     fclose(f2);
     return true;
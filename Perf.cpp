@@ -0,0 +1,330 @@
+/*
+* This file is part of the BSGS distribution (https://github.com/JeanLucPons/Kangaroo).
+* Copyright (c) 2020 Jean Luc PONS.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Perf.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static const char *eventName[PERF_NB_EVENT] = { "cycles","instructions","branch-misses","L1D-misses","LLC-refs","LLC-misses" };
+static const char *phaseName[PERF_NB_PHASE] = { "dx","inv","add","dp","table","other" };
+
+// ----------------------------------------------------------------------------
+
+PerfCounters::PerfCounters() {
+
+  nbFd = 0;
+  Reset();
+
+}
+
+PerfCounters::~PerfCounters() {
+
+  Close();
+
+}
+
+void PerfCounters::Reset() {
+
+  memset(count,0,sizeof(count));
+  memset(time,0,sizeof(time));
+  memset(available,0,sizeof(available));
+  memset(last,0,sizeof(last));
+  lastTime = Timer::get_ns();
+  cur = PERF_OTHER;
+
+}
+
+const char *PerfCounters::GetEventName(int e) {
+
+  return eventName[e];
+
+}
+
+// ----------------------------------------------------------------------------
+
+#ifdef __linux__
+
+static void SetEvent(struct perf_event_attr *attr,int e) {
+
+  switch(e) {
+  case PERF_CYCLES:
+    attr->type = PERF_TYPE_HARDWARE;
+    attr->config = PERF_COUNT_HW_CPU_CYCLES;
+    break;
+  case PERF_INSTR:
+    attr->type = PERF_TYPE_HARDWARE;
+    attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+    break;
+  case PERF_BRANCH_MISS:
+    attr->type = PERF_TYPE_HARDWARE;
+    attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+    break;
+  case PERF_L1D_MISS:
+    attr->type = PERF_TYPE_HW_CACHE;
+    attr->config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    break;
+  case PERF_L2_MISS:
+    // Requests reaching the last level cache, i.e. L2 misses on most x86
+    attr->type = PERF_TYPE_HARDWARE;
+    attr->config = PERF_COUNT_HW_CACHE_REFERENCES;
+    break;
+  case PERF_LLC_MISS:
+    attr->type = PERF_TYPE_HARDWARE;
+    attr->config = PERF_COUNT_HW_CACHE_MISSES;
+    break;
+  }
+
+}
+
+static string GetOpenError(int err) {
+
+  char tmp[256];
+
+  switch(err) {
+  case EACCES:
+  case EPERM: {
+    int paranoid = -1;
+    FILE *f = fopen("/proc/sys/kernel/perf_event_paranoid","r");
+    if(f) {
+      if(fscanf(f,"%d",&paranoid) != 1) paranoid = -1;
+      fclose(f);
+    }
+    ::sprintf(tmp,"permission denied, kernel.perf_event_paranoid=%d",paranoid);
+    return string(tmp);
+  }
+  case ENOENT:
+  case EOPNOTSUPP:
+  case ENODEV:
+    return "no hardware performance counter (virtual machine or container)";
+  case ENOSYS:
+    return "perf_event_open not available (kernel or seccomp)";
+  default:
+    return string(strerror(err));
+  }
+
+}
+
+bool PerfCounters::Open() {
+
+  Close();
+  Reset();
+  error = "";
+
+  for(int e = 0; e < PERF_NB_EVENT; e++) {
+
+    struct perf_event_attr attr;
+    memset(&attr,0,sizeof(attr));
+    attr.size = sizeof(attr);
+    SetEvent(&attr,e);
+    attr.disabled = (nbFd == 0);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    // Calling thread, any cpu, one group (a single read per phase switch)
+    int f = (int)syscall(__NR_perf_event_open,&attr,0,-1,(nbFd == 0) ? -1 : fd[0],0);
+    if(f < 0) {
+      if(error.length() == 0) error = GetOpenError(errno);
+      continue;
+    }
+
+    fd[nbFd] = f;
+    event[nbFd] = e;
+    available[e] = true;
+    nbFd++;
+
+  }
+
+  if(nbFd == 0)
+    return false;
+
+  ioctl(fd[0],PERF_EVENT_IOC_RESET,PERF_IOC_FLAG_GROUP);
+  ioctl(fd[0],PERF_EVENT_IOC_ENABLE,PERF_IOC_FLAG_GROUP);
+  Read(last);
+  lastTime = Timer::get_ns();
+  return true;
+
+}
+
+void PerfCounters::Close() {
+
+  for(int i = 0; i < nbFd; i++)
+    close(fd[i]);
+  nbFd = 0;
+
+}
+
+bool PerfCounters::Read(uint64_t *v) {
+
+  // nr, time enabled, time running, values
+  uint64_t buff[3 + PERF_NB_EVENT];
+  if(read(fd[0],buff,sizeof(buff)) < (ssize_t)(3 * sizeof(uint64_t)))
+    return false;
+  for(int i = 0; i < nbFd && i < (int)buff[0]; i++)
+    v[i] = buff[3 + i];
+  return true;
+
+}
+
+#else
+
+bool PerfCounters::Open() {
+
+  Reset();
+  error = "hardware performance counters are only supported on Linux";
+  return false;
+
+}
+
+void PerfCounters::Close() {
+}
+
+bool PerfCounters::Read(uint64_t *v) {
+
+  return false;
+
+}
+
+#endif
+
+// ----------------------------------------------------------------------------
+
+void PerfCounters::Flush() {
+
+  uint64_t now = Timer::get_ns();
+  time[cur] += now - lastTime;
+  lastTime = now;
+
+  uint64_t v[PERF_NB_EVENT];
+  if(nbFd > 0 && Read(v)) {
+    for(int i = 0; i < nbFd; i++) {
+      count[cur][event[i]] += v[i] - last[i];
+      last[i] = v[i];
+    }
+  }
+
+}
+
+void PerfCounters::Phase(int phase) {
+
+  if(phase == cur)
+    return;
+
+  Flush();
+  cur = phase;
+
+}
+
+void PerfCounters::Stop() {
+
+  Flush();
+  Close();
+
+}
+
+void PerfCounters::Add(PerfCounters *p) {
+
+  for(int ph = 0; ph < PERF_NB_PHASE; ph++) {
+    time[ph] += p->time[ph];
+    for(int e = 0; e < PERF_NB_EVENT; e++)
+      count[ph][e] += p->count[ph][e];
+  }
+  for(int e = 0; e < PERF_NB_EVENT; e++)
+    available[e] |= p->available[e];
+
+}
+
+bool PerfCounters::Probe(string &info) {
+
+  PerfCounters p;
+  if(!p.Open()) {
+    info = p.error;
+    return false;
+  }
+
+  info = "";
+  for(int e = 0; e < PERF_NB_EVENT; e++) {
+    if(!p.available[e]) continue;
+    if(info.length() > 0) info.append(",");
+    info.append(eventName[e]);
+  }
+  return true;
+
+}
+
+// ----------------------------------------------------------------------------
+
+static void PrintPerStep(PerfCounters *p,uint64_t *c,int e,double nbStep) {
+
+  if(p->available[e])
+    ::printf(" %11.3f",(double)c[e] / nbStep);
+  else
+    ::printf(" %11s","-");
+
+}
+
+void PerfCounters::Print(uint64_t nbStep,int nbThread) {
+
+  double steps = (nbStep > 0) ? (double)nbStep : 1.0;
+  uint64_t total[PERF_NB_EVENT];
+  uint64_t totalTime = 0;
+  memset(total,0,sizeof(total));
+  for(int ph = 0; ph < PERF_NB_PHASE; ph++) {
+    totalTime += time[ph];
+    for(int e = 0; e < PERF_NB_EVENT; e++)
+      total[e] += count[ph][e];
+  }
+  if(totalTime == 0) totalTime = 1;
+
+  ::printf("Perf: %d CPU thread(s), 2^%.2f steps, per step values\n",nbThread,log2(steps));
+  ::printf("  %-6s %6s %9s %11s %6s %11s %11s %11s %11s\n","Phase","Time","ns","cycles","IPC",
+           "L1D-misses","LLC-refs","LLC-misses","br-misses");
+
+  for(int ph = 0; ph <= PERF_NB_PHASE; ph++) {
+
+    uint64_t *c = (ph < PERF_NB_PHASE) ? count[ph] : total;
+    uint64_t t = (ph < PERF_NB_PHASE) ? time[ph] : totalTime;
+    ::printf("  %-6s %5.1f%% %9.2f",(ph < PERF_NB_PHASE) ? phaseName[ph] : "total",
+             100.0 * (double)t / (double)totalTime,(double)t / steps);
+    PrintPerStep(this,c,PERF_CYCLES,steps);
+    if(available[PERF_CYCLES] && available[PERF_INSTR] && c[PERF_CYCLES] > 0)
+      ::printf(" %6.2f",(double)c[PERF_INSTR] / (double)c[PERF_CYCLES]);
+    else
+      ::printf(" %6s","-");
+    PrintPerStep(this,c,PERF_L1D_MISS,steps);
+    PrintPerStep(this,c,PERF_L2_MISS,steps);
+    PrintPerStep(this,c,PERF_LLC_MISS,steps);
+    PrintPerStep(this,c,PERF_BRANCH_MISS,steps);
+    ::printf("\n");
+
+  }
+
+  if(available[PERF_CYCLES] && total[PERF_CYCLES] == 0)
+    ::printf("  Warning: counters opened but never scheduled (PMU busy or multiplexed)\n");
+
+}
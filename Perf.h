@@ -0,0 +1,83 @@
+/*
+ * This file is part of the BSGS distribution (https://github.com/JeanLucPons/Kangaroo).
+ * Copyright (c) 2020 Jean Luc PONS.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PERFH
+#define PERFH
+
+#include <stdint.h>
+#include <string>
+
+// Hardware events (Linux perf_event_open, user space only)
+#define PERF_CYCLES      0
+#define PERF_INSTR       1
+#define PERF_BRANCH_MISS 2
+#define PERF_L1D_MISS    3
+#define PERF_L2_MISS     4 // LLC references (no generic L2 event)
+#define PERF_LLC_MISS    5
+#define PERF_NB_EVENT    6
+
+// Phases of SolveKeyCPU
+#define PERF_DX          0 // Jump selection and dx
+#define PERF_INV         1 // Grouped inversion
+#define PERF_ADD         2 // Point addition and distance
+#define PERF_DP          3 // DP check
+#define PERF_TABLE       4 // Table insertion or send to server (lock included)
+#define PERF_OTHER       5 // Save wait, multi-key reset
+#define PERF_NB_PHASE    6
+
+class PerfCounters {
+
+public:
+
+  PerfCounters();
+  ~PerfCounters();
+
+  // Open the counters of the calling thread, returns false if no hardware event is available
+  bool Open();
+  void Close();
+  // Accounts the events since the previous call to the current phase and switches to phase
+  void Phase(int phase);
+  // Accounts the current phase and closes the counters
+  void Stop();
+  void Reset();
+  void Add(PerfCounters *p);
+  void Print(uint64_t nbStep,int nbThread);
+
+  // Opens and closes the counters, returns the available events or the error
+  static bool Probe(std::string &info);
+  static const char *GetEventName(int e);
+
+  uint64_t count[PERF_NB_PHASE][PERF_NB_EVENT];
+  uint64_t time[PERF_NB_PHASE];   // ns
+  bool available[PERF_NB_EVENT];
+  std::string error;              // Open() failure of the first event
+
+private:
+
+  bool Read(uint64_t *v);
+  void Flush();
+
+  int fd[PERF_NB_EVENT];
+  int event[PERF_NB_EVENT];       // Event of the ith group member
+  int nbFd;
+  uint64_t last[PERF_NB_EVENT];
+  uint64_t lastTime;
+  int cur;
+
+};
+
+#endif // PERFH
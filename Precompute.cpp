@@ -0,0 +1,326 @@
+/*
+* This file is part of the BSGS distribution (https://github.com/JeanLucPons/Kangaroo).
+* Copyright (c) 2020 Jean Luc PONS.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Kangaroo.h"
+#include "Timer.h"
+#include <string.h>
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <algorithm>
+
+using namespace std;
+
+// Number of distinct DP collected per table entry, only the most visited are kept
+#define PRECOMP_OVERSAMPLE 4
+
+#ifdef USE_SYMMETRY
+#define PRECOMP_SYM 1
+#else
+#define PRECOMP_SYM 0
+#endif
+
+#ifdef WIN64
+DWORD WINAPI _SolveKeyCPU(LPVOID lpParam);
+#else
+void *_SolveKeyCPU(void *lpParam);
+#endif
+
+// ----------------------------------------------------------------------------
+
+static double GetDistance(int128_t *d) {
+
+  // Absolute travelled distance (126 bit magnitude)
+  return (double)d->i64[0] + ldexp((double)(d->i64[1] & 0x3FFFFFFFFFFFFFFFULL),64);
+
+}
+
+static bool cmpWeight(const PRECOMP_DP &a,const PRECOMP_DP &b) {
+
+  return a.weight > b.weight;
+
+}
+
+// ----------------------------------------------------------------------------
+
+bool Kangaroo::AddToPrecompute(Int *pos,Int *dist,uint64_t walkLength) {
+
+  // Tame DP, the weight of a DP is the total length of the walks that reached it
+  // (Bernstein-Lange: the most visited DP are the most likely to be hit by a wild kangaroo)
+  pair<uint64_t,uint64_t> key(pos->bits64[0],pos->bits64[1]);
+  map<pair<uint64_t,uint64_t>,uint32_t>::iterator it = precompIndex.find(key);
+
+  if(it != precompIndex.end()) {
+    // Walk merged into a known trail, the kangaroo must be reset
+    precompTable[it->second].weight += walkLength;
+    return false;
+  }
+
+  PRECOMP_DP e;
+  uint64_t h;
+  HashTable::Convert(pos,dist,TAME,&h,&e.x,&e.d);
+  e.h = (uint32_t)h;
+  e.weight = walkLength;
+  precompIndex[key] = (uint32_t)precompTable.size();
+  precompTable.push_back(e);
+
+  if(precompTable.size() >= precompTarget)
+    endOfSearch = true;
+
+  return true;
+
+}
+
+// ----------------------------------------------------------------------------
+
+double Kangaroo::ExpectedWithTable(double dp,double coverage,double span) {
+
+  // A wild kangaroo lands on a precomputed trail with probability coverage/span at
+  // each step, then each kangaroo walks about 2^dp until the next DP
+  if(coverage <= 0.0)
+    return 0.0;
+  double N = pow(2.0,(double)rangePower);
+  if(span < N) span = N;
+  return span / coverage + (double)totalRW * pow(2.0,dp);
+
+}
+
+// ----------------------------------------------------------------------------
+
+void Kangaroo::Precompute(int nbThread,std::string &fileName,int nbEntry) {
+
+  double t0 = Timer::get_tick();
+
+  nbCPUThread = nbThread;
+  nbGPUThread = 0;
+  if(nbCPUThread <= 0) {
+    ::printf("No CPU thread, exiting.\n");
+    ::exit(0);
+  }
+  if(nbEntry <= 0) {
+    ::printf("Precompute: invalid table size\n");
+    ::exit(-1);
+  }
+
+  totalRW = nbCPUThread * (uint64_t)CPU_GRP_SIZE;
+  ::printf("Number of CPU thread: %d\n",nbCPUThread);
+
+  InitRange();
+  CreateJumpTable();
+
+  ::printf("Number of kangaroos: 2^%.2f\n",log2((double)totalRW));
+
+  // Walk length close to sqrt(N/T) (Bernstein-Lange)
+  if(initDPSize < 0) {
+    initDPSize = (int)(((double)rangePower - log2((double)nbEntry)) / 2.0);
+    if(initDPSize < 0) initDPSize = 0;
+  }
+  SetDP(initDPSize);
+
+  double stdOp;
+  double stdMem;
+  ComputeExpected((double)dpSize,&stdOp,&stdMem);
+
+  herdType = TAME;
+  precompTarget = (uint64_t)nbEntry * PRECOMP_OVERSAMPLE;
+  precompTable.clear();
+  precompTable.reserve(precompTarget);
+  precompIndex.clear();
+  expectedNbOp = (double)precompTarget * pow(2.0,(double)dpSize);
+  ::printf("Table entries: %d (2^%.2f DP to collect)\n",nbEntry,log2((double)precompTarget));
+  ::printf("Expected operations: 2^%.2f\n",log2(expectedNbOp));
+
+  TH_PARAM *params = (TH_PARAM *)malloc(nbCPUThread * sizeof(TH_PARAM));
+  THREAD_HANDLE *thHandles = (THREAD_HANDLE *)malloc(nbCPUThread * sizeof(THREAD_HANDLE));
+  memset(params,0,nbCPUThread * sizeof(TH_PARAM));
+  memset(stats,0,sizeof(stats));
+
+  keyIdx = 0;
+  endOfSearch = false;
+  precompMode = true;
+
+  for(int i = 0; i < nbCPUThread; i++) {
+    params[i].threadId = i;
+    params[i].isRunning = true;
+    thHandles[i] = LaunchThread(_SolveKeyCPU,params + i);
+  }
+
+  Process(params,"MK/s");
+  JoinThreads(thHandles,nbCPUThread);
+  FreeHandles(thHandles,nbCPUThread);
+  free(params);
+  free(thHandles);
+
+  precompMode = false;
+  herdType = -1;
+  precompIndex.clear();
+
+  // Keep the most useful DP
+  uint64_t nbCollected = precompTable.size();
+  sort(precompTable.begin(),precompTable.end(),cmpWeight);
+  if(precompTable.size() > (size_t)nbEntry)
+    precompTable.resize(nbEntry);
+
+  precompCoverage = 0.0;
+  precompSpan = 0.0;
+  for(size_t i = 0; i < precompTable.size(); i++) {
+    precompCoverage += (double)precompTable[i].weight;
+    double d = GetDistance(&precompTable[i].d);
+    if(d > precompSpan) precompSpan = d;
+  }
+
+  ::printf("\nPrecompute: %d/%.0f DP kept, coverage 2^%.2f\n",(int)precompTable.size(),(double)nbCollected,
+           log2(precompCoverage));
+
+  if(!SavePrecompute(fileName))
+    ::exit(-1);
+
+  double opT = ExpectedWithTable((double)dpSize,precompCoverage,precompSpan);
+  ::printf("Expected operations (standard): 2^%.2f\n",log2(stdOp));
+  ::printf("Expected operations (table)   : 2^%.2f [x%.1f speedup, %d kangaroos]\n",log2(opT),stdOp / opT,
+           (int)totalRW);
+
+  double t1 = Timer::get_tick();
+  ::printf("Done: Total time %s \n",GetTimeStr(t1 - t0).c_str());
+
+}
+
+// ----------------------------------------------------------------------------
+
+bool Kangaroo::SavePrecompute(std::string &fileName) {
+
+  FILE *f = fopen(fileName.c_str(),"wb");
+  if(f == NULL) {
+    ::printf("SavePrecompute: Cannot open %s for writing\n",fileName.c_str());
+    ::printf("%s\n",::strerror(errno));
+    return false;
+  }
+
+  uint32_t head = HEADP;
+  uint32_t version = GetJumpConfig();
+  uint32_t rPower = rangePower;
+  uint32_t sym = PRECOMP_SYM;
+  uint64_t nbItem = precompTable.size();
+
+  ::fwrite(&head,sizeof(uint32_t),1,f);
+  ::fwrite(&version,sizeof(uint32_t),1,f);
+  ::fwrite(&dpSize,sizeof(uint32_t),1,f);
+  ::fwrite(&rPower,sizeof(uint32_t),1,f);
+  ::fwrite(&sym,sizeof(uint32_t),1,f);
+  ::fwrite(&nbItem,sizeof(uint64_t),1,f);
+  ::fwrite(&precompCoverage,sizeof(double),1,f);
+  ::fwrite(&precompSpan,sizeof(double),1,f);
+
+  for(uint64_t i = 0; i < nbItem; i++) {
+    ::fwrite(&precompTable[i].h,sizeof(uint32_t),1,f);
+    ::fwrite(&precompTable[i].x,16,1,f);
+    if(::fwrite(&precompTable[i].d,16,1,f) != 1) {
+      ::printf("SavePrecompute: Cannot write to %s\n",fileName.c_str());
+      ::printf("%s\n",::strerror(errno));
+      ::fclose(f);
+      return false;
+    }
+  }
+
+  ::fclose(f);
+  ::printf("Table saved: %s [%.1fMB]\n",fileName.c_str(),(double)(nbItem * 36) / (1024.0 * 1024.0));
+
+  return true;
+
+}
+
+// ----------------------------------------------------------------------------
+
+bool Kangaroo::LoadPrecompute(std::string &fileName) {
+
+  FILE *f = fopen(fileName.c_str(),"rb");
+  if(f == NULL) {
+    ::printf("LoadPrecompute: Cannot open %s for reading\n",fileName.c_str());
+    ::printf("%s\n",::strerror(errno));
+    return false;
+  }
+
+  uint32_t head = 0;
+  uint32_t version;
+  uint32_t dp;
+  uint32_t rPower;
+  uint32_t sym;
+  uint64_t nbItem;
+
+  ::fread(&head,sizeof(uint32_t),1,f);
+  if(head != HEADP) {
+    ::printf("LoadPrecompute: %s is not a precomputed table\n",fileName.c_str());
+    ::fclose(f);
+    return false;
+  }
+
+  ::fread(&version,sizeof(uint32_t),1,f);
+  ::fread(&dp,sizeof(uint32_t),1,f);
+  ::fread(&rPower,sizeof(uint32_t),1,f);
+  ::fread(&sym,sizeof(uint32_t),1,f);
+  ::fread(&nbItem,sizeof(uint64_t),1,f);
+  ::fread(&precompCoverage,sizeof(double),1,f);
+  ::fread(&precompSpan,sizeof(double),1,f);
+
+  // Tame trails depend only on the range width, the jump table and the symmetry
+  if(rPower != (uint32_t)rangePower) {
+    ::printf("LoadPrecompute: %s computed for range width 2^%d (2^%d expected)\n",fileName.c_str(),rPower,rangePower);
+    ::fclose(f);
+    return false;
+  }
+  if(!SetJumpConfig(version,fileName)) {
+    ::fclose(f);
+    return false;
+  }
+  if(sym != PRECOMP_SYM) {
+    ::printf("LoadPrecompute: %s symmetry mismatch, compiled %s USE_SYMMETRY\n",fileName.c_str(),
+             PRECOMP_SYM ? "with" : "without");
+    ::fclose(f);
+    return false;
+  }
+
+  precompTable.resize(nbItem);
+  for(uint64_t i = 0; i < nbItem; i++) {
+    ::fread(&precompTable[i].h,sizeof(uint32_t),1,f);
+    ::fread(&precompTable[i].x,16,1,f);
+    if(::fread(&precompTable[i].d,16,1,f) != 1) {
+      ::printf("LoadPrecompute: %s unexpected end of file\n",fileName.c_str());
+      ::fclose(f);
+      precompTable.clear();
+      return false;
+    }
+    precompTable[i].weight = 0;
+  }
+  ::fclose(f);
+
+  if(initDPSize >= 0 && initDPSize != (int32_t)dp)
+    ::printf("Warning, DP size forced to %d (precomputed table)\n",dp);
+  initDPSize = dp;
+
+  ::printf("Precomputed table: %s [%.0f DP, coverage 2^%.2f]\n",fileName.c_str(),(double)nbItem,log2(precompCoverage));
+
+  return true;
+
+}
+
+// ----------------------------------------------------------------------------
+
+void Kangaroo::ImportPrecompute() {
+
+  for(size_t i = 0; i < precompTable.size(); i++)
+    hashTable.Add(precompTable[i].h,&precompTable[i].x,&precompTable[i].d);
+
+}
@@ -0,0 +1,114 @@
+/*
+* This file is part of the BSGS distribution (https://github.com/JeanLucPons/Kangaroo).
+* Copyright (c) 2020 Jean Luc PONS.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Kangaroo.h"
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+using namespace std;
+
+// Points of the success curve reported in the status
+const double Kangaroo::succPoint[NB_SUCC_POINT] = { 0.5,0.9,0.99 };
+
+// ----------------------------------------------------------------------------
+
+// The number of group operations without DP (DP=0) needed to solve follows a Rayleigh law of mean
+// succMu (birthday paradox between tame and wild paths). Detecting the collision costs the DP overhead
+// succOverHead on top of it, the curve is shifted by this amount.
+void Kangaroo::InitSuccess(bool server) {
+
+  double op;
+  double ram;
+  double overHead;
+  ComputeExpected((double)dpSize,&op,&ram,&overHead);
+
+  // Precomputed table (-pt) or multi-key (-mk) change the expected operations, keep the same shape.
+  // A server gets its kangaroo number from the clients, use the current one.
+  double scale = (server || op <= 0.0) ? 1.0 : expectedNbOp / op;
+  succMu = op / overHead * scale;
+  succOverHead = (op - op / overHead) * scale;
+  succProb = 0.0;
+  for(int i = 0; i < NB_SUCC_POINT; i++)
+    succTime[i] = -1.0;
+
+}
+
+// Success probability after ops useful group operations
+double Kangaroo::SuccessProb(double ops) {
+
+  double x = ops - succOverHead;
+  if(x <= 0.0 || succMu <= 0.0)
+    return 0.0;
+  return 1.0 - exp(-M_PI * x * x / (4.0 * succMu * succMu));
+
+}
+
+// Group operations to reach the success probability p
+double Kangaroo::SuccessOps(double p) {
+
+  return succOverHead + succMu * sqrt(-4.0 * log(1.0 - p) / M_PI);
+
+}
+
+// Probability reached and time to the points of the curve at opRate op/s (-1: passed or unknown).
+// Walks of dead kangaroos (merged into an other path) are not useful, about 2^dpSize operations each.
+void Kangaroo::UpdateSuccess(double ops,double dead,double opRate) {
+
+  double useful = fmax(ops - dead * pow(2.0,dpSize),0.0);
+  succProb = SuccessProb(useful);
+  for(int i = 0; i < NB_SUCC_POINT; i++) {
+    double left = SuccessOps(succPoint[i]) - useful;
+    succTime[i] = (left > 0.0 && opRate > 0.0) ? left / opRate : -1.0;
+  }
+
+  // Past the last point, the key is likely not in the range (or the search is misconfigured)
+  if(!succHint && succProb >= succPoint[NB_SUCC_POINT - 1]) {
+    succHint = true;
+    ::printf("\nSuccess probability above %.0f%% (2^%.2f operations), the key may not be in the range: "
+             "consider stopping (-m) or reassigning the resources\n",succPoint[NB_SUCC_POINT - 1] * 100.0,log2(useful));
+  }
+
+}
+
+// Status field: probability reached and time to the points not yet reached
+string Kangaroo::GetSuccessStr() {
+
+  char tmp[256];
+  string s;
+
+  ::sprintf(tmp,"[P %.1f%%",succProb * 100.0);
+  s.append(tmp);
+  for(int i = 0; i < NB_SUCC_POINT; i++) {
+    if(succTime[i] < 0.0)
+      continue;
+    ::sprintf(tmp," %g%% %s",succPoint[i] * 100.0,GetTimeStr(succTime[i]).c_str());
+    s.append(tmp);
+    break;
+  }
+  s.append("]");
+  return s;
+
+}
+
+void Kangaroo::PrintSuccess() {
+
+  ::printf("Success:");
+  for(int i = 0; i < NB_SUCC_POINT; i++)
+    ::printf(" %g%% at 2^%.2f%s",succPoint[i] * 100.0,log2(SuccessOps(succPoint[i])),(i + 1 < NB_SUCC_POINT) ? "," : "");
+  ::printf(" operations\n");
+
+}
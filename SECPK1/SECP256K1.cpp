@@ -40,17 +40,68 @@ void Secp256K1::Init() {
   Int::InitK1(&order);
 
   // Compute Generator table
+  SetWindow(8);
+
+}
+
+bool Secp256K1::SetWindow(int bits) {
+
+  // Wider window: less additions per scalar multiplication, 2^bits.256/bits points
+  if(bits < 4 || bits > 16)
+    return false;
+
+  wBits = bits;
+  wSize = 1 << bits;
+  nbWindow = (256 + bits - 1) / bits;
+  GTable.clear();
+  GTable.resize((size_t)nbWindow * wSize);
+
   Point N(G);
-  for(int i = 0; i < 32; i++) {
-    GTable[i * 256] = N;
-    N = DoubleDirect(N);
-    for (int j = 1; j < 255; j++) {
-      GTable[i * 256 + j] = N;
-      N = AddDirect(N, GTable[i * 256]);
+  for(int i = 0; i < nbWindow; i++) {
+
+    Point *T = &GTable[(size_t)i * wSize];
+    T[0] = N;
+
+    // j.N for j in [2^k+1,2^(k+1)] from [1,2^k], one batch inversion per level
+    for(int k = 0; k < bits; k++) {
+      int h = 1 << k;
+      if(h > 1) {
+        std::vector<Point> p1(h - 1,T[h - 1]);
+        std::vector<Point> p2(T,T + h - 1);
+        std::vector<Point> r = AddDirect(p1,p2);
+        for(int j = 0; j < h - 1; j++)
+          T[h + j] = r[j];
+      }
+      T[2 * h - 1] = DoubleDirect(T[h - 1]);
     }
-    GTable[i * 256 + 255] = N; // Dummy point for check function
+
+    // Last entry is 2^bits.N (dummy point for check function)
+    N = T[wSize - 1];
+
   }
 
+  return true;
+
+}
+
+int Secp256K1::GetWindow() {
+  return wBits;
+}
+
+double Secp256K1::GetTableSize() {
+  return (double)GTable.size() * sizeof(Point) / (1024.0 * 1024.0);
+}
+
+uint32_t Secp256K1::GetDigit(Int *k,int w) {
+
+  int pos = w * wBits;
+  int q = pos >> 6;
+  int r = pos & 63;
+  uint64_t v = k->bits64[q] >> r;
+  if(r + wBits > 64 && q < NB64BLOCK - 1)
+    v |= k->bits64[q + 1] << (64 - r);
+  return (uint32_t)(v & (uint64_t)(wSize - 1));
+
 }
 
 Secp256K1::~Secp256K1() {
@@ -59,26 +110,26 @@ Secp256K1::~Secp256K1() {
 Point Secp256K1::ComputePublicKey(Int *privKey,bool reduce) {
 
   int i = 0;
-  uint8_t b;
+  uint32_t b;
   Point Q;
   Q.Clear();
 
-  // Search first significant byte
-  for (i = 0; i < 32; i++) {
-    b = privKey->GetByte(i);
+  // Search first significant window
+  for (i = 0; i < nbWindow; i++) {
+    b = GetDigit(privKey,i);
     if(b)
       break;
   }
 
-  if(i<32) {
-    Q = GTable[256 * i + (b-1)];
+  if(i<nbWindow) {
+    Q = GTable[(size_t)wSize * i + (b-1)];
     i++;
   }
 
-  for(; i < 32; i++) {
-    b = privKey->GetByte(i);
+  for(; i < nbWindow; i++) {
+    b = GetDigit(privKey,i);
     if(b)
-      Q = Add2(Q, GTable[256 * i + (b-1)]);
+      Q = Add2(Q, GTable[(size_t)wSize * i + (b-1)]);
   }
 
   if(reduce) Q.Reduce();
@@ -88,27 +139,74 @@ Point Secp256K1::ComputePublicKey(Int *privKey,bool reduce) {
 
 std::vector<Point> Secp256K1::ComputePublicKeys(std::vector<Int> &privKeys) {
 
-  std::vector<Point> pts;
-  IntGroup grp((int)privKeys.size());
-  Int *inv = new Int[privKeys.size()];
-  pts.reserve(privKeys.size());
-
-  for(int i=0;i<privKeys.size();i++) {
-    Point P = ComputePublicKey(&privKeys[i],false);
-    inv[i].Set(&P.z);
-    pts.push_back(P);
-  }
+  // Affine additions of all scalars window by window, one batch inversion per window
+  // (privKeys must be in [1,order-1], the partial sum never equals +/- the table point)
+  int size = (int)privKeys.size();
+  std::vector<Point> pts(size);
+  std::vector<bool> started(size,false);
+  std::vector<int> idx(size);
+  std::vector<uint32_t> digit(size);
+  Int *dx = new Int[size];
 
-  grp.Set(inv);
-  grp.ModInv();
+  Int _s;
+  Int _p;
+  Int dy;
+
+  for(int w = 0; w < nbWindow; w++) {
+
+    int m = 0;
+    for(int i = 0; i < size; i++) {
+      uint32_t b = GetDigit(&privKeys[i],w);
+      if(!b)
+        continue;
+      Point &T = GTable[(size_t)wSize * w + (b - 1)];
+      if(!started[i]) {
+        pts[i] = T;
+        started[i] = true;
+      } else {
+        dx[m].ModSub(&T.x,&pts[i].x);
+        idx[m] = i;
+        digit[m] = b;
+        m++;
+      }
+    }
+
+    if(m == 0)
+      continue;
+
+    IntGroup grp(m);
+    grp.Set(dx);
+    grp.ModInv();
+
+    for(int j = 0; j < m; j++) {
+
+      Point &T = GTable[(size_t)wSize * w + (digit[j] - 1)];
+      Point &P = pts[idx[j]];
+
+      dy.ModSub(&T.y,&P.y);
+      _s.ModMulK1(&dy,&dx[j]);     // s = (p2.y-p1.y)*inverse(p2.x-p1.x);
+      _p.ModSquareK1(&_s);         // _p = pow2(s)
+
+      _p.ModSub(&P.x);
+      _p.ModSub(&T.x);             // rx = pow2(s) - p1.x - p2.x;
+
+      P.y.ModSub(&T.x,&_p);
+      P.y.ModMulK1(&_s);
+      P.y.ModSub(&T.y);            // ry = - p2.y - s*(ret.x-p2.x);
+      P.x.Set(&_p);
+
+    }
 
-  for(int i = 0; i<privKeys.size(); i++) {
-    pts[i].x.ModMulK1(inv + i);
-    pts[i].y.ModMulK1(inv + i);
-    pts[i].z.SetInt32(1);
   }
 
-  delete[] inv;
+  for(int i = 0; i < size; i++) {
+    if(started[i])
+      pts[i].z.SetInt32(1);
+    else
+      pts[i].Clear();
+  }
+
+  delete[] dx;
   return pts;
 
 }
@@ -283,6 +381,7 @@ std::vector<Point> Secp256K1::AddDirect(std::vector<Point> &p1,std::vector<Point
   Int _p;
   Int dy;
   Point r;
+  r.z.SetInt32(1);
 
   // Compute DX
   for(int i=0;i<size;i++) {
@@ -29,6 +29,9 @@ public:
   Secp256K1();
   ~Secp256K1();
   void  Init();
+  bool  SetWindow(int bits);
+  int   GetWindow();
+  double GetTableSize();
   Point ComputePublicKey(Int *privKey,bool reduce=true);
   std::vector<Point> ComputePublicKeys(std::vector<Int> &privKeys);
   Point NextKey(Point &key);
@@ -53,7 +56,13 @@ private:
   uint8_t GetByte(std::string &str,int idx);
 
   Int GetY(Int x, bool isEven);
-  Point GTable[256*32];       // Generator table
+  uint32_t GetDigit(Int *k,int w);
+
+  // Generator table, window w: GTable[w*wSize + (b-1)] = b.2^(w*wBits).G
+  std::vector<Point> GTable;
+  int wBits;
+  int wSize;
+  int nbWindow;
 
 };
 
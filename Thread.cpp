@@ -103,7 +103,7 @@ uint64_t Kangaroo::getGPUCount() {
 
   uint64_t count = 0;
   for(int i = 0; i<nbGPUThread; i++)
-    count += counters[0x80L + i];
+    count += stats[0x80L + i].step;
   return count;
 
 }
@@ -114,13 +114,40 @@ uint64_t Kangaroo::getCPUCount() {
 
   uint64_t count = 0;
   for(int i=0;i<nbCPUThread;i++)
-    count += counters[i];
+    count += stats[i].step;
   return count;
 
 }
 
 // ----------------------------------------------------------------------------
 
+void Kangaroo::GetThreadStats(THREAD_STATS *total) {
+
+  // Each block is written by its thread only, no lock needed for statistics
+  memset(total,0,sizeof(THREAD_STATS));
+  for(int i = 0; i < nbCPUThread + nbGPUThread; i++) {
+    THREAD_STATS *s = (i < nbCPUThread) ? &stats[i] : &stats[0x80L + i - nbCPUThread];
+    total->step += s->step;
+    total->nbDP += s->nbDP;
+    total->nbDead += s->nbDead;
+    total->lockWait += s->lockWait;
+    total->saveStall += s->saveStall;
+    total->netStall += s->netStall;
+  }
+
+}
+
+// Lock ghMutex from a walker thread, the wait is added to its statistics
+void Kangaroo::LockStat(int thId) {
+
+  uint64_t t0 = Timer::get_ns();
+  LOCK(ghMutex);
+  stats[thId].lockWait += Timer::get_ns() - t0;
+
+}
+
+// ----------------------------------------------------------------------------
+
 string Kangaroo::GetTimeStr(double dTime) {
 
   char tmp[256];
@@ -161,6 +188,34 @@ string Kangaroo::GetTimeStr(double dTime) {
 
 }
 
+// Route dead kangaroos (kIdx at the head of the DP buffers) to their clients, free the buffers
+void Kangaroo::RouteDeadKangaroos(vector<DP_CACHE>& dead) {
+
+  if(dead.size() == 0)
+    return;
+
+  LOCK(ghMutex);
+  for(int i = 0; i < (int)dead.size(); i++) {
+    map<uint32_t,DEAD_LIST>::iterator it = deadKangaroos.find(dead[i].clientId);
+    if(it != deadKangaroos.end()) {
+      // Client still connected
+      vector<DEAD_KANGAROO>& list = it->second[dead[i].threadId];
+      for(uint32_t j = 0; j < dead[i].nbDP; j++) {
+        DEAD_KANGAROO dk;
+        dk.kIdx = dead[i].dp[j].kIdx;
+        dk.batchId = dead[i].batchId;
+        list.push_back(dk);
+      }
+    }
+    free(dead[i].dp);
+  }
+  UNLOCK(ghMutex);
+  dead.clear();
+
+}
+
+// ----------------------------------------------------------------------------
+
 // Wait for end of server and dispay stats
 void Kangaroo::ProcessServer() {
 
@@ -178,6 +233,16 @@ void Kangaroo::ProcessServer() {
   ghMutex = CreateMutex(NULL,FALSE,NULL);
 #endif
 
+  if(relayMode) {
+    ProcessRelay();
+    return;
+  }
+
+  // Success probability from the DP in the table (2^dpSize operations each)
+  uint64_t lastNbDP = hashTable.GetNbItem();
+  double opRate = 0.0;
+  succHint = false;
+
   while(!endOfSearch) {
 
     t0 = Timer::get_tick();
@@ -191,37 +256,86 @@ void Kangaroo::ProcessServer() {
     UNLOCK(ghMutex);
 
     // Add to hashTable
+    vector<DP_CACHE> dead;
     for(int i = 0; i<(int)localCache.size() && !endOfSearch; i++) {
       DP_CACHE dp = localCache[i];
+      DP_CACHE dc;
+      dc.nbDP = 0;
+      dc.clientId = dp.clientId;
+      dc.threadId = dp.threadId;
+      dc.batchId = dp.batchId;
       for(int j = 0; j<(int)dp.nbDP && !endOfSearch; j++) {
         uint64_t h = dp.dp[j].h;
-        if(!AddToTable(h,&dp.dp[j].x,&dp.dp[j].d)) {
+        if(nbShard > 1 && GetShard(h,nbShard) != shardIdx) {
+          // Not owned by this shard (misconfigured client)
+          nbWrongShard++;
+          continue;
+        }
+        if(!AddToTable(h,&dp.dp[j].x,&dp.dp[j].d,dp.clientId)) {
           // Collision inside the same herd
           collisionInSameHerd++;
+          // Keep kIdx at the head of the DP buffer, the client will reset it
+          if(dp.clientId)
+            dp.dp[dc.nbDP++].kIdx = dp.dp[j].kIdx;
         }
       }
-      free(dp.dp);
+      if(dc.nbDP > 0) {
+        dc.dp = dp.dp;
+        dead.push_back(dc);
+      } else {
+        free(dp.dp);
+      }
     }
 
+    // Route dead kangaroos to their clients
+    RouteDeadKangaroos(dead);
+
+    // Raise DP if the table does not fit in the RAM budget (-maxram)
+    AdaptDP(false);
+
     t1 = Timer::get_tick();
 
-    double toSleep = SEND_PERIOD - (t1-t0);
+    double toSleep = sendPeriod - (t1-t0);
     if(toSleep<0) toSleep = 0.0;
     Timer::SleepMillis((uint32_t)(toSleep*1000.0));
 
     t1 = Timer::get_tick();
 
-    if(!endOfSearch)
-      printf("\r[Client %d][Kang 2^%.2f][DP Count 2^%.2f/2^%.2f][Dead %.0f][%s][%s]  ",
+    uint64_t nbDP = hashTable.GetNbItem();
+    double theta = pow(2.0,dpSize) * (double)nbShard;
+    double rate = (nbDP > lastNbDP) ? (double)(nbDP - lastNbDP) * theta / (t1 - t0) : 0.0;
+    opRate = (opRate > 0.0) ? 0.75 * opRate + 0.25 * rate : rate;
+    lastNbDP = nbDP;
+    InitSuccess(true);
+    UpdateSuccess((double)nbDP * theta,0.0,opRate);
+
+    if(!endOfSearch && nbWrongShard > 0)
+      printf("\r[Client %d][Kang 2^%.2f][DP Count 2^%.2f/2^%.2f][Dead %.0f][Wrong shard %.0f]%s[%s][%s]  ",
+        connectedClient,
+        log2((double)totalRW),
+        log2((double)nbDP),
+        log2(expectedNbOp / pow(2.0,dpSize) / (double)nbShard),
+        (double)collisionInSameHerd,
+        (double)nbWrongShard,
+        GetSuccessStr().c_str(),
+        GetTimeStr(t1 - startTime).c_str(),
+        hashTable.GetSizeInfo().c_str()
+        );
+    else if(!endOfSearch)
+      printf("\r[Client %d][Kang 2^%.2f][DP Count 2^%.2f/2^%.2f][Dead %.0f]%s[%s][%s]  ",
         connectedClient,
         log2((double)totalRW),
-        log2((double)hashTable.GetNbItem()),
-        log2(expectedNbOp / pow(2.0,dpSize)),
+        log2((double)nbDP),
+        log2(expectedNbOp / pow(2.0,dpSize) / (double)nbShard),
         (double)collisionInSameHerd,
+        GetSuccessStr().c_str(),
         GetTimeStr(t1 - startTime).c_str(),
         hashTable.GetSizeInfo().c_str()
         );
 
+    if(!endOfSearch)
+      UpdateMetrics(true,0.0,0.0,0.0);
+
     if(workFile.length() > 0 && !endOfSearch) {
       if((t1 - lastSave) > saveWorkPeriod) {
         SaveServerWork();
@@ -231,6 +345,166 @@ void Kangaroo::ProcessServer() {
 
   }
 
+  // Final state
+  UpdateMetrics(true,0.0,0.0,0.0);
+
+}
+
+// ----------------------------------------------------------------------------
+
+#define RELAY_MAX_DP    65536 // Max DP per upstream batch
+#define RELAY_MAX_BATCH 1024  // Number of forwarded batches kept for dead kangaroo routing
+
+// Relay: merge DP from local clients, remove duplicates and forward them upstream
+void Kangaroo::ProcessRelay() {
+
+  double t0;
+  double t1;
+  startTime = Timer::get_tick();
+  uint64_t upstreamRW = 0;
+
+  while(!endOfSearch) {
+
+    t0 = Timer::get_tick();
+
+    LOCK(ghMutex);
+    // Get back all dps
+    localCache.clear();
+    for(int i = 0; i < (int)recvDP.size(); i++)
+      localCache.push_back(recvDP[i]);
+    recvDP.clear();
+    UNLOCK(ghMutex);
+
+    // Merge and remove duplicates
+    vector<DP> out;
+    vector<RELAY_ORIGIN> origin;
+    vector<DP_CACHE> dead;
+    for(int i = 0; i < (int)localCache.size(); i++) {
+      DP_CACHE dp = localCache[i];
+      DP_CACHE dc;
+      dc.nbDP = 0;
+      dc.clientId = dp.clientId;
+      dc.threadId = dp.threadId;
+      dc.batchId = dp.batchId;
+      relayIn += dp.nbDP;
+      for(int j = 0; j < (int)dp.nbDP; j++) {
+        uint64_t h = dp.dp[j].h;
+        if(h >= HASH_SIZE)
+          continue;
+        bool isDead = false;
+        int addStatus = localTable->Add(h,&dp.dp[j].x,&dp.dp[j].d);
+        if(addStatus == ADD_OK) {
+          nbLocalDP++;
+          if(maxLocalDP > 0 && nbLocalDP >= maxLocalDP) {
+            localTable->Reset();
+            nbLocalDP = 0;
+          }
+        } else if(addStatus == ADD_DUPLICATE) {
+          isDead = true;
+        } else {
+          // Same herd collision is a dead kangaroo, Tame/Wild collision is solved upstream.
+          // With the four-kangaroo walk, a Wild/Wild collision may solve the key (k and -k herds),
+          // it is forwarded and checked upstream, which also reports it dead otherwise.
+          Int dist;
+          uint32_t kType;
+          HashTable::CalcDistAndType(dp.dp[j].d,&dist,&kType);
+          isDead = (kType == localTable->kType) && !(fourKangaroo && kType == WILD);
+        }
+        if(isDead) {
+          collisionInSameHerd++;
+          if(dp.clientId)
+            dp.dp[dc.nbDP++].kIdx = dp.dp[j].kIdx;
+        } else {
+          RELAY_ORIGIN o;
+          o.clientId = dp.clientId;
+          o.threadId = dp.threadId;
+          o.batchId = dp.batchId;
+          o.kIdx = dp.dp[j].kIdx;
+          origin.push_back(o);
+          out.push_back(dp.dp[j]);
+        }
+      }
+      if(dc.nbDP > 0) {
+        dc.dp = dp.dp;
+        dead.push_back(dc);
+      } else {
+        free(dp.dp);
+      }
+    }
+    RouteDeadKangaroos(dead);
+
+    // Kangaroo number of local clients
+    if(upstreamRW != totalRW) {
+      upstreamRW = totalRW;
+      SetUpstreamKangaroo();
+    }
+
+    // Forward upstream, kIdx is replaced by the DP index in the batch
+    for(size_t start = 0; start < out.size() && !endOfSearch; start += RELAY_MAX_DP) {
+
+      size_t nbDP = out.size() - start;
+      if(nbDP > RELAY_MAX_DP) nbDP = RELAY_MAX_DP;
+      vector<DP> batch(out.begin() + start,out.begin() + start + nbDP);
+      for(uint32_t k = 0; k < (uint32_t)nbDP; k++)
+        batch[k].kIdx = k;
+
+      relayBatch++;
+      relayOrigin[relayBatch].assign(origin.begin() + start,origin.begin() + start + nbDP);
+      if(relayOrigin.size() > RELAY_MAX_BATCH)
+        relayOrigin.erase(relayOrigin.begin());
+
+      vector<DEAD_KANGAROO> upDead;
+      SendDPToServer(batch,0,0xFFFF,relayBatch,upDead);
+      relayOut += nbDP;
+
+      // Route dead kangaroos found upstream to their clients
+      if(upDead.size() > 0) {
+        LOCK(ghMutex);
+        for(size_t k = 0; k < upDead.size(); k++) {
+          map<uint32_t,vector<RELAY_ORIGIN>>::iterator it = relayOrigin.find(upDead[k].batchId);
+          if(it == relayOrigin.end() || upDead[k].kIdx >= it->second.size())
+            continue;
+          RELAY_ORIGIN& o = it->second[upDead[k].kIdx];
+          map<uint32_t,DEAD_LIST>::iterator c = deadKangaroos.find(o.clientId);
+          if(o.clientId && c != deadKangaroos.end()) {
+            DEAD_KANGAROO dk;
+            dk.kIdx = o.kIdx;
+            dk.batchId = o.batchId;
+            c->second[o.threadId].push_back(dk);
+          }
+        }
+        UNLOCK(ghMutex);
+      }
+
+    }
+
+    t1 = Timer::get_tick();
+
+    double toSleep = sendPeriod - (t1 - t0);
+    if(toSleep < 0) toSleep = 0.0;
+    Timer::SleepMillis((uint32_t)(toSleep*1000.0));
+
+    t1 = Timer::get_tick();
+
+    if(!endOfSearch)
+      printf("\r[Relay][Client %d][Kang 2^%.2f][DP In %.0f Out %.0f][Dead %.0f][%s][Upstream %s]  ",
+        connectedClient,
+        log2((double)totalRW),
+        (double)relayIn,
+        (double)relayOut,
+        (double)collisionInSameHerd,
+        GetTimeStr(t1 - startTime).c_str(),
+        serverStatus.c_str()
+        );
+
+    if(!endOfSearch)
+      UpdateMetrics(true,0.0,0.0,0.0);
+
+  }
+
+  // Final state
+  UpdateMetrics(true,0.0,0.0,0.0);
+
 }
 
 // Wait for end of threads and display stats
@@ -263,15 +537,28 @@ void Kangaroo::Process(TH_PARAM *params,std::string unit) {
   memset(lastkeyRate,0,sizeof(lastkeyRate));
   memset(lastGpukeyRate,0,sizeof(lastkeyRate));
 
+  double tStart = Timer::get_tick();
+
   // Wait that all threads have started
   while(!hasStarted(params))
     Timer::SleepMillis(5);
 
   t0 = Timer::get_tick();
+  if(keyIdx == 0)
+    ::printf("Time to first step: %.3fs\n",t0 - tStart);
   startTime = t0;
   lastGPUCount = getGPUCount();
   lastCount = getCPUCount() + gpuCount;
 
+  // Success probability (not known by a client)
+  bool success = !clientMode && !precompMode;
+  succHint = false;
+  if(success) {
+    InitSuccess(false);
+    if(keyIdx == 0)
+      PrintSuccess();
+  }
+
   while(isAlive(params)) {
 
     int delay = 2000;
@@ -299,30 +586,54 @@ void Kangaroo::Process(TH_PARAM *params,std::string unit) {
     avgKeyRate /= (double)(nbSample);
     avgGpuKeyRate /= (double)(nbSample);
     double expectedTime = expectedNbOp / avgKeyRate;
+    if(success) {
+      // DP size may have been raised (-maxram)
+      InitSuccess(false);
+      UpdateSuccess((double)count + offsetCount,(double)collisionInSameHerd,avgKeyRate);
+    }
 
     // Display stats
     if(isAlive(params) && !endOfSearch) {
       if(clientMode) {
-        printf("\r[%.2f %s][GPU %.2f %s][Count 2^%.2f][%s][Server %6s]  ",
+        // Throughput recovered by resetting kangaroos walking on an already known path
+        double recoveredRate = avgKeyRate * (double)nbResetKangaroo / (double)totalRW;
+        if(recoveredRate > avgKeyRate) recoveredRate = avgKeyRate;
+        printf("\r[%.2f %s][GPU %.2f %s][Count 2^%.2f][Reset %.0f (%.2f %s)][%s][Server %6s]  ",
           avgKeyRate / 1000000.0,unit.c_str(),
           avgGpuKeyRate / 1000000.0,unit.c_str(),
           log2((double)count + offsetCount),
+          (double)nbResetKangaroo,recoveredRate / 1000000.0,unit.c_str(),
           GetTimeStr(t1 - startTime + offsetTime).c_str(),
           serverStatus.c_str()
           );
+      } else if(precompMode) {
+        printf("\r[%.2f %s][Count 2^%.2f][Merged %.0f][%s (Avg %s)][DP %.0f/%.0f]  ",
+          avgKeyRate / 1000000.0,unit.c_str(),
+          log2((double)count),
+          (double)collisionInSameHerd,
+          GetTimeStr(t1 - startTime).c_str(),GetTimeStr(expectedTime).c_str(),
+          (double)precompTable.size(),(double)precompTarget
+        );
       } else {
-        printf("\r[%.2f %s][GPU %.2f %s][Count 2^%.2f][Dead %.0f][%s (Avg %s)][%s]  ",
+        printf("\r[%.2f %s][GPU %.2f %s][Count 2^%.2f][Dead %.0f][%s (Avg %s)]%s[%s]  ",
           avgKeyRate / 1000000.0,unit.c_str(),
           avgGpuKeyRate / 1000000.0,unit.c_str(),
           log2((double)count + offsetCount),
           (double)collisionInSameHerd,
           GetTimeStr(t1 - startTime + offsetTime).c_str(),GetTimeStr(expectedTime).c_str(),
+          GetSuccessStr().c_str(),
           hashTable.GetSizeInfo().c_str()
         );
       }
 
+      UpdateMetrics(false,avgKeyRate,avgGpuKeyRate,(double)count + offsetCount);
+
     }
 
+    // Raise DP if the table does not fit in the RAM budget (-maxram)
+    if(!clientMode && !precompMode)
+      AdaptDP(true);
+
     // Save request
     if(workFile.length() > 0 && !endOfSearch) {
       if((t1 - lastSave) > saveWorkPeriod) {
@@ -332,11 +643,17 @@ void Kangaroo::Process(TH_PARAM *params,std::string unit) {
     }
 
     // Abort
-    if(!clientMode && maxStep>0.0) {
+    if(!clientMode && maxStep>0.0 && !endOfSearch) {
       double max = expectedNbOp * maxStep; 
       if( (double)count > max ) {
-        ::printf("\nKey#%2d [XX]Pub:  0x%s \n",keyIdx,secp->GetPublicKeyHex(true,keysToSearch[keyIdx]).c_str());
-        ::printf("       Aborted !\n");
+        LOCK(ghMutex);
+        for(uint32_t k = 0; k < (uint32_t)keysToSearch.size(); k++) {
+          if(multiKey ? keySolved[k] : k != keyIdx)
+            continue;
+          ::printf("\nKey#%2d [XX]Pub:  0x%s \n",k,secp->GetPublicKeyHex(true,keysToSearch[k]).c_str());
+          ::printf("       Aborted !\n");
+        }
+        UNLOCK(ghMutex);
         endOfSearch = true;
         Timer::SleepMillis(1000);
       }
@@ -360,5 +677,32 @@ void Kangaroo::Process(TH_PARAM *params,std::string unit) {
       );
   }
 
+  // Thread statistics, time in % of the total thread time
+  if(!benchMode) {
+    THREAD_STATS st;
+    GetThreadStats(&st);
+    double thTime = (t1 - startTime) * (double)(nbCPUThread + nbGPUThread) * 1e9;
+    if(thTime <= 0.0) thTime = 1.0;
+    ::printf("\nThreads: [DP %.0f][Dead %.0f][Lock wait %.3fs %.2f%%][Save stall %.3fs %.2f%%][Network %.3fs %.2f%%]\n",
+             (double)st.nbDP,(double)st.nbDead,
+             (double)st.lockWait / 1e9,100.0 * (double)st.lockWait / thTime,
+             (double)st.saveStall / 1e9,100.0 * (double)st.saveStall / thTime,
+             (double)st.netStall / 1e9,100.0 * (double)st.netStall / thTime);
+  }
+
+  // Hardware counters of the CPU threads, per step
+  if(perfMode && !benchMode && nbCPUThread > 0) {
+    uint64_t cpuStep = 0;
+    for(int i = 0; i < nbCPUThread; i++)
+      cpuStep += stats[i].step;
+    perfTotal.Print(cpuStep,nbCPUThread);
+  }
+
+  if(!benchMode)
+    PrintHugePages();
+
+  // Final state
+  UpdateMetrics(false,avgKeyRate,avgGpuKeyRate,(double)count + offsetCount);
+
 }
 
@@ -47,6 +47,21 @@ void Timer::Init() {
 
 }
 
+uint64_t Timer::get_ns() {
+
+  // Monotonic clock in nanoseconds, used for short intervals
+#ifdef WIN64
+  LARGE_INTEGER t;
+  QueryPerformanceCounter(&t);
+  return (uint64_t)((double)(t.QuadPart - perfTickStart.QuadPart) * (1e9 / perfTicksPerSec));
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+
+}
+
 double Timer::get_tick() {
 
 #ifdef WIN64
@@ -19,6 +19,7 @@
 #define TIMERH
 
 #include <time.h>
+#include <stdint.h>
 #include <string>
 #ifdef WIN64
 #include <windows.h>
@@ -29,6 +30,7 @@ class Timer {
 public:
   static void Init();
   static double get_tick();
+  static uint64_t get_ns();
   static void printResult(char *unit, int nbTry, double t0, double t1);
   static std::string getResult(char *unit, int nbTry, double t0, double t1);
   static int getCoreNumber();
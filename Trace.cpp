@@ -0,0 +1,429 @@
+/*
+* This file is part of the BSGS distribution (https://github.com/JeanLucPons/Kangaroo).
+* Copyright (c) 2020 Jean Luc PONS.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Kangaroo.h"
+#include "Timer.h"
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#ifndef WIN64
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#define TRACE_MAGIC   0x5450444BU  // "KDPT"
+#define TRACE_VERSION 1
+#define TRACE_CHUNK   65536        // Records per read
+#define TRACE_SAMPLE  32           // Points of the memory curve
+#define TRACE_MAX_COL 1024         // Collisions kept in the report
+
+// Trace file: header then one record per DP given to AddToTable()
+typedef struct {
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t dpSize;
+  uint32_t symmetry;
+  uint64_t nbLoaded;       // Entries already in the table (work file)
+  uint64_t startTime;      // Unix time of the first record
+  uint64_t rangeStart[4];
+  uint64_t rangeEnd[4];
+  uint64_t keyX[4];
+  uint64_t keyY[4];
+
+} TRACE_HEADER;
+
+typedef struct {
+
+  uint32_t h;
+  uint32_t t;              // Time since the start of the record (ms)
+  uint32_t thread;         // Walker thread, or client id on a server
+  uint32_t status;         // HashTable::Add() result when recorded
+  int128_t x;
+  int128_t d;
+
+} TRACE_DP;
+
+typedef struct {
+
+  uint64_t record;
+  double traceTime;
+  double replayTime;
+  uint32_t thread;
+
+} TRACE_COLLISION;
+
+typedef struct {
+
+  uint64_t record;
+  double tableMB;
+  double rssMB;
+
+} TRACE_MEMORY;
+
+// ----------------------------------------------------------------------------
+
+static void GetInt(Int *i,uint64_t *b) {
+
+  i->SetInt32(0);
+  for(int j = 0; j < 4; j++)
+    i->bits64[j] = b[j];
+
+}
+
+static void PutInt(uint64_t *b,Int *i) {
+
+  for(int j = 0; j < 4; j++)
+    b[j] = i->bits64[j];
+
+}
+
+// Resident set size of the process
+static double GetRSSMB() {
+
+#ifndef WIN64
+  FILE *f = fopen("/proc/self/statm","r");
+  if(f == NULL)
+    return 0.0;
+  unsigned long size = 0;
+  unsigned long rss = 0;
+  if(fscanf(f,"%lu %lu",&size,&rss) != 2)
+    rss = 0;
+  fclose(f);
+  return (double)rss * (double)sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+#else
+  return 0.0;
+#endif
+
+}
+
+// ----------------------------------------------------------------------------
+
+// Record the DP of the current key (-dptrace), one trace per run (first key)
+void Kangaroo::StartTrace() {
+
+  if(traceName.length() == 0)
+    return;
+
+  if(keyIdx > 0) {
+    if(traceStream)
+      ::printf("DP trace: first key only, %.0f DP recorded\n",(double)traceCount);
+    CloseTrace();
+    traceName = "";
+    return;
+  }
+
+  traceStream = fopen(traceName.c_str(),"wb");
+  if(traceStream == NULL) {
+    ::printf("Error: Cannot open %s for writing\n",traceName.c_str());
+    ::printf("%s\n",::strerror(errno));
+    ::exit(-1);
+  }
+  setvbuf(traceStream,NULL,_IOFBF,1 << 20);
+
+  TRACE_HEADER hd;
+  memset(&hd,0,sizeof(hd));
+  hd.magic = TRACE_MAGIC;
+  hd.version = TRACE_VERSION;
+  hd.dpSize = dpSize;
+#ifdef USE_SYMMETRY
+  hd.symmetry = 1;
+#endif
+  hd.nbLoaded = hashTable.GetNbItem();
+  hd.startTime = (uint64_t)time(NULL);
+  PutInt(hd.rangeStart,&rangeStart);
+  PutInt(hd.rangeEnd,&rangeEnd);
+  PutInt(hd.keyX,&keysToSearch[keyIdx].x);
+  PutInt(hd.keyY,&keysToSearch[keyIdx].y);
+  if(fwrite(&hd,sizeof(hd),1,traceStream) != 1) {
+    ::printf("Error: Cannot write to %s\n",traceName.c_str());
+    ::printf("%s\n",::strerror(errno));
+    ::exit(-1);
+  }
+
+  traceStart = Timer::get_tick();
+  traceCount = 0;
+  ::printf("DP trace: %s\n",traceName.c_str());
+
+}
+
+void Kangaroo::CloseTrace() {
+
+  if(traceStream == NULL)
+    return;
+  fclose(traceStream);
+  traceStream = NULL;
+
+}
+
+void Kangaroo::TraceDP(uint64_t h,int128_t *x,int128_t *d,uint32_t thId,int status) {
+
+  TRACE_DP r;
+  r.h = (uint32_t)h;
+  r.t = (uint32_t)((Timer::get_tick() - traceStart) * 1000.0);
+  r.thread = thId;
+  r.status = (uint32_t)status;
+  r.x = *x;
+  r.d = *d;
+  if(fwrite(&r,sizeof(r),1,traceStream) != 1) {
+    ::printf("\nDP trace: write error, record stopped: %s\n",::strerror(errno));
+    CloseTrace();
+    return;
+  }
+  traceCount++;
+
+}
+
+// ----------------------------------------------------------------------------
+
+// Feed a trace into HashTable::Add() (table) or into the server ingest path AddToTable() (ingest),
+// as fast as possible or at the recorded pace
+void Kangaroo::ReplayTrace(std::string &fileName,bool pace,bool ingest,std::string &reportFile) {
+
+  FILE *f = fopen(fileName.c_str(),"rb");
+  if(f == NULL) {
+    ::printf("ReplayTrace: Cannot open %s\n",fileName.c_str());
+    ::printf("%s\n",::strerror(errno));
+    ::exit(-1);
+  }
+
+  TRACE_HEADER hd;
+  if(fread(&hd,sizeof(hd),1,f) != 1 || hd.magic != TRACE_MAGIC) {
+    ::printf("ReplayTrace: %s is not a DP trace\n",fileName.c_str());
+    ::exit(-1);
+  }
+  if(hd.version != TRACE_VERSION) {
+    ::printf("ReplayTrace: %s, unsupported version %d\n",fileName.c_str(),hd.version);
+    ::exit(-1);
+  }
+
+#ifdef WIN64
+  _fseeki64(f,0,SEEK_END);
+  uint64_t fileSize = (uint64_t)_ftelli64(f);
+  _fseeki64(f,sizeof(hd),SEEK_SET);
+#else
+  fseeko(f,0,SEEK_END);
+  uint64_t fileSize = (uint64_t)ftello(f);
+  fseeko(f,sizeof(hd),SEEK_SET);
+#endif
+  uint64_t nbRecord = (fileSize - sizeof(hd)) / sizeof(TRACE_DP);
+
+  Int rs;
+  Int re;
+  GetInt(&rs,hd.rangeStart);
+  GetInt(&re,hd.rangeEnd);
+  time_t st = (time_t)hd.startTime;
+  char tStr[64];
+  strftime(tStr,sizeof(tStr),"%Y-%m-%d %H:%M:%S",localtime(&st));
+  ::printf("Trace: %s\n",fileName.c_str());
+  ::printf("Trace: recorded %s, %.0f DP, DP %d, %s\n",tStr,(double)nbRecord,hd.dpSize,
+           hd.symmetry ? "symmetry" : "no symmetry");
+  ::printf("Trace: range [%s,%s]\n",rs.GetBase16().c_str(),re.GetBase16().c_str());
+  if(hd.nbLoaded > 0)
+    ::printf("Trace: warning, %.0f entries were loaded in the table before the record (not replayed)\n",
+             (double)hd.nbLoaded);
+
+  if(ingest) {
+#ifdef USE_SYMMETRY
+    bool sym = true;
+#else
+    bool sym = false;
+#endif
+    if(sym != (hd.symmetry != 0)) {
+      ::printf("ReplayTrace: the trace was recorded %s symmetry, -ingest needs the same build\n",
+               hd.symmetry ? "with" : "without");
+      ::exit(-1);
+    }
+    // Same search as the recording server (collision check)
+    Point P;
+    P.Clear();
+    GetInt(&P.x,hd.keyX);
+    GetInt(&P.y,hd.keyY);
+    P.z.SetInt32(1);
+    rangeStart.Set(&rs);
+    rangeEnd.Set(&re);
+    keysToSearch.clear();
+    keysToSearch.push_back(P);
+    keyIdx = 0;
+    InitRange();
+    InitSearchKey();
+    SetDP(hd.dpSize);
+  }
+
+  ::printf("Replay: %s, %s\n",ingest ? "ingest (AddToTable)" : "table (HashTable::Add)",
+           pace ? "recorded pace" : "as fast as possible");
+
+  hashTable.Reset();
+  endOfSearch = false;
+  collisionInSameHerd = 0;
+
+  vector<TRACE_DP> buff(TRACE_CHUNK);
+  vector<TRACE_MEMORY> mem;
+  vector<TRACE_COLLISION> col;
+  uint64_t nbStatus[3] = { 0,0,0 };
+  uint64_t nbMismatch = 0;
+  uint64_t nbCollision = 0;
+  uint64_t nbDone = 0;
+  uint64_t addNs = 0;
+  uint64_t sampleStep = (nbRecord / TRACE_SAMPLE > 0) ? nbRecord / TRACE_SAMPLE : 1;
+  bool solved = false;
+  TRACE_COLLISION solvedAt;
+  memset(&solvedAt,0,sizeof(solvedAt));
+  double lastTraceTime = 0.0;
+
+  double t0 = Timer::get_tick();
+  size_t n;
+  while(!endOfSearch && (n = fread(buff.data(),sizeof(TRACE_DP),TRACE_CHUNK,f)) > 0) {
+
+    // Timed per chunk, or per DP when paced (sleep excluded)
+    uint64_t n0 = Timer::get_ns();
+
+    for(size_t i = 0; i < n && !endOfSearch; i++) {
+
+      TRACE_DP *r = &buff[i];
+
+      if(pace) {
+        double wait = (double)r->t / 1000.0 - (Timer::get_tick() - t0);
+        if(wait > 0.001)
+          Timer::SleepMillis((uint32_t)(wait * 1000.0));
+        n0 = Timer::get_ns();
+      }
+
+      int status;
+      if(ingest) {
+        // Same accounting as ProcessServer(): duplicates and same herd collisions are dead kangaroos
+        uint32_t nb = hashTable.E[r->h].nbItem;
+        if(!AddToTable((uint64_t)r->h,&r->x,&r->d,r->thread))
+          collisionInSameHerd++;
+        status = (hashTable.E[r->h].nbItem > nb) ? ADD_OK : (endOfSearch ? ADD_COLLISION : ADD_DUPLICATE);
+      } else {
+        status = hashTable.Add((uint64_t)r->h,&r->x,&r->d);
+      }
+      if(pace)
+        addNs += Timer::get_ns() - n0;
+
+      nbStatus[status]++;
+      if(!ingest && (uint32_t)status != r->status)
+        nbMismatch++;
+
+      if(status == ADD_COLLISION || (ingest && endOfSearch)) {
+        TRACE_COLLISION c;
+        c.record = nbDone;
+        c.traceTime = (double)r->t / 1000.0;
+        c.replayTime = Timer::get_tick() - t0;
+        c.thread = r->thread;
+        if(ingest && endOfSearch) {
+          solved = true;
+          solvedAt = c;
+        } else {
+          nbCollision++;
+          if(col.size() < TRACE_MAX_COL)
+            col.push_back(c);
+        }
+      }
+
+      lastTraceTime = (double)r->t / 1000.0;
+      nbDone++;
+      if(nbDone % sampleStep == 0) {
+        TRACE_MEMORY m;
+        m.record = nbDone;
+        m.tableMB = hashTable.GetSizeMB();
+        m.rssMB = GetRSSMB();
+        mem.push_back(m);
+      }
+
+    }
+
+    if(!pace) {
+      addNs += Timer::get_ns() - n0;
+      ::printf("\r[Replay %.1f%%][%.0f DP/s][Table %.1fMB]  ",100.0 * (double)nbDone / (double)nbRecord,
+               (double)nbDone / ((double)addNs / 1e9),hashTable.GetSizeMB());
+    }
+
+  }
+
+  double replayTime = Timer::get_tick() - t0;
+  fclose(f);
+
+  double addTime = (double)addNs / 1e9;
+  double rate = (addTime > 0.0) ? (double)nbDone / addTime : 0.0;
+  ::printf("\nReplay: %.0f DP in %.3fs (trace %.3fs), %.0f inserts/s, %.1f ns/insert\n",(double)nbDone,replayTime,
+           lastTraceTime,rate,(nbDone > 0) ? (double)addNs / (double)nbDone : 0.0);
+  if(ingest)
+    ::printf("Replay: [Added %.0f][Dead %.0f]\n",(double)nbStatus[ADD_OK],(double)collisionInSameHerd);
+  else
+    ::printf("Replay: [OK %.0f][Duplicate %.0f][Collision %.0f][Status mismatch %.0f]\n",(double)nbStatus[ADD_OK],
+             (double)nbStatus[ADD_DUPLICATE],(double)nbStatus[ADD_COLLISION],(double)nbMismatch);
+  ::printf("Replay: table %.1fMB, RSS %.1fMB\n",hashTable.GetSizeMB(),GetRSSMB());
+  for(size_t i = 0; i < col.size() && i < 8; i++)
+    ::printf("Collision: DP #%.0f, thread %d, trace %.3fs, replay %.3fs\n",(double)col[i].record,col[i].thread,
+             col[i].traceTime,col[i].replayTime);
+  if(solved)
+    ::printf("Solved: DP #%.0f, thread %d, trace %.3fs, replay %.3fs\n",(double)solvedAt.record,solvedAt.thread,
+             solvedAt.traceTime,solvedAt.replayTime);
+
+  if(reportFile.length() == 0)
+    return;
+
+  FILE *fr = fopen(reportFile.c_str(),"w");
+  if(fr == NULL) {
+    ::printf("ReplayTrace: Cannot open %s for writing\n",reportFile.c_str());
+    ::printf("%s\n",::strerror(errno));
+    return;
+  }
+
+  ::fprintf(fr,"{\n");
+  ::fprintf(fr,"  \"version\": \"%s\",\n",RELEASE);
+  ::fprintf(fr,"  \"trace\": \"%s\",\n",fileName.c_str());
+  ::fprintf(fr,"  \"mode\": \"%s\",\n",ingest ? "ingest" : "table");
+  ::fprintf(fr,"  \"pace\": %s,\n",pace ? "true" : "false");
+  ::fprintf(fr,"  \"dp_bits\": %d,\n",hd.dpSize);
+  ::fprintf(fr,"  \"records\": %.0f,\n",(double)nbDone);
+  ::fprintf(fr,"  \"trace_time\": %.3f,\n",lastTraceTime);
+  ::fprintf(fr,"  \"replay_time\": %.3f,\n",replayTime);
+  ::fprintf(fr,"  \"inserts_per_s\": %.0f,\n",rate);
+  ::fprintf(fr,"  \"ns_per_insert\": %.3f,\n",(nbDone > 0) ? (double)addNs / (double)nbDone : 0.0);
+  ::fprintf(fr,"  \"ok\": %.0f,\n",(double)nbStatus[ADD_OK]);
+  if(ingest) {
+    ::fprintf(fr,"  \"dead\": %.0f,\n",(double)collisionInSameHerd);
+  } else {
+    ::fprintf(fr,"  \"duplicate\": %.0f,\n",(double)nbStatus[ADD_DUPLICATE]);
+    ::fprintf(fr,"  \"collision\": %.0f,\n",(double)nbCollision);
+    ::fprintf(fr,"  \"status_mismatch\": %.0f,\n",(double)nbMismatch);
+  }
+  if(solved)
+    ::fprintf(fr,"  \"solved\": {\"record\": %.0f, \"thread\": %d, \"trace_time\": %.3f, \"replay_time\": %.3f},\n",
+              (double)solvedAt.record,solvedAt.thread,solvedAt.traceTime,solvedAt.replayTime);
+  ::fprintf(fr,"  \"table_mb\": %.3f,\n",hashTable.GetSizeMB());
+  ::fprintf(fr,"  \"rss_mb\": %.3f,\n",GetRSSMB());
+  ::fprintf(fr,"  \"memory\": [\n");
+  for(size_t i = 0; i < mem.size(); i++)
+    ::fprintf(fr,"    {\"records\": %.0f, \"table_mb\": %.3f, \"rss_mb\": %.3f}%s\n",(double)mem[i].record,
+              mem[i].tableMB,mem[i].rssMB,(i + 1 < mem.size()) ? "," : "");
+  ::fprintf(fr,"  ],\n");
+  ::fprintf(fr,"  \"collisions\": [\n");
+  for(size_t i = 0; i < col.size(); i++)
+    ::fprintf(fr,"    {\"record\": %.0f, \"thread\": %d, \"trace_time\": %.3f, \"replay_time\": %.3f}%s\n",
+              (double)col[i].record,col[i].thread,col[i].traceTime,col[i].replayTime,(i + 1 < col.size()) ? "," : "");
+  ::fprintf(fr,"  ]\n");
+  ::fprintf(fr,"}\n");
+  ::fclose(fr);
+
+  ::printf("Report saved: %s\n",reportFile.c_str());
+
+}
@@ -56,11 +56,41 @@ void printUsage() {
   printf(" -m maxStep: number of operations before give up the search (maxStep*expected operation)\n");
   printf(" -s: Start in server mode\n");
   printf(" -c server_ip: Start in client mode and connect to server server_ip\n");
+  printf("    server_ip1[:port1],server_ip2[:port2],...: connect to several server shards\n");
+  printf(" -shard idx/count: Server handles only the shard idx (0 based) of the DP table\n");
+  printf(" -relay server_ip: Start in relay mode, act as a server for local clients and forward DP to server_ip\n");
   printf(" -sp port: Server port, default is 17403\n");
   printf(" -nt timeout: Network timeout in millisec (default is 3000ms)\n");
+  printf(" -lt sizeMB: Client local DP table size in MB (duplicate filtering), default is 0 (disabled)\n");
+  printf(" -maxram sizeMB: DP table RAM budget, the DP size is raised at runtime to fit (server or standalone)\n");
   printf(" -o fileName: output result to fileName\n");
   printf(" -l: List cuda enabled devices\n");
   printf(" -check: Check GPU kernel vs CPU\n");
+  printf(" -mk: Solve all keys of the input file concurrently (shared tame herd, CPU only)\n");
+  printf(" -jn nbJump: Number of random jumps, power of 2 in [8..%d] (default is %d)\n",MAX_JUMP,NB_JUMP);
+  printf(" -jm meanBit|auto: Mean jump 2^meanBit, auto: derived from the number of kangaroos (default from range width)\n");
+  printf(" -precompute tableFile nbEntry: Run tame kangaroos only and save the nbEntry most useful DP (CPU only)\n");
+  printf(" -pt tableFile: Load a precomputed tame DP table and run wild kangaroos only (CPU only)\n");
+  printf(" -optjump jumpFile rangeBits nbCandidate nbSolve: Simulate nbSolve solves on a 2^rangeBits range for each\n");
+  printf("    candidate jump set and save the best one to jumpFile (CPU only)\n");
+  printf(" -jf jumpFile: Use the jump set of jumpFile (scaled to the range width)\n");
+  printf(" -gw windowBits: Fixed base table window in [4..16], default is 8 (memory 2^windowBits*256/windowBits points)\n");
+  printf(" -herd ratio[,tameStart,tameWidth,wildStart,wildWidth]: Tame fraction of the herd and start windows\n");
+  printf("    (start and width in range width unit), default is 0.5,0,1,-0.5,1\n");
+  printf(" -4k: Four-kangaroo walk, two tame herds of distinct parity and two wild herds from k and -k (CPU only)\n");
+  printf(" -hs: Create kangaroos by stepping from random base points (fast herd creation)\n");
+  printf(" -bench-solve nbKey rangeBits: Solve nbKey random keys in [2^rangeBits,2^(rangeBits+1)-1] and report statistics\n");
+  printf(" -bench-out reportFile: Save the -bench-solve report to reportFile (JSON)\n");
+  printf(" -metrics fileName: Append status metrics to fileName (one JSON line per status update)\n");
+  printf(" -metricsport port: Serve status metrics (Prometheus text format) on 127.0.0.1:port\n");
+  printf(" -autotune: Benchmark CPU group sizes, thread counts and placements at startup, result cached in kangaroo.tune\n");
+  printf(" -perf: Profile the CPU walk with hardware counters, IPC and misses per step of each phase (Linux)\n");
+  printf(" -sendperiod s: DP send period of the clients and flush period of the server in seconds, default is %.1f\n",SEND_PERIOD);
+  printf(" -numa: Pin CPU threads to NUMA nodes (round robin), herds are allocated on the node of their thread\n");
+  printf(" -hugepages thp|tlb: Back DP table entries and herds with transparent (thp) or explicit (tlb, hugetlbfs) huge pages\n");
+  printf(" -dptrace fileName: Record every DP added to the table (time, thread, status) to fileName, see kangaroo-bench -replay\n");
+  printf(" -floodtest nbConn dpRate: Client without EC arithmetic, flood the server (-c) with dpRate random DP/s over nbConn connections\n");
+  printf(" -floodkey privKey delay: Plant a tame/wild collision of privKey after delay seconds of -floodtest\n");
   printf(" inFile: intput configuration file\n");
   exit(0);
 
@@ -133,6 +163,33 @@ void getInts(string name,vector<int> &tokens,const string &text,char sep) {
 
   }
 
+}
+
+void getDoubles(string name,vector<double> &tokens,const string &text,char sep) {
+
+  size_t start = 0,end = 0;
+  tokens.clear();
+  double item;
+
+  try {
+
+    while((end = text.find(sep,start)) != string::npos) {
+      item = std::stod(text.substr(start,end - start));
+      tokens.push_back(item);
+      start = end + 1;
+    }
+
+    item = std::stod(text.substr(start));
+    tokens.push_back(item);
+
+  }
+  catch(std::invalid_argument &) {
+
+    printf("Invalid %s argument, number expected\n",name.c_str());
+    exit(-1);
+
+  }
+
 }
 // ------------------------------------------------------------------------------------------
 
@@ -163,6 +220,40 @@ static bool serverMode = false;
 static string serverIP = "";
 static string outputFile = "";
 static bool splitWorkFile = false;
+static int localTableSize = 0;
+static vector<int> shard = { 0,1 };
+static bool relayMode = false;
+static bool multiKey = false;
+static string precompFile = "";
+static int precompSize = 0;
+static string tableFile = "";
+static int nbJump = NB_JUMP;
+static int jumpMean = -1;
+static string jumpFile = "";
+static string optJumpFile = "";
+static int optJumpBits = 0;
+static int optJumpCandidate = 0;
+static int optJumpSolve = 0;
+static int benchKey = 0;
+static int benchBits = 0;
+static string benchFile = "";
+static bool herdStep = false;
+static int gWindow = 8;
+static int maxRam = 0;
+static vector<double> herdLayout;
+static bool fourKangaroo = false;
+static string metricsFile = "";
+static int metricsPort = 0;
+static bool perfMode = false;
+static bool autoTune = false;
+static bool numaMode = false;
+static double sendPeriod = SEND_PERIOD;
+static int hugePages = HUGE_PAGE_OFF;
+static string traceName = "";
+static int floodConn = 0;
+static double floodRate = 0.0;
+static string floodKey = "";
+static double floodDelay = 0.0;
 
 int main(int argc, char* argv[]) {
 
@@ -278,6 +369,19 @@ int main(int argc, char* argv[]) {
       CHECKARG("-c",1);
       serverIP = string(argv[a]);
       a++;
+    } else if(strcmp(argv[a],"-relay") == 0) {
+      CHECKARG("-relay",1);
+      serverIP = string(argv[a]);
+      relayMode = true;
+      a++;
+    } else if(strcmp(argv[a],"-shard") == 0) {
+      CHECKARG("-shard",1);
+      getInts("shard",shard,string(argv[a]),'/');
+      a++;
+    } else if(strcmp(argv[a],"-lt") == 0) {
+      CHECKARG("-lt",1);
+      localTableSize = getInt("localTableSize",argv[a]);
+      a++;
     } else if(strcmp(argv[a],"-sp") == 0) {
       CHECKARG("-sp",1);
       port = getInt("serverPort",argv[a]);
@@ -295,6 +399,117 @@ int main(int argc, char* argv[]) {
       a++;
     } else if(strcmp(argv[a],"-v") == 0) {
       ::exit(0);
+    } else if(strcmp(argv[a],"-mk") == 0) {
+      multiKey = true;
+      a++;
+    } else if(strcmp(argv[a],"-jn") == 0) {
+      CHECKARG("-jn",1);
+      nbJump = getInt("nbJump",argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-jm") == 0) {
+      CHECKARG("-jm",1);
+      jumpMean = (strcmp(argv[a],"auto") == 0) ? 0 : getInt("meanBit",argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-precompute") == 0) {
+      CHECKARG("-precompute",1);
+      precompFile = string(argv[a]);
+      CHECKARG("-precompute",2);
+      precompSize = getInt("nbEntry",argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-pt") == 0) {
+      CHECKARG("-pt",1);
+      tableFile = string(argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-optjump") == 0) {
+      CHECKARG("-optjump",1);
+      optJumpFile = string(argv[a]);
+      CHECKARG("-optjump",2);
+      optJumpBits = getInt("rangeBits",argv[a]);
+      CHECKARG("-optjump",3);
+      optJumpCandidate = getInt("nbCandidate",argv[a]);
+      CHECKARG("-optjump",4);
+      optJumpSolve = getInt("nbSolve",argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-gw") == 0) {
+      CHECKARG("-gw",1);
+      gWindow = getInt("windowBits",argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-maxram") == 0) {
+      CHECKARG("-maxram",1);
+      maxRam = getInt("maxRam",argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-herd") == 0) {
+      CHECKARG("-herd",1);
+      getDoubles("herd",herdLayout,string(argv[a]),',');
+      a++;
+    } else if(strcmp(argv[a],"-4k") == 0) {
+      fourKangaroo = true;
+      a++;
+    } else if(strcmp(argv[a],"-hs") == 0) {
+      herdStep = true;
+      a++;
+    } else if(strcmp(argv[a],"-bench-solve") == 0) {
+      CHECKARG("-bench-solve",1);
+      benchKey = getInt("nbKey",argv[a]);
+      CHECKARG("-bench-solve",2);
+      benchBits = getInt("rangeBits",argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-bench-out") == 0) {
+      CHECKARG("-bench-out",1);
+      benchFile = string(argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-metrics") == 0) {
+      CHECKARG("-metrics",1);
+      metricsFile = string(argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-metricsport") == 0) {
+      CHECKARG("-metricsport",1);
+      metricsPort = getInt("metricsPort",argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-autotune") == 0) {
+      autoTune = true;
+      a++;
+    } else if(strcmp(argv[a],"-perf") == 0) {
+      perfMode = true;
+      a++;
+    } else if(strcmp(argv[a],"-sendperiod") == 0) {
+      CHECKARG("-sendperiod",1);
+      sendPeriod = getDouble("sendPeriod",argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-numa") == 0) {
+      numaMode = true;
+      a++;
+    } else if(strcmp(argv[a],"-hugepages") == 0) {
+      CHECKARG("-hugepages",1);
+      if(strcmp(argv[a],"thp") == 0) {
+        hugePages = HUGE_PAGE_THP;
+      } else if(strcmp(argv[a],"tlb") == 0) {
+        hugePages = HUGE_PAGE_TLB;
+      } else {
+        printf("Invalid -hugepages argument, thp or tlb expected\n");
+        exit(-1);
+      }
+      a++;
+    } else if(strcmp(argv[a],"-dptrace") == 0) {
+      CHECKARG("-dptrace",1);
+      traceName = string(argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-floodtest") == 0) {
+      CHECKARG("-floodtest",1);
+      floodConn = getInt("nbConn",argv[a]);
+      CHECKARG("-floodtest",2);
+      floodRate = getDouble("dpRate",argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-floodkey") == 0) {
+      CHECKARG("-floodkey",1);
+      floodKey = string(argv[a]);
+      CHECKARG("-floodkey",2);
+      floodDelay = getDouble("delay",argv[a]);
+      a++;
+    } else if(strcmp(argv[a],"-jf") == 0) {
+      CHECKARG("-jf",1);
+      jumpFile = string(argv[a]);
+      a++;
     } else if(strcmp(argv[a],"-check") == 0) {
       checkFlag = true;
       a++;
@@ -318,8 +533,131 @@ int main(int argc, char* argv[]) {
     exit(-1);
   }
 
+  if(shard.size() != 2 || shard[1] < 1 || shard[0] < 0 || shard[0] >= shard[1]) {
+    printf("Invalid shard argument, idx/count expected with 0<=idx<count\n");
+    exit(-1);
+  }
+
+  if(nbJump < 8 || nbJump > MAX_JUMP || (nbJump & (nbJump - 1)) != 0) {
+    printf("Invalid nbJump argument, power of 2 in [8..%d] expected\n",MAX_JUMP);
+    exit(-1);
+  }
+
+  if(jumpMean > 127 || jumpMean < -1 || (jumpMean == 0 && serverMode)) {
+    printf("Invalid meanBit argument, 1..127 expected (auto not allowed in server mode)\n");
+    exit(-1);
+  }
+
+  if(multiKey && (serverMode || relayMode || serverIP.length() > 0 || gpuEnable ||
+                  workFile.length() > 0 || iWorkFile.length() > 0)) {
+    printf("-mk cannot be used with -s, -c, -relay, -gpu, -w or -i\n");
+    exit(-1);
+  }
+
+  if((precompFile.length() > 0 || tableFile.length() > 0) && (serverMode || relayMode || serverIP.length() > 0 ||
+                                                             gpuEnable || multiKey || iWorkFile.length() > 0)) {
+    printf("-precompute and -pt cannot be used with -s, -c, -relay, -gpu, -mk or -i\n");
+    exit(-1);
+  }
+
+  if(gWindow != secp->GetWindow()) {
+    if(!secp->SetWindow(gWindow)) {
+      printf("Invalid windowBits argument, 4..16 expected\n");
+      exit(-1);
+    }
+    printf("Fixed base table: window %d [%.1fMB]\n",gWindow,secp->GetTableSize());
+  }
+
+  if(optJumpFile.length() > 0 && (jumpFile.length() > 0 || gpuEnable || serverMode || relayMode ||
+                                  serverIP.length() > 0)) {
+    printf("-optjump cannot be used with -jf, -gpu, -s, -c or -relay\n");
+    exit(-1);
+  }
+
+  if(benchKey > 0 && (serverMode || relayMode || serverIP.length() > 0 || multiKey || workFile.length() > 0 ||
+                      iWorkFile.length() > 0 || precompFile.length() > 0 || optJumpFile.length() > 0)) {
+    printf("-bench-solve cannot be used with -s, -c, -relay, -mk, -w, -i, -precompute or -optjump\n");
+    exit(-1);
+  }
+
+  if(maxRam != 0 && maxRam < 64) {
+    printf("Invalid maxRam argument, at least 64MB expected\n");
+    exit(-1);
+  }
+
+  if(maxRam > 0 && (relayMode || serverIP.length() > 0 || multiKey || precompFile.length() > 0 || tableFile.length() > 0)) {
+    printf("-maxram cannot be used with -c, -relay, -mk, -precompute or -pt\n");
+    exit(-1);
+  }
+
+  if(herdLayout.size() > 0 && (relayMode || serverIP.length() > 0 || precompFile.length() > 0 || tableFile.length() > 0)) {
+    printf("-herd cannot be used with -c, -relay, -precompute or -pt\n");
+    exit(-1);
+  }
+
+  if(fourKangaroo && (relayMode || serverIP.length() > 0 || gpuEnable || multiKey || precompFile.length() > 0 ||
+                      tableFile.length() > 0 || herdLayout.size() > 0 || optJumpFile.length() > 0)) {
+    printf("-4k cannot be used with -c, -relay, -gpu, -mk, -precompute, -pt, -herd or -optjump\n");
+    exit(-1);
+  }
+
+  if(sendPeriod < 0.01 || sendPeriod > 3600.0) {
+    printf("Invalid sendPeriod argument, 0.01..3600 expected\n");
+    exit(-1);
+  }
+
+  if(metricsPort < 0 || metricsPort > 65535 || metricsPort == port) {
+    printf("Invalid metricsPort argument, 1..65535 expected, distinct from the server port\n");
+    exit(-1);
+  }
+
+  if(perfMode && (serverMode || relayMode || benchKey > 0)) {
+    printf("-perf cannot be used with -s, -relay or -bench-solve\n");
+    exit(-1);
+  }
+
+  if(traceName.length() > 0 && (relayMode || serverIP.length() > 0 || multiKey || precompFile.length() > 0 ||
+                                 tableFile.length() > 0 || benchKey > 0)) {
+    printf("-dptrace cannot be used with -c, -relay, -mk, -precompute, -pt or -bench-solve\n");
+    exit(-1);
+  }
+
+  if(floodConn != 0 || floodRate != 0.0) {
+    if(floodConn < 1 || floodRate <= 0.0) {
+      printf("Invalid -floodtest argument, nbConn >= 1 and dpRate > 0 expected\n");
+      exit(-1);
+    }
+    if(serverIP.length() == 0 || serverMode || relayMode) {
+      printf("-floodtest requires -c and cannot be used with -s or -relay\n");
+      exit(-1);
+    }
+  }
+
+  if(floodKey.length() > 0 && (floodConn == 0 || floodDelay < 0.0)) {
+    printf("-floodkey requires -floodtest and a positive delay\n");
+    exit(-1);
+  }
+
+#ifdef WIN64
+  if(numaMode || hugePages != HUGE_PAGE_OFF) {
+    printf("-numa and -hugepages are not supported on Windows, ignored\n");
+    numaMode = false;
+    hugePages = HUGE_PAGE_OFF;
+  }
+#endif
+  HashTable::SetHugePages(hugePages);
+
+#ifdef USE_SYMMETRY
+  if(fourKangaroo) {
+    printf("-4k cannot be used with symmetry (USE_SYMMETRY)\n");
+    exit(-1);
+  }
+#endif
+
   Kangaroo *v = new Kangaroo(secp,dp,gpuEnable,workFile,iWorkFile,savePeriod,saveKangaroo,saveKangarooByServer,
-                             maxStep,wtimeout,port,ntimeout,serverIP,outputFile,splitWorkFile);
+                             maxStep,wtimeout,port,ntimeout,serverIP,outputFile,splitWorkFile,localTableSize,shard[0],shard[1],multiKey,
+                             tableFile,nbJump,jumpMean,jumpFile,herdStep,maxRam,herdLayout,fourKangaroo,
+                             metricsFile,metricsPort,perfMode,autoTune,numaMode,sendPeriod,traceName);
   if(checkFlag) {
     v->Check(gpuId,gridSize);  
     exit(0);
@@ -336,6 +674,12 @@ int main(int argc, char* argv[]) {
     } else if(merge1.length()>0) {
       v->MergeWork(merge1,merge2,mergeDest);
       exit(0);
+    } else if(optJumpFile.length() > 0) {
+      v->OptimizeJump(nbCPUThread,optJumpFile,optJumpBits,optJumpCandidate,optJumpSolve);
+      exit(0);
+    } else if(benchKey > 0) {
+      v->BenchSolve(nbCPUThread,gpuId,gridSize,benchKey,benchBits,benchFile);
+      exit(0);
     } if(iWorkFile.length()>0) {
       if( !v->LoadWork(iWorkFile) )
         exit(-1);
@@ -348,8 +692,14 @@ int main(int argc, char* argv[]) {
         exit(-1);
       }
     }
-    if(serverMode)
+    if(precompFile.length() > 0)
+      v->Precompute(nbCPUThread,precompFile,precompSize);
+    else if(relayMode)
+      v->RunRelay();
+    else if(serverMode)
       v->RunServer();
+    else if(floodConn > 0)
+      v->FloodTest(floodConn,floodRate,floodKey,floodDelay);
     else
       v->Run(nbCPUThread,gpuId,gridSize);
   }